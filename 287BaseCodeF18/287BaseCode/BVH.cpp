@@ -0,0 +1,461 @@
+#include <algorithm>
+#include "BVH.h"
+#include "RenderStats.h"
+
+/**
+ * @fn	static float halfArea(const glm::vec3 &lo, const glm::vec3 &hi)
+ * @brief	Half the surface area of a box, which is all the heuristic needs.
+ * @param	lo	The lower corner.
+ * @param	hi	The upper corner.
+ * @return	Half the surface area.
+ */
+
+static float halfArea(const glm::vec3 &lo, const glm::vec3 &hi) {
+	const glm::vec3 d = glm::max(hi - lo, glm::vec3(0.0f));
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+/**
+ * @fn	static bool hitsBox(const BVHNode &node, const glm::vec3 &origin, const glm::vec3 &invDir, float tMax, float &tNear)
+ * @brief	Slab test of a ray against a node's box.
+ * @param 		  	node  	The node.
+ * @param 		  	origin	The ray's origin.
+ * @param 		  	invDir	1 / the ray's direction, per component.
+ * @param 		  	tMax  	Farthest distance of interest.
+ * @param [in,out]	tNear 	Where the ray enters the box, or 0 if it starts inside.
+ * @return	True iff the ray enters the box between 0 and tMax.
+ */
+
+static bool hitsBox(const BVHNode &node, const glm::vec3 &origin, const glm::vec3 &invDir, float tMax, float &tNear) {
+	float tMin = 0.0f;
+	for (int axis = 0; axis < 3; axis++) {
+		const float t1 = (node.lo[axis] - origin[axis]) * invDir[axis];
+		const float t2 = (node.hi[axis] - origin[axis]) * invDir[axis];
+		tMin = std::max(tMin, std::min(t1, t2));
+		tMax = std::min(tMax, std::max(t1, t2));
+	}
+	tNear = tMin;
+	return tMin <= tMax;
+}
+
+/**
+ * @fn	static void setBox(BVHNode &node, const glm::vec3 &lo, const glm::vec3 &hi)
+ * @brief	Sets a node's box.
+ * @param [in,out]	node	The node.
+ * @param 		  	lo  	The lower corner.
+ * @param 		  	hi  	The upper corner.
+ */
+
+static void setBox(BVHNode &node, const glm::vec3 &lo, const glm::vec3 &hi) {
+	for (int axis = 0; axis < 3; axis++) {
+		node.lo[axis] = lo[axis];
+		node.hi[axis] = hi[axis];
+	}
+}
+
+/**
+ * @fn	void BVH::gatherBounds(const std::vector<VisibleIShapePtr> &objects, std::vector<glm::vec3> &lo, std::vector<glm::vec3> &hi, std::vector<bool> &bounded)
+ * @brief	Gets the box of each object, padded by EPSILON so rounding in the shapes'
+ * 			intersection code cannot put a hit outside it.
+ * @param 		  	objects	The objects.
+ * @param [in,out]	lo	   	Lower corner of each object's box.
+ * @param [in,out]	hi	   	Upper corner of each object's box.
+ * @param [in,out]	bounded	Whether each object has a box at all.
+ */
+
+void BVH::gatherBounds(const std::vector<VisibleIShapePtr> &objects, std::vector<glm::vec3> &lo,
+						std::vector<glm::vec3> &hi, std::vector<bool> &bounded) {
+	lo.resize(objects.size());
+	hi.resize(objects.size());
+	bounded.resize(objects.size());
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		bounded[i] = objects[i]->shape->getBounds(lo[i], hi[i]);
+		if (bounded[i]) {
+			lo[i] -= glm::vec3(EPSILON);
+			hi[i] += glm::vec3(EPSILON);
+		}
+	}
+}
+
+/**
+ * @fn	void BVH::build(const std::vector<VisibleIShapePtr> &objects)
+ * @brief	Builds the hierarchy over a list of objects, replacing any previous one.
+ * @param	objects	The objects.
+ */
+
+void BVH::build(const std::vector<VisibleIShapePtr> &objects) {
+	std::vector<glm::vec3> lo, hi;
+	std::vector<bool> bounded;
+	gatherBounds(objects, lo, hi, bounded);
+	build(lo, hi, bounded);
+}
+
+/**
+ * @fn	void BVH::build(const std::vector<glm::vec3> &lo, const std::vector<glm::vec3> &hi, const std::vector<bool> &bounded)
+ * @brief	Builds the hierarchy from boxes given by gatherBounds. Touches no objects,
+ * 			so it may run on another thread while they move.
+ * @param	lo	   	Lower corner of each object's box.
+ * @param	hi	   	Upper corner of each object's box.
+ * @param	bounded	Whether each object has a box at all.
+ */
+
+void BVH::build(const std::vector<glm::vec3> &lo, const std::vector<glm::vec3> &hi, const std::vector<bool> &bounded) {
+	clear();
+	numObjects = (int)bounded.size();
+	std::vector<glm::vec3> centroids(bounded.size());
+	for (int i = 0; i < numObjects; i++) {
+		if (bounded[i]) {
+			centroids[i] = 0.5f * (lo[i] + hi[i]);
+			objectIndices.push_back(i);
+		} else {
+			unboundedObjects.push_back(i);
+		}
+	}
+	if (objectIndices.empty()) {
+		return;
+	}
+	nodes.reserve(2 * objectIndices.size());
+	nodes.push_back(BVHNode());
+	buildNode(0, lo, hi, centroids, 0, (int)objectIndices.size(), 1);
+	builtCost = getCost();
+}
+
+/**
+ * @fn	void BVH::buildNode(int nodeIndex, const std::vector<glm::vec3> &lo, const std::vector<glm::vec3> &hi, const std::vector<glm::vec3> &centroids, int first, int count, int depth)
+ * @brief	Fills in one node, and recursively its children. The split is the best
+ * 			of BVH_BINS candidate planes on each axis by the surface area
+ * 			heuristic; if none beats a leaf, the objects are split at the median
+ * 			of the widest axis, unless they fit in one leaf.
+ * @param	nodeIndex	The node to fill in.
+ * @param	lo		 	Lower corner of each object's box.
+ * @param	hi		 	Upper corner of each object's box.
+ * @param	centroids	Center of each object's box.
+ * @param	first	 	First of the node's entries in objectIndices.
+ * @param	count	 	Number of the node's entries.
+ * @param	depth	 	Depth of the node; the root is 1.
+ */
+
+void BVH::buildNode(int nodeIndex, const std::vector<glm::vec3> &lo, const std::vector<glm::vec3> &hi,
+					const std::vector<glm::vec3> &centroids, int first, int count, int depth) {
+	int *indices = &objectIndices[first];
+	glm::vec3 boxLo = lo[indices[0]], boxHi = hi[indices[0]];
+	glm::vec3 centroidLo = centroids[indices[0]], centroidHi = centroidLo;
+	for (int i = 1; i < count; i++) {
+		boxLo = glm::min(boxLo, lo[indices[i]]);
+		boxHi = glm::max(boxHi, hi[indices[i]]);
+		centroidLo = glm::min(centroidLo, centroids[indices[i]]);
+		centroidHi = glm::max(centroidHi, centroids[indices[i]]);
+	}
+	setBox(nodes[nodeIndex], boxLo, boxHi);
+	nodes[nodeIndex].first = first;
+	nodes[nodeIndex].count = count;
+
+	const glm::vec3 centroidExtent = centroidHi - centroidLo;
+	if (count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH ||
+		std::max(centroidExtent.x, std::max(centroidExtent.y, centroidExtent.z)) <= 0.0f) {
+		return;
+	}
+
+	// Sweep the bins of each axis, keeping the cheapest split.
+	int bestAxis = -1, bestSplit = 0;
+	float bestCost = count * halfArea(boxLo, boxHi);
+	for (int axis = 0; axis < 3; axis++) {
+		if (centroidExtent[axis] <= 0.0f) {
+			continue;
+		}
+		int binCounts[BVH_BINS] = { 0 };
+		glm::vec3 binLo[BVH_BINS], binHi[BVH_BINS];
+		const float scale = BVH_BINS / centroidExtent[axis];
+		for (int i = 0; i < count; i++) {
+			const int o = indices[i];
+			const int b = std::min(BVH_BINS - 1, (int)((centroids[o][axis] - centroidLo[axis]) * scale));
+			binLo[b] = binCounts[b] == 0 ? lo[o] : glm::min(binLo[b], lo[o]);
+			binHi[b] = binCounts[b] == 0 ? hi[o] : glm::max(binHi[b], hi[o]);
+			binCounts[b]++;
+		}
+		float rightCost[BVH_BINS];
+		int rightCount = 0;
+		glm::vec3 rightLo, rightHi;
+		for (int b = BVH_BINS - 1; b > 0; b--) {
+			if (binCounts[b] > 0) {
+				rightLo = rightCount == 0 ? binLo[b] : glm::min(rightLo, binLo[b]);
+				rightHi = rightCount == 0 ? binHi[b] : glm::max(rightHi, binHi[b]);
+				rightCount += binCounts[b];
+			}
+			rightCost[b] = rightCount == 0 ? 0.0f : rightCount * halfArea(rightLo, rightHi);
+		}
+		int leftCount = 0;
+		glm::vec3 leftLo, leftHi;
+		for (int b = 0; b < BVH_BINS - 1; b++) {
+			if (binCounts[b] > 0) {
+				leftLo = leftCount == 0 ? binLo[b] : glm::min(leftLo, binLo[b]);
+				leftHi = leftCount == 0 ? binHi[b] : glm::max(leftHi, binHi[b]);
+				leftCount += binCounts[b];
+			}
+			if (leftCount == 0 || leftCount == count) {
+				continue;
+			}
+			const float cost = leftCount * halfArea(leftLo, leftHi) + rightCost[b + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	int leftCount;
+	if (bestAxis >= 0) {
+		const int axis = bestAxis;
+		const float scale = BVH_BINS / centroidExtent[axis];
+		const float lowAxis = centroidLo[axis];
+		const int split = bestSplit;
+		int *middle = std::partition(indices, indices + count, [&](int o) {
+			return std::min(BVH_BINS - 1, (int)((centroids[o][axis] - lowAxis) * scale)) <= split;
+		});
+		leftCount = (int)(middle - indices);
+	} else {
+		int axis = 0;
+		if (centroidExtent.y > centroidExtent[axis]) axis = 1;
+		if (centroidExtent.z > centroidExtent[axis]) axis = 2;
+		leftCount = count / 2;
+		std::nth_element(indices, indices + leftCount, indices + count, [&](int a, int b) {
+			return centroids[a][axis] < centroids[b][axis];
+		});
+	}
+
+	const int left = (int)nodes.size();
+	nodes.push_back(BVHNode());
+	nodes.push_back(BVHNode());
+	nodes[nodeIndex].first = left;
+	nodes[nodeIndex].count = 0;
+	buildNode(left, lo, hi, centroids, first, leftCount, depth + 1);
+	buildNode(left + 1, lo, hi, centroids, first + leftCount, count - leftCount, depth + 1);
+}
+
+/**
+ * @fn	void BVH::linkNodes()
+ * @brief	Records each node's parent and each object's leaf, which refitting
+ * 			walks. Not stored with the nodes, so a hierarchy read from a file gets
+ * 			them on its first refit.
+ */
+
+void BVH::linkNodes() {
+	parents.assign(nodes.size(), -1);
+	leafOf.assign(numObjects, -1);
+	for (unsigned int n = 0; n < nodes.size(); n++) {
+		const BVHNode &node = nodes[n];
+		if (node.count > 0) {
+			for (int i = 0; i < node.count; i++) {
+				leafOf[objectIndices[node.first + i]] = n;
+			}
+		} else {
+			parents[node.first] = n;
+			parents[node.first + 1] = n;
+		}
+	}
+}
+
+/**
+ * @fn	void BVH::refit(const std::vector<VisibleIShapePtr> &objects, const std::vector<bool> &moved)
+ * @brief	Updates the boxes after objects have moved, keeping the tree's shape.
+ * 			Only the leaves holding moved objects and their ancestors are
+ * 			recomputed, bottom up. The tree may fit worse than a rebuilt one;
+ * 			see needsRebuild.
+ * @param	objects	The objects the hierarchy was built for.
+ * @param	moved  	Whether each object has moved since the last build or refit.
+ */
+
+void BVH::refit(const std::vector<VisibleIShapePtr> &objects, const std::vector<bool> &moved) {
+	if (nodes.empty()) {
+		return;
+	}
+	if (parents.size() != nodes.size() || (int)leafOf.size() != numObjects) {
+		linkNodes();
+	}
+
+	// Flag the leaves of moved objects and everything above them.
+	std::vector<bool> stale(nodes.size(), false);
+	for (int i = 0; i < numObjects; i++) {
+		if (!moved[i]) {
+			continue;
+		}
+		for (int n = leafOf[i]; n >= 0 && !stale[n]; n = parents[n]) {
+			stale[n] = true;
+		}
+	}
+
+	// Children always come after their parent, so a backward sweep is bottom up.
+	for (int n = (int)nodes.size() - 1; n >= 0; n--) {
+		if (!stale[n]) {
+			continue;
+		}
+		BVHNode &node = nodes[n];
+		glm::vec3 boxLo, boxHi;
+		if (node.count > 0) {
+			for (int i = 0; i < node.count; i++) {
+				glm::vec3 objectLo, objectHi;
+				objects[objectIndices[node.first + i]]->shape->getBounds(objectLo, objectHi);
+				boxLo = i == 0 ? objectLo : glm::min(boxLo, objectLo);
+				boxHi = i == 0 ? objectHi : glm::max(boxHi, objectHi);
+			}
+			boxLo -= glm::vec3(EPSILON);
+			boxHi += glm::vec3(EPSILON);
+		} else {
+			const BVHNode &left = nodes[node.first];
+			const BVHNode &right = nodes[node.first + 1];
+			for (int axis = 0; axis < 3; axis++) {
+				boxLo[axis] = std::min(left.lo[axis], right.lo[axis]);
+				boxHi[axis] = std::max(left.hi[axis], right.hi[axis]);
+			}
+		}
+		setBox(node, boxLo, boxHi);
+	}
+}
+
+/**
+ * @fn	void BVH::clear()
+ * @brief	Empties the hierarchy.
+ */
+
+void BVH::clear() {
+	nodes.clear();
+	objectIndices.clear();
+	unboundedObjects.clear();
+	parents.clear();
+	leafOf.clear();
+	numObjects = 0;
+	builtCost = 0.0f;
+}
+
+/**
+ * @fn	bool BVH::isBuiltFor(const std::vector<VisibleIShapePtr> &objects) const
+ * @brief	Query if the hierarchy covers a list of objects.
+ * @param	objects	The objects.
+ * @return	True iff the hierarchy was built for a list of this length.
+ */
+
+bool BVH::isBuiltFor(const std::vector<VisibleIShapePtr> &objects) const {
+	return numObjects > 0 && numObjects == (int)objects.size();
+}
+
+/**
+ * @fn	float BVH::getCost() const
+ * @brief	Expected cost of tracing a ray that hits the root's box, by the surface
+ * 			area heuristic: each node is weighted by how likely such a ray is to
+ * 			enter it, and a leaf costs one test per object.
+ * @return	The cost, in node visits and object tests.
+ */
+
+float BVH::getCost() const {
+	if (nodes.empty()) {
+		return 0.0f;
+	}
+	float total = 0.0f;
+	for (unsigned int n = 0; n < nodes.size(); n++) {
+		const BVHNode &node = nodes[n];
+		const float area = halfArea(glm::vec3(node.lo[0], node.lo[1], node.lo[2]),
+									glm::vec3(node.hi[0], node.hi[1], node.hi[2]));
+		total += (node.count > 0 ? node.count : 1) * area;
+	}
+	const float rootArea = halfArea(glm::vec3(nodes[0].lo[0], nodes[0].lo[1], nodes[0].lo[2]),
+									glm::vec3(nodes[0].hi[0], nodes[0].hi[1], nodes[0].hi[2]));
+	return rootArea > 0.0f ? total / rootArea : 0.0f;
+}
+
+/**
+ * @fn	bool BVH::needsRebuild() const
+ * @brief	Query if refitting has degraded the tree enough that it is worth
+ * 			building a new one, i.e., its cost exceeds BVH_REFIT_LIMIT times its
+ * 			cost when built.
+ * @return	True iff the hierarchy should be rebuilt.
+ */
+
+bool BVH::needsRebuild() const {
+	return builtCost > 0.0f && getCost() > BVH_REFIT_LIMIT * builtCost;
+}
+
+/**
+ * @fn	HitRecord BVH::findIntersection(const Ray &ray, const std::vector<VisibleIShapePtr> &objects) const
+ * @brief	Searches for the first intersection, like VisibleIShape::findIntersection,
+ * 			but only testing the objects whose boxes the ray enters. Of objects hit
+ * 			at the same t, the earliest in the list wins, as it does there.
+ * @param	ray	   	The ray.
+ * @param	objects	The objects the hierarchy was built for.
+ * @return	The closest intersection that is in front of the camera.
+ */
+
+HitRecord BVH::findIntersection(const Ray &ray, const std::vector<VisibleIShapePtr> &objects) const {
+	HitRecord theHit;
+	theHit.t = FLT_MAX;
+	int hitIndex = -1;
+
+	auto test = [&](int i) {
+		HitRecord thisHit;
+		objects[i]->findClosestIntersection(ray, thisHit);
+		if (thisHit.t > 0 && (thisHit.t < theHit.t || (thisHit.t == theHit.t && hitIndex > i))) {
+			theHit = thisHit;
+			hitIndex = i;
+		}
+	};
+
+	for (unsigned int i = 0; i < unboundedObjects.size(); i++) {
+		test(unboundedObjects[i]);
+	}
+
+	if (!nodes.empty()) {
+		// Entries are (node, where the ray enters it); nearer children are popped first.
+		// The stack holds at most one entry per level, and no tree is deeper than
+		// BVH_MAX_DEPTH: build() stops there, and loaded trees are checked.
+		const glm::vec3 invDir = 1.0f / ray.direction;
+		int stackNodes[BVH_MAX_DEPTH + 1];
+		float stackNear[BVH_MAX_DEPTH + 1];
+		int top = 0;
+		int visited = 0;
+		float tNear;
+		if (hitsBox(nodes[0], ray.origin, invDir, theHit.t, tNear)) {
+			stackNodes[top] = 0;
+			stackNear[top++] = tNear;
+		}
+		while (top > 0) {
+			top--;
+			if (stackNear[top] > theHit.t) {
+				continue;
+			}
+			const BVHNode &node = nodes[stackNodes[top]];
+			visited++;
+			if (node.count > 0) {
+				for (int i = 0; i < node.count; i++) {
+					test(objectIndices[node.first + i]);
+				}
+				continue;
+			}
+			float tLeft, tRight;
+			const bool hitLeft = hitsBox(nodes[node.first], ray.origin, invDir, theHit.t, tLeft);
+			const bool hitRight = hitsBox(nodes[node.first + 1], ray.origin, invDir, theHit.t, tRight);
+			if (hitLeft && hitRight) {
+				const bool leftFirst = tLeft <= tRight;
+				stackNodes[top] = leftFirst ? node.first + 1 : node.first;
+				stackNear[top++] = leftFirst ? tRight : tLeft;
+				stackNodes[top] = leftFirst ? node.first : node.first + 1;
+				stackNear[top++] = leftFirst ? tLeft : tRight;
+			} else if (hitLeft || hitRight) {
+				stackNodes[top] = hitLeft ? node.first : node.first + 1;
+				stackNear[top++] = hitLeft ? tLeft : tRight;
+			}
+		}
+		RenderCounters *counters = RenderCounters::current;
+		if (counters != nullptr) {
+			counters->bvhNodesVisited += visited;
+		}
+	}
+
+	if (hitIndex >= 0) {
+		theHit.materialId = objects[hitIndex]->materialId;
+		theHit.texture = objects[hitIndex]->texture;
+		if (theHit.texture != nullptr) {
+			objects[hitIndex]->shape->getTexCoords(theHit.interceptPoint, theHit.u, theHit.v);
+		}
+	}
+	return theHit;
+}
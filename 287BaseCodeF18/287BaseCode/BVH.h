@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include "IShape.h"
+
+const int BVH_LEAF_SIZE = 4;			//!< Most objects stored in one leaf.
+const int BVH_BINS = 12;				//!< Candidate split planes per axis, when building.
+const int BVH_MAX_DEPTH = 64;			//!< Deepest tree the traversal stack can hold.
+const float BVH_REFIT_LIMIT = 1.5f;		//!< Rebuild once refitting makes the tree this much costlier than when built.
+
+/**
+ * @struct	BVHNode
+ * @brief	One node of a bounding volume hierarchy. Plain data, so nodes can be
+ * 			written to and read from a file as is.
+ */
+
+struct BVHNode {
+	float lo[3];		//!< Lower corner of the node's box
+	float hi[3];		//!< Upper corner of the node's box
+	int first;			//!< Leaf: first entry in objectIndices. Interior: the left child; the right child follows it.
+	int count;			//!< Number of objects in a leaf; 0 for interior nodes
+};
+
+/**
+ * @struct	BVH
+ * @brief	A bounding volume hierarchy over a list of visible objects, built with
+ * 			the surface area heuristic. Objects without bounds (e.g., planes) are
+ * 			kept aside and tested against every ray.
+ */
+
+struct BVH {
+	std::vector<BVHNode> nodes;				//!< The nodes; nodes[0] is the root
+	std::vector<int> objectIndices;			//!< Indices of the bounded objects, in leaf order
+	std::vector<int> unboundedObjects;		//!< Indices of the objects with no bounds
+	int numObjects;							//!< Length of the object list it was built for
+	float builtCost;						//!< getCost() right after the last build; 0 if unknown
+	std::vector<int> parents;				//!< Parent of each node, -1 for the root; filled in by refit
+	std::vector<int> leafOf;				//!< Leaf holding each object, -1 if unbounded; filled in by refit
+	BVH() : numObjects(0), builtCost(0.0f) {}
+	void build(const std::vector<VisibleIShapePtr> &objects);
+	void build(const std::vector<glm::vec3> &lo, const std::vector<glm::vec3> &hi, const std::vector<bool> &bounded);
+	void refit(const std::vector<VisibleIShapePtr> &objects, const std::vector<bool> &moved);
+	void clear();
+	bool isBuiltFor(const std::vector<VisibleIShapePtr> &objects) const;
+	float getCost() const;
+	bool needsRebuild() const;
+	HitRecord findIntersection(const Ray &ray, const std::vector<VisibleIShapePtr> &objects) const;
+	static void gatherBounds(const std::vector<VisibleIShapePtr> &objects, std::vector<glm::vec3> &lo,
+							std::vector<glm::vec3> &hi, std::vector<bool> &bounded);
+protected:
+	void linkNodes();
+	void buildNode(int nodeIndex, const std::vector<glm::vec3> &lo, const std::vector<glm::vec3> &hi,
+					const std::vector<glm::vec3> &centroids, int first, int count, int depth);
+};
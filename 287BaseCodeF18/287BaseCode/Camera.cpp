@@ -1,4 +1,7 @@
 #include "Camera.h"
+#include <algorithm>
+#include <cfloat>
+#include "SimdMath.h"
 
 /**
  * @fn	RaytracingCamera::RaytracingCamera(const glm::vec3 &viewingPos, const glm::vec3 &lookAtPt, const glm::vec3 &up)
@@ -70,6 +73,37 @@ glm::vec2 RaytracingCamera::getProjectionPlaneCoordinates(float x, float y) cons
 	return glm::vec2(u, v);
 }
 
+/**
+ * @fn	bool RaytracingCamera::getWindowBounds(const glm::vec3 &lo, const glm::vec3 &hi, BoundingBoxi &rect) const
+ * @brief	Gets the pixels whose rays could hit anything inside a box: the window
+ * 			bounds of the box's corners, widened by a pixel for sub-samples and
+ * 			clipped to the window. A box reaching behind the camera covers the
+ * 			whole window.
+ * @param	lo			The box's minimum corner.
+ * @param	hi			The box's maximum corner.
+ * @param [out]	rect	The pixels, inclusive.
+ * @return	True iff any pixels are covered.
+ */
+
+bool RaytracingCamera::getWindowBounds(const glm::vec3 &lo, const glm::vec3 &hi, BoundingBoxi &rect) const {
+	const int W = (int)nx;
+	const int H = (int)ny;
+	glm::vec2 windowLo(FLT_MAX), windowHi(-FLT_MAX);
+	for (int i = 0; i < 8; i++) {
+		const glm::vec3 corner((i & 1) ? hi.x : lo.x, (i & 2) ? hi.y : lo.y, (i & 4) ? hi.z : lo.z);
+		glm::vec2 window;
+		if (!getWindowCoordinates(corner, window)) {
+			rect = BoundingBoxi(0, W - 1, 0, H - 1);
+			return W > 0 && H > 0;
+		}
+		windowLo = glm::min(windowLo, window);
+		windowHi = glm::max(windowHi, window);
+	}
+	rect = BoundingBoxi(std::max(0, (int)std::floor(windowLo.x) - 1), std::min(W - 1, (int)std::ceil(windowHi.x) + 1),
+						std::max(0, (int)std::floor(windowLo.y) - 1), std::min(H - 1, (int)std::ceil(windowHi.y) + 1));
+	return rect.lx <= rect.rx && rect.ly <= rect.ry;
+}
+
 /**
  * @fn	void PerspectiveCamera::calculateViewingParameters(int W, int H)
  * @brief	Calculates the viewing parameters associated with this camera.
@@ -97,6 +131,47 @@ void PerspectiveCamera::calculateViewingParameters(int W, int H) {
 
 void OrthographicCamera::calculateViewingParameters(int W, int H) {
 	// fill in nx, ny, top, bottom, left, and right
+	nx = (float)W;
+	ny = (float)H;
+	top = ny / (2.0f * pixelsPerWorldUnit);
+	bottom = -top;
+	right = nx / (2.0f * pixelsPerWorldUnit);
+	left = -right;
+}
+
+/**
+ * @fn	bool PerspectiveCamera::getWindowCoordinates(const glm::vec3 &pt, glm::vec2 &window) const
+ * @brief	Projects a point into the window; getRay((x, y)) passes through it.
+ * @param	pt			  	The point, in world coordinates.
+ * @param [out]	window	The window coordinates of the point.
+ * @return	False if the point is not in front of the camera.
+ */
+
+bool PerspectiveCamera::getWindowCoordinates(const glm::vec3 &pt, glm::vec2 &window) const {
+	const glm::vec3 p = cameraFrame.toFrameCoords(pt);
+	if (p.z > -EPSILON) {
+		return false;
+	}
+	const float u = distToPlane * p.x / -p.z;
+	const float v = distToPlane * p.y / -p.z;
+	window.x = (u - left) * nx / (right - left) - 0.5f;
+	window.y = (v - bottom) * ny / (top - bottom) - 0.5f;
+	return true;
+}
+
+/**
+ * @fn	bool OrthographicCamera::getWindowCoordinates(const glm::vec3 &pt, glm::vec2 &window) const
+ * @brief	Projects a point into the window; getRay((x, y)) passes through it.
+ * @param	pt			  	The point, in world coordinates.
+ * @param [out]	window	The window coordinates of the point.
+ * @return	Always true; points behind the camera are not culled.
+ */
+
+bool OrthographicCamera::getWindowCoordinates(const glm::vec3 &pt, glm::vec2 &window) const {
+	const glm::vec3 p = cameraFrame.toFrameCoords(pt);
+	window.x = (p.x - left) * nx / (right - left) - 0.5f;
+	window.y = (p.y - bottom) * ny / (top - bottom) - 0.5f;
+	return true;
 }
 
 /**
@@ -122,11 +197,149 @@ Ray OrthographicCamera::getRay(float x, float y) const {
 
 Ray PerspectiveCamera::getRay(float x, float y) const {
 	glm::vec2 uv = getProjectionPlaneCoordinates(x, y);
-	glm::vec3 rayDirection = glm::normalize((float)(-distToPlane) * cameraFrame.w +
-		uv.x * cameraFrame.u + uv.y * cameraFrame.v);
+	glm::vec3 rayDirection = (float)(-distToPlane) * cameraFrame.w +
+		uv.x * cameraFrame.u + uv.y * cameraFrame.v;
 	return Ray(cameraFrame.origin, rayDirection);
 }
 
+/**
+ * @fn	void RayBlock::resize(int numRays, int samplesPerPixel)
+ * @brief	Makes room for a block of rays. Each array gets one vector's worth of
+ * 			slack, so rays can be written a whole vector at a time.
+ * @param	numRays		   	Rays in the block.
+ * @param	samplesPerPixel	Rays per pixel.
+ */
+
+void RayBlock::resize(int numRays, int samplesPerPixel) {
+	this->numRays = numRays;
+	this->samplesPerPixel = samplesPerPixel;
+	const size_t size = (size_t)numRays + vfloatN::WIDTH;
+	if (originX.size() < size) {
+		originX.resize(size);
+		originY.resize(size);
+		originZ.resize(size);
+		dirX.resize(size);
+		dirY.resize(size);
+		dirZ.resize(size);
+	}
+}
+
+/**
+ * @fn	template <class RayWriter> static void forEachRayGroup(const RaytracingCamera &camera, int x0, int y0, int cols, int rows, const glm::vec2 *offsets, int samplesPerPixel, RayBlock &block, RayWriter writeRays)
+ * @brief	Steps through the rays of a tile a vector at a time, handing the writer
+ * 			the projection plane coordinates of each group. The u coordinates
+ * 			are the same for every row, so they are computed once per tile.
+ * 			A row's last group may run into the next row; the next row then
+ * 			overwrites those rays, and the last row's spill lands in the
+ * 			block's slack.
+ * @param	camera		   	The camera.
+ * @param	x0			   	Left column of the tile.
+ * @param	y0			   	Bottom row of the tile.
+ * @param	cols		   	Width of the tile.
+ * @param	rows		   	Height of the tile.
+ * @param	offsets		   	Offset of each sample from its pixel.
+ * @param	samplesPerPixel	Number of offsets.
+ * @param [in,out]	block  	Receives the rays.
+ * @param	writeRays	   	Called with (u, v, index of the group's first ray).
+ */
+
+template <class RayWriter>
+static void forEachRayGroup(const RaytracingCamera &camera, int x0, int y0, int cols, int rows,
+							const glm::vec2 *offsets, int samplesPerPixel, RayBlock &block,
+							RayWriter writeRays) {
+	static thread_local std::vector<float> rowU, rowDV;
+	const int W = vfloatN::WIDTH;
+	const int perRow = cols * samplesPerPixel;
+	const int padded = (perRow + W - 1) / W * W;
+	if ((int)rowU.size() < padded) {
+		rowU.resize(padded);
+		rowDV.resize(padded);
+	}
+	const float du = (camera.right - camera.left) / camera.nx;
+	const float dv = (camera.top - camera.bottom) / camera.ny;
+	for (int i = 0; i < padded; i++) {
+		const int c = std::min(i / samplesPerPixel, cols - 1);
+		const glm::vec2 &offset = offsets[i % samplesPerPixel];
+		rowU[i] = camera.left + du * (x0 + c + offset.x + 0.5f);
+		rowDV[i] = dv * offset.y;
+	}
+	block.resize(rows * perRow, samplesPerPixel);
+	for (int r = 0; r < rows; r++) {
+		const vfloatN rowV(camera.bottom + dv * (y0 + r + 0.5f));
+		const int first = r * perRow;
+		for (int i = 0; i < perRow; i += W) {
+			writeRays(vfloatN::load(&rowU[i]), rowV + vfloatN::load(&rowDV[i]), first + i);
+		}
+	}
+}
+
+/**
+ * @fn	void PerspectiveCamera::generateRays(int x0, int y0, int cols, int rows, const glm::vec2 *offsets, int samplesPerPixel, RayBlock &block) const
+ * @brief	Generates the rays of every pixel and sample of a tile at once. They
+ * 			match getRay's, up to rounding.
+ * @param	x0			   	Left column of the tile.
+ * @param	y0			   	Bottom row of the tile.
+ * @param	cols		   	Width of the tile.
+ * @param	rows		   	Height of the tile.
+ * @param	offsets		   	Offset of each sample from its pixel.
+ * @param	samplesPerPixel	Number of offsets.
+ * @param [in,out]	block  	Receives the rays.
+ */
+
+void PerspectiveCamera::generateRays(int x0, int y0, int cols, int rows, const glm::vec2 *offsets,
+									int samplesPerPixel, RayBlock &block) const {
+	const Frame &f = cameraFrame;
+	const vfloatN ox(f.origin.x), oy(f.origin.y), oz(f.origin.z);
+	const vfloatN ux(f.u.x), uy(f.u.y), uz(f.u.z);
+	const vfloatN vx(f.v.x), vy(f.v.y), vz(f.v.z);
+	const vfloatN cx(-distToPlane * f.w.x), cy(-distToPlane * f.w.y), cz(-distToPlane * f.w.z);
+	forEachRayGroup(*this, x0, y0, cols, rows, offsets, samplesPerPixel, block,
+		[&](const vfloatN &u, const vfloatN &v, int i) {
+			const vfloatN dx = cx + u * ux + v * vx;
+			const vfloatN dy = cy + u * uy + v * vy;
+			const vfloatN dz = cz + u * uz + v * vz;
+			const vfloatN length = vsqrt(dx * dx + dy * dy + dz * dz);
+			(dx / length).store(&block.dirX[i]);
+			(dy / length).store(&block.dirY[i]);
+			(dz / length).store(&block.dirZ[i]);
+			ox.store(&block.originX[i]);
+			oy.store(&block.originY[i]);
+			oz.store(&block.originZ[i]);
+		});
+}
+
+/**
+ * @fn	void OrthographicCamera::generateRays(int x0, int y0, int cols, int rows, const glm::vec2 *offsets, int samplesPerPixel, RayBlock &block) const
+ * @brief	Generates the rays of every pixel and sample of a tile at once. They
+ * 			match getRay's, up to rounding.
+ * @param	x0			   	Left column of the tile.
+ * @param	y0			   	Bottom row of the tile.
+ * @param	cols		   	Width of the tile.
+ * @param	rows		   	Height of the tile.
+ * @param	offsets		   	Offset of each sample from its pixel.
+ * @param	samplesPerPixel	Number of offsets.
+ * @param [in,out]	block  	Receives the rays.
+ */
+
+void OrthographicCamera::generateRays(int x0, int y0, int cols, int rows, const glm::vec2 *offsets,
+									int samplesPerPixel, RayBlock &block) const {
+	const Frame &f = cameraFrame;
+	const vfloatN ox(f.origin.x), oy(f.origin.y), oz(f.origin.z);
+	const vfloatN ux(f.u.x), uy(f.u.y), uz(f.u.z);
+	const vfloatN vx(f.v.x), vy(f.v.y), vz(f.v.z);
+	const glm::vec3 d = glm::normalize(-f.w);
+	const vfloatN dx(d.x), dy(d.y), dz(d.z);
+	forEachRayGroup(*this, x0, y0, cols, rows, offsets, samplesPerPixel, block,
+		[&](const vfloatN &u, const vfloatN &v, int i) {
+			(ox + u * ux + v * vx).store(&block.originX[i]);
+			(oy + u * uy + v * vy).store(&block.originY[i]);
+			(oz + u * uz + v * vz).store(&block.originZ[i]);
+			dx.store(&block.dirX[i]);
+			dy.store(&block.dirY[i]);
+			dz.store(&block.dirZ[i]);
+		});
+}
+
 /**
  * @fn	void PerspectiveCamera::setFOV(float FOV, int W, int H)
  * @brief	Sets a camera's field of view.
@@ -1,7 +1,29 @@
 #pragma once
 #include <iostream>
+#include <vector>
 #include "IShape.h"
 
+/**
+ * @struct	RayBlock
+ * @brief	The camera rays of one tile, stored as separate arrays of origin and
+ * 			direction components so they can be generated many at a time.
+ * 			Ray i is sample i % samplesPerPixel of pixel i / samplesPerPixel,
+ * 			and pixels are in row order. Directions are unit length.
+ */
+
+struct RayBlock {
+	std::vector<float> originX, originY, originZ;	//!< Ray origins
+	std::vector<float> dirX, dirY, dirZ;			//!< Ray directions
+	int numRays;									//!< Rays in the block
+	int samplesPerPixel;							//!< Rays per pixel
+	RayBlock() : numRays(0), samplesPerPixel(1) {}
+	void resize(int numRays, int samplesPerPixel);
+	Ray getRay(int i) const {
+		return Ray::fromUnitDirection(glm::vec3(originX[i], originY[i], originZ[i]),
+										glm::vec3(dirX[i], dirY[i], dirZ[i]));
+	}
+};
+
 /**
  * @struct	RaytracingCamera
  * @brief	Base class for cameras in raytracing applications.
@@ -15,8 +37,12 @@ struct RaytracingCamera {
 	RaytracingCamera(const glm::vec3 &pos, const glm::vec3 &lookAtPt, const glm::vec3 &up);
 	void changeConfiguration(const glm::vec3 &pos, const glm::vec3 &lookAtPt, const glm::vec3 &up);
 	glm::vec2 getProjectionPlaneCoordinates(float x, float y) const;
+	bool getWindowBounds(const glm::vec3 &lo, const glm::vec3 &hi, BoundingBoxi &rect) const;
 	virtual void calculateViewingParameters(int width, int height) = 0;
+	virtual bool getWindowCoordinates(const glm::vec3 &pt, glm::vec2 &window) const = 0;
 	virtual Ray getRay(float x, float y) const = 0;
+	virtual void generateRays(int x0, int y0, int cols, int rows, const glm::vec2 *offsets,
+								int samplesPerPixel, RayBlock &block) const = 0;
 	friend std::ostream &operator << (std::ostream &os, const RaytracingCamera &camera);
 };
 
@@ -29,7 +55,10 @@ struct PerspectiveCamera : public RaytracingCamera {
 	float distToPlane;				//!< Distance to image plane
 	PerspectiveCamera(const glm::vec3 &pos, const glm::vec3 &lookAtPt, const glm::vec3 &up, float FOVRads);
 	virtual void calculateViewingParameters(int width, int height);
+	virtual bool getWindowCoordinates(const glm::vec3 &pt, glm::vec2 &window) const;
 	virtual Ray getRay(float x, float y) const;
+	virtual void generateRays(int x0, int y0, int cols, int rows, const glm::vec2 *offsets,
+								int samplesPerPixel, RayBlock &block) const;
 	void setFOV(float FOV, int W, int H);
 };
 
@@ -42,5 +71,8 @@ struct OrthographicCamera : public RaytracingCamera {
 	float pixelsPerWorldUnit;		//!< Controls the size of the image plane.
 	OrthographicCamera(const glm::vec3 &pos, const glm::vec3 &lookAtPt, const glm::vec3 &up, float ppwu);
 	virtual void calculateViewingParameters(int width, int height);
+	virtual bool getWindowCoordinates(const glm::vec3 &pt, glm::vec2 &window) const;
 	virtual Ray getRay(float x, float y) const;
+	virtual void generateRays(int x0, int y0, int cols, int rows, const glm::vec2 *offsets,
+								int samplesPerPixel, RayBlock &block) const;
 };
\ No newline at end of file
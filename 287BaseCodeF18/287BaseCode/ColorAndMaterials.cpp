@@ -64,6 +64,19 @@ Material::Material(const std::vector<float> &C) :
 		C[9]) {
 }
 
+/**
+ * @fn	Material::Material(const MaterialPreset &preset)
+ * @brief	Construct a Material from one of the presets.
+ * @param	preset	The preset.
+ */
+
+Material::Material(const MaterialPreset &preset) :
+	Material(color(preset.values[0], preset.values[1], preset.values[2]),
+		color(preset.values[3], preset.values[4], preset.values[5]),
+		color(preset.values[6], preset.values[7], preset.values[8]),
+		preset.values[9]) {
+}
+
 /**
  * @fn	Material::Material(const color &oneColor)
  * @brief	Constructs a material that has ambient values only. Diffuse and specular are black.
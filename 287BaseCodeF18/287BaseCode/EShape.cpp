@@ -1,8 +1,90 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
 #include "EShape.h"
 
+static const int LOD_SLICES[LOD_LEVELS] = { 64, 32, 16, 8 };	//!< Slices in each level of a LOD chain, finest first
+static const int LOD_STACKS[LOD_LEVELS] = { 8, 4, 2, 1 };		//!< Stacks in each level of a LOD chain
+
+/**
+ * @fn	static glm::vec4 pointOnRing(float R, float y, float angle)
+ * @brief	A point on a horizontal circle centered on the y axis. Increasing
+ * 			angles run counterclockwise seen from +y, starting at +z.
+ * @param	R	 	Radius.
+ * @param	y	 	Height of the circle.
+ * @param	angle	Angle in radians.
+ * @return	The point.
+ */
+
+static glm::vec4 pointOnRing(float R, float y, float angle) {
+	return glm::vec4(R * std::sin(angle), y, R * std::cos(angle), 1.0f);
+}
+
+/**
+ * @fn	static void addCap(EShapeData &verts, const Material &mat, float R, float y, int slices, bool facingUp)
+ * @brief	Adds a disk centered on the y axis, as a fan of slices triangles.
+ * @param [in,out]	verts   	Receives the triangles.
+ * @param 		  	mat	 	Material.
+ * @param 		  	R	 	Radius.
+ * @param 		  	y	 	Height of the disk.
+ * @param 		  	slices  	Number of slices.
+ * @param 		  	facingUp	True ==> the disk faces +y; otherwise -y.
+ */
+
+static void addCap(EShapeData &verts, const Material &mat, float R, float y, int slices, bool facingUp) {
+	const glm::vec4 center(0.0f, y, 0.0f, 1.0f);
+	const glm::vec3 n = facingUp ? Y_AXIS : -Y_AXIS;
+	for (int i = 0; i < slices; i++) {
+		const glm::vec4 A = pointOnRing(R, y, M_2PI * i / slices);
+		const glm::vec4 B = pointOnRing(R, y, M_2PI * (i + 1) / slices);
+		if (facingUp) {
+			VertexData::addTriVertsAndComputeNormal(verts, center, A, B, n, mat);
+		} else {
+			VertexData::addTriVertsAndComputeNormal(verts, center, B, A, n, mat);
+		}
+	}
+}
+
+/**
+ * @fn	static void addBand(EShapeData &verts, const Material &mat, float R0, float y0, float R1, float y1, const glm::vec2 &slope, int slices)
+ * @brief	Adds the side of a frustum between two horizontal circles, with
+ * 			smooth normals.
+ * @param [in,out]	verts 	Receives the triangles.
+ * @param 		  	mat   	Material.
+ * @param 		  	R0	  	Radius of the lower circle.
+ * @param 		  	y0	  	Height of the lower circle.
+ * @param 		  	R1	  	Radius of the upper circle.
+ * @param 		  	y1	  	Height of the upper circle.
+ * @param 		  	slope 	Unit normal of the side at angle 0, as (outward, up) components.
+ * @param 		  	slices	Number of slices.
+ */
+
+static void addBand(EShapeData &verts, const Material &mat, float R0, float y0, float R1, float y1,
+					const glm::vec2 &slope, int slices) {
+	for (int i = 0; i < slices; i++) {
+		const float a0 = M_2PI * i / slices;
+		const float a1 = M_2PI * (i + 1) / slices;
+		const glm::vec3 n0(slope.x * std::sin(a0), slope.y, slope.x * std::cos(a0));
+		const glm::vec3 n1(slope.x * std::sin(a1), slope.y, slope.x * std::cos(a1));
+		const VertexData A(pointOnRing(R0, y0, a0), n0, mat);
+		const VertexData B(pointOnRing(R0, y0, a1), n1, mat);
+		const VertexData C(pointOnRing(R1, y1, a1), n1, mat);
+		const VertexData D(pointOnRing(R1, y1, a0), n0, mat);
+		verts.push_back(A);
+		verts.push_back(B);
+		verts.push_back(C);
+		if (R1 > 0.0f) {	// At an apex the quad's top edge has no length.
+			verts.push_back(C);
+			verts.push_back(D);
+			verts.push_back(A);
+		}
+	}
+}
+
 /**
  * @fn	EShapeData EShape::createEDisk(const Material &mat, float radius, int slices)
- * @brief	Creates a disk.
+ * @brief	Creates a disk, centered on (0,0,0) in the xz plane and facing +y.
  * @param	mat   	Material.
  * @param	radius	Radius.
  * @param	slices	Number of slices.
@@ -11,6 +93,7 @@
 
 EShapeData EShape::createEDisk(const Material &mat, float radius, int slices) {
 	EShapeData result;
+	addCap(result, mat, radius, 0.0f, slices, true);
 	return result;
 }
 
@@ -25,12 +108,21 @@ EShapeData EShape::createEDisk(const Material &mat, float radius, int slices) {
 
 EShapeData EShape::createEPyramid(const Material &mat, float width, float height) {
 	EShapeData verts;
+	const float W2 = width / 2.0f;
+	const glm::vec4 apex(0.0f, height, 0.0f, 1.0f);
+	const glm::vec4 base[4] = { glm::vec4(-W2, 0.0f, W2, 1.0f), glm::vec4(W2, 0.0f, W2, 1.0f),
+								glm::vec4(W2, 0.0f, -W2, 1.0f), glm::vec4(-W2, 0.0f, -W2, 1.0f) };
+	for (int i = 0; i < 4; i++) {
+		VertexData::addTriVertsAndComputeNormal(verts, base[i], base[(i + 1) % 4], apex, mat);
+	}
+	VertexData::addConvexPolyVertsAndComputeNormals(verts, base[3], base[2], base[1], base[0], mat);
 	return verts;
 }
 
 /**
- * @fn	EShapeData EShape::createECylinder(const Material &mat, float radius, float height, int slices)
+ * @fn	EShapeData EShape::createECylinder(const Material &mat, float radius, float height, int slices, int stacks)
  * @brief	Creates cylinder, which is centered on (0,0,0) and aligned with y axis.
+ * 			Both ends are capped.
  * @param	mat   	Material.
  * @param	radius	Radius.
  * @param	height	Height.
@@ -41,12 +133,21 @@ EShapeData EShape::createEPyramid(const Material &mat, float width, float height
 
 EShapeData EShape::createECylinder(const Material &mat, float R, float height, int slices, int stacks) {
 	EShapeData result;
+	const float bottom = -height / 2.0f;
+	for (int j = 0; j < stacks; j++) {
+		const float y0 = bottom + height * j / stacks;
+		const float y1 = bottom + height * (j + 1) / stacks;
+		addBand(result, mat, R, y0, R, y1, glm::vec2(1.0f, 0.0f), slices);
+	}
+	addCap(result, mat, R, height / 2.0f, slices, true);
+	addCap(result, mat, R, bottom, slices, false);
 	return result;
 }
 
 /**
  * @fn	EShapeData EShape::createECone(const Material &mat, float radius, float height, int slices, int stacks)
- * @brief	Creates cone, which is aligned with y axis.
+ * @brief	Creates cone, which is aligned with y axis. The base is centered on
+ * 			(0,0,0) and capped, and the apex is at (0,height,0).
  * @param	mat   	Material.
  * @param	radius	Radius.
  * @param	height	Height.
@@ -57,12 +158,19 @@ EShapeData EShape::createECylinder(const Material &mat, float R, float height, i
 
 EShapeData EShape::createECone(const Material &mat, float R, float height, int slices, int stacks) {
 	EShapeData result;
+	const glm::vec2 slope = glm::normalize(glm::vec2(height, R));
+	for (int j = 0; j < stacks; j++) {
+		const float t0 = (float)j / stacks;
+		const float t1 = (float)(j + 1) / stacks;
+		addBand(result, mat, R * (1.0f - t0), height * t0, R * (1.0f - t1), height * t1, slope, slices);
+	}
+	addCap(result, mat, R, 0.0f, slices, false);
 	return result;
 }
 
 /**
  * @fn	EShapeData EShape::createECube(const Material &mat, float width, float height, float depth)
- * @brief	Creates cube
+ * @brief	Creates cube, or rather a box, centered on (0,0,0).
  * @param	mat   	Material.
  * @param	width 	Width.
  * @param	height	Height.
@@ -72,6 +180,18 @@ EShapeData EShape::createECone(const Material &mat, float R, float height, int s
 
 EShapeData EShape::createECube(const Material &mat, float width, float height, float depth) {
 	EShapeData result;
+	const float W = width / 2.0f, H = height / 2.0f, D = depth / 2.0f;
+	const glm::vec4 corners[8] = { glm::vec4(-W, -H, D, 1.0f), glm::vec4(W, -H, D, 1.0f),
+									glm::vec4(W, H, D, 1.0f), glm::vec4(-W, H, D, 1.0f),
+									glm::vec4(-W, -H, -D, 1.0f), glm::vec4(W, -H, -D, 1.0f),
+									glm::vec4(W, H, -D, 1.0f), glm::vec4(-W, H, -D, 1.0f) };
+	// Each face's corners, counterclockwise seen from outside.
+	const int faces[6][4] = { { 0, 1, 2, 3 }, { 5, 4, 7, 6 }, { 1, 5, 6, 2 },
+								{ 4, 0, 3, 7 }, { 3, 2, 6, 7 }, { 4, 5, 1, 0 } };
+	for (int f = 0; f < 6; f++) {
+		VertexData::addConvexPolyVertsAndComputeNormals(result, corners[faces[f][0]], corners[faces[f][1]],
+														corners[faces[f][2]], corners[faces[f][3]], mat);
+	}
 	return result;
 }
 
@@ -171,9 +291,130 @@ EShapeData EShape::createECheckerBoard(const Material &mat1, const Material &mat
 	return result;
 }
 
+/**
+ * @fn	EShapeMesh EShape::createECheckerBoardMesh(const Material &mat1, const Material &mat2, float WIDTH, float HEIGHT, int DIV)
+ * @brief	Creates the checker board pattern as an indexed mesh. Each square's
+ * 			four corners are stored once and shared by its two triangles.
+ * @param	mat1  	Material #1.
+ * @param	mat2  	Material #2.
+ * @param	WIDTH 	Width of overall plane.
+ * @param	HEIGHT	Height of overall plane.
+ * @param	DIV   	Number of divisions.
+ * @return	The checker board mesh.
+ */
+
+EShapeMesh EShape::createECheckerBoardMesh(const Material &mat1, const Material &mat2, float WIDTH, float HEIGHT, int DIV) {
+	EShapeMesh result;
+	MaterialLibrary &library = MaterialLibrary::getShared();
+	const MaterialId id1 = library.findOrAdd(mat1);
+	const MaterialId id2 = library.findOrAdd(mat2);
+	result.vertices.reserve(4 * DIV * DIV);
+	result.indices.reserve(6 * DIV * DIV);
+
+	const float INC = (float)WIDTH / DIV;
+	for (int X = 0; X < DIV; X++) {
+		bool isMat1 = X % 2 == 0;
+		for (int Z = 0; Z < DIV; Z++) {
+			glm::vec4 V0(-WIDTH / 2.0f + X*INC, 0.0f, -WIDTH / 2 + Z*INC, 1.0f);
+			glm::vec4 corners[4] = { V0,
+									V0 + glm::vec4(0.0f, 0.0f, INC, 0.0f),
+									V0 + glm::vec4(INC, 0.0f, INC, 0.0f),
+									V0 + glm::vec4(INC, 0.0f, 0.0f, 0.0f) };
+			const unsigned int first = (unsigned int)result.vertices.size();
+			for (int i = 0; i < 4; i++) {
+				MeshVertex v = { corners[i], Y_AXIS, isMat1 ? id1 : id2 };
+				result.vertices.push_back(v);
+			}
+			const unsigned int order[6] = { 0, 1, 2, 2, 3, 0 };
+			for (int i = 0; i < 6; i++) {
+				result.indices.push_back(first + order[i]);
+			}
+			isMat1 = !isMat1;
+		}
+	}
+	return result;
+}
+
+/**
+ * @struct	MeshVertexHash
+ * @brief	Hashes and compares mesh vertices field by field. Zeros are hashed
+ * 			alike whatever their sign, as they compare equal.
+ */
+
+struct MeshVertexHash {
+	static void combine(size_t &h, float f) {
+		uint32_t bits;
+		if (f == 0.0f) {
+			f = 0.0f;		// -0 becomes +0
+		}
+		std::memcpy(&bits, &f, sizeof(bits));
+		h = (h ^ bits) * 16777619u;
+	}
+	size_t operator()(const MeshVertex &v) const {
+		size_t h = 2166136261u;
+		for (int i = 0; i < 4; i++) {
+			combine(h, v.position[i]);
+		}
+		for (int i = 0; i < 3; i++) {
+			combine(h, v.normal[i]);
+		}
+		return (h ^ v.materialId) * 16777619u;
+	}
+	bool operator()(const MeshVertex &a, const MeshVertex &b) const {
+		return a.position == b.position && a.normal == b.normal && a.materialId == b.materialId;
+	}
+};
+
+/**
+ * @fn	EShapeMesh EShapeMesh::fromTriangles(const EShapeData &triangles)
+ * @brief	Builds an indexed mesh from a triangle soup, merging vertices whose
+ * 			position, normal and material are identical.
+ * @param	triangles	The triangles; each successive triplet is a triangle.
+ * @return	The indexed mesh.
+ */
+
+EShapeMesh EShapeMesh::fromTriangles(const EShapeData &triangles) {
+	EShapeMesh mesh;
+	MaterialLibrary &library = MaterialLibrary::getShared();
+	std::unordered_map<MeshVertex, unsigned int, MeshVertexHash, MeshVertexHash> unique;
+	const size_t N = triangles.size() - triangles.size() % 3;
+	mesh.indices.reserve(N);
+	for (size_t i = 0; i < N; i++) {
+		const VertexData &vd = triangles[i];
+		MeshVertex v{};
+		v.position = vd.position;
+		v.normal = vd.normal;
+		v.materialId = library.findOrAdd(vd.material);
+		auto found = unique.find(v);
+		if (found == unique.end()) {
+			found = unique.insert(std::make_pair(v, (unsigned int)mesh.vertices.size())).first;
+			mesh.vertices.push_back(v);
+		}
+		mesh.indices.push_back(found->second);
+	}
+	return mesh;
+}
+
+/**
+ * @fn	EShapeData EShapeMesh::toTriangles() const
+ * @brief	Expands the mesh back into a triangle soup.
+ * @return	The triangles; each successive triplet is a triangle.
+ */
+
+EShapeData EShapeMesh::toTriangles() const {
+	const MaterialLibrary &library = MaterialLibrary::getShared();
+	EShapeData triangles;
+	triangles.reserve(indices.size());
+	for (unsigned int index : indices) {
+		const MeshVertex &v = vertices[index];
+		triangles.push_back(VertexData(v.position, v.normal, library[v.materialId]));
+	}
+	return triangles;
+}
+
 /**
  * @fn	std::vector<VertexData> createSidePanel(const Material &mat, const glm::vec2 &V1, const glm::vec2 &V2)
- * @brief	Creates side panel for an extrusion.
+ * @brief	Creates side panel for an extrusion, from y = 0 to y = 1.
  * @param	mat	Material.
  * @param	V1 	The first vertex of the side panel.
  * @param	V2 	The second vertex of the side panel.
@@ -182,5 +423,140 @@ EShapeData EShape::createECheckerBoard(const Material &mat1, const Material &mat
 
 static std::vector<VertexData> createSidePanel(const Material &mat, const glm::vec2 &V1, const glm::vec2 &V2) {
 	std::vector<VertexData> verts;
+	const glm::vec4 A(V1.x, 0.0f, V1.y, 1.0f);
+	const glm::vec4 B(V2.x, 0.0f, V2.y, 1.0f);
+	const glm::vec4 C(V2.x, 1.0f, V2.y, 1.0f);
+	const glm::vec4 D(V1.x, 1.0f, V1.y, 1.0f);
+	VertexData::addConvexPolyVertsAndComputeNormals(verts, A, B, C, D, mat);
 	return verts;
 }
+
+/**
+ * @fn	EShapeData EShape::createExtrusion(const Material &mat, const std::vector<glm::vec2> &V)
+ * @brief	Creates the sides of an extrusion of a polygon from y = 0 to y = 1. The
+ * 			ends are left open.
+ * @param	mat	Material.
+ * @param	V  	The polygon, as (x, z) points listed counterclockwise seen from +y.
+ * @return	The new extrusion.
+ */
+
+EShapeData EShape::createExtrusion(const Material &mat, const std::vector<glm::vec2> &V) {
+	EShapeData result;
+	for (unsigned int i = 0; i < V.size(); i++) {
+		std::vector<VertexData> panel = createSidePanel(mat, V[i], V[(i + 1) % V.size()]);
+		result.insert(result.end(), panel.begin(), panel.end());
+	}
+	return result;
+}
+
+/**
+ * @fn	EShapeLOD EShape::createEDiskLOD(const Material &mat, float radius)
+ * @brief	Creates a chain of disks of decreasing slice counts.
+ * @param	mat   	Material.
+ * @param	radius	Radius.
+ * @return	The LOD chain.
+ */
+
+EShapeLOD EShape::createEDiskLOD(const Material &mat, float radius) {
+	EShapeLOD lod;
+	for (int i = 0; i < LOD_LEVELS; i++) {
+		lod.addLevel(createEDisk(mat, radius, LOD_SLICES[i]), LOD_SLICES[i]);
+	}
+	return lod;
+}
+
+/**
+ * @fn	EShapeLOD EShape::createECylinderLOD(const Material &mat, float radius, float height)
+ * @brief	Creates a chain of cylinders of decreasing slice and stack counts.
+ * @param	mat   	Material.
+ * @param	radius	Radius.
+ * @param	height	Height.
+ * @return	The LOD chain.
+ */
+
+EShapeLOD EShape::createECylinderLOD(const Material &mat, float radius, float height) {
+	EShapeLOD lod;
+	for (int i = 0; i < LOD_LEVELS; i++) {
+		lod.addLevel(createECylinder(mat, radius, height, LOD_SLICES[i], LOD_STACKS[i]), LOD_SLICES[i]);
+	}
+	return lod;
+}
+
+/**
+ * @fn	EShapeLOD EShape::createEConeLOD(const Material &mat, float radius, float height)
+ * @brief	Creates a chain of cones of decreasing slice and stack counts.
+ * @param	mat   	Material.
+ * @param	radius	Radius.
+ * @param	height	Height.
+ * @return	The LOD chain.
+ */
+
+EShapeLOD EShape::createEConeLOD(const Material &mat, float radius, float height) {
+	EShapeLOD lod;
+	for (int i = 0; i < LOD_LEVELS; i++) {
+		lod.addLevel(createECone(mat, radius, height, LOD_SLICES[i], LOD_STACKS[i]), LOD_SLICES[i]);
+	}
+	return lod;
+}
+
+/**
+ * @fn	void EShapeLOD::addLevel(const EShapeData &triangles, int numSlices)
+ * @brief	Appends the next coarser level. The first level added sets the
+ * 			bounding sphere.
+ * @param	triangles	The level's triangles.
+ * @param	numSlices	Slices around the shape in this level.
+ */
+
+void EShapeLOD::addLevel(const EShapeData &triangles, int numSlices) {
+	if (levels.empty() && !triangles.empty()) {
+		glm::vec3 lo = triangles[0].position.xyz, hi = lo;
+		for (const VertexData &v : triangles) {
+			lo = glm::min(lo, glm::vec3(v.position.xyz));
+			hi = glm::max(hi, glm::vec3(v.position.xyz));
+		}
+		center = (lo + hi) / 2.0f;
+		radius = 0.0f;
+		for (const VertexData &v : triangles) {
+			radius = std::max(radius, glm::length(glm::vec3(v.position.xyz) - center));
+		}
+	}
+	levels.push_back(EShapeMesh::fromTriangles(triangles));
+	slices.push_back(numSlices);
+}
+
+/**
+ * @fn	int EShapeLOD::selectLevel(const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix, float viewportHeight) const
+ * @brief	Picks the coarsest level whose silhouette edges are still about
+ * 			LOD_EDGE_PIXELS long, given the bounding sphere's projected radius.
+ * @param	modelMatrix   	The modeling transformation.
+ * @param	viewMatrix	  	The viewing transformation.
+ * @param	projMatrix	  	The projection transformation.
+ * @param	viewportHeight	Height of the viewport, in pixels.
+ * @return	Index of the level to draw.
+ */
+
+int EShapeLOD::selectLevel(const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix,
+							const glm::mat4 &projMatrix, float viewportHeight) const {
+	const glm::mat3 M(modelMatrix);
+	const float scale = std::max(glm::length(M[0]), std::max(glm::length(M[1]), glm::length(M[2])));
+	const float worldRadius = radius * scale;
+	const glm::vec4 eyeCenter = viewMatrix * modelMatrix * glm::vec4(center, 1.0f);
+
+	// Projected radius in pixels. Perspective divides by the distance in front of the eye.
+	float pixels = worldRadius * projMatrix[1][1] * viewportHeight / 2.0f;
+	if (projMatrix[2][3] != 0.0f) {
+		const float distance = -eyeCenter.z;
+		if (distance <= worldRadius) {	// The eye is at or inside the sphere.
+			return 0;
+		}
+		pixels /= distance;
+	}
+
+	const float neededSlices = M_2PI * pixels / LOD_EDGE_PIXELS;
+	for (int i = (int)levels.size() - 1; i > 0; i--) {
+		if (slices[i] >= neededSlices) {
+			return i;
+		}
+	}
+	return 0;
+}
@@ -2,12 +2,61 @@
 #pragma once
 
 #include <utility>
+#include <vector>
 #include "VertexData.h"
 #include "FrameBuffer.h"
 #include "Light.h"
+#include "MaterialLibrary.h"
 
 typedef std::vector<VertexData> EShapeData;
 
+/**
+ * @struct	MeshVertex
+ * @brief	A vertex of an indexed mesh. The material is stored once in the
+ * 			shared material library and referred to by id.
+ */
+
+struct MeshVertex {
+	glm::vec4 position;		//!< Object coordinates.
+	glm::vec3 normal;		//!< Normal vector.
+	MaterialId materialId;	//!< Id in the shared material library.
+};
+
+/**
+ * @struct	EShapeMesh
+ * @brief	An indexed triangle mesh: each unique vertex is stored once, and each
+ * 			successive triplet of indices is a triangle.
+ */
+
+struct EShapeMesh {
+	std::vector<MeshVertex> vertices;	//!< The vertex buffer
+	std::vector<unsigned int> indices;	//!< The index buffer
+	int numTriangles() const { return (int)indices.size() / 3; }
+	static EShapeMesh fromTriangles(const EShapeData &triangles);
+	EShapeData toTriangles() const;
+};
+
+const int LOD_LEVELS = 4;				//!< Levels in the LOD chains EShape creates.
+const float LOD_EDGE_PIXELS = 4.0f;		//!< Target on-screen length of a silhouette edge, in pixels.
+
+/**
+ * @struct	EShapeLOD
+ * @brief	A chain of meshes of one shape, finest first. At draw time the level
+ * 			is picked from how large the shape's bounding sphere appears on
+ * 			screen, so distant shapes are drawn with few triangles.
+ */
+
+struct EShapeLOD {
+	std::vector<EShapeMesh> levels;		//!< The meshes, finest first
+	std::vector<int> slices;			//!< Slices around the shape, per level
+	glm::vec3 center;					//!< Center of the bounding sphere, in object coordinates
+	float radius;						//!< Radius of the bounding sphere
+	EShapeLOD() : center(ORIGIN3D), radius(0.0f) {}
+	void addLevel(const EShapeData &triangles, int numSlices);
+	int selectLevel(const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix,
+					const glm::mat4 &projMatrix, float viewportHeight) const;
+};
+
 /**
  * @struct	EShape
  * @brief	This class contains functions that create explicitly represented shapes.
@@ -26,5 +75,9 @@ struct EShape {
 	static EShapeData createEPlanes(const Material &mat, const std::vector<glm::vec4> &corners);
 	static EShapeData createELines(const Material &mat, const std::vector<glm::vec4> &corners);
 	static EShapeData createECheckerBoard(const Material &mat1, const Material &mat2, float WIDTH, float HEIGHT, int DIV);
+	static EShapeMesh createECheckerBoardMesh(const Material &mat1, const Material &mat2, float WIDTH, float HEIGHT, int DIV);
 	static EShapeData createExtrusion(const Material &mat, const std::vector<glm::vec2> &V);
+	static EShapeLOD createEDiskLOD(const Material &mat, float radius = 1.0f);
+	static EShapeLOD createECylinderLOD(const Material &mat, float radius = 1.0f, float height = 1.0f);
+	static EShapeLOD createEConeLOD(const Material &mat, float radius = 1.0f, float height = 1.0f);
 };
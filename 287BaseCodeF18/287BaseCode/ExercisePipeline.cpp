@@ -0,0 +1,122 @@
+#include <ctime>
+#include <vector>
+#include <cctype>
+#include "Defs.h"
+#include "FrameBuffer.h"
+#include "ColorAndMaterials.h"
+#include "Light.h"
+#include "EShape.h"
+#include "VertexOps.h"
+#include "FragmentOps.h"
+#include "GBuffer.h"
+
+FrameBuffer frameBuffer(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+float angle = 0.0f;
+bool isAnimated = true;
+bool isDeferred = false;
+GBuffer gBuffer;
+
+PositionalLightPtr posLight = new PositionalLight(glm::vec3(10.0f, 15.0f, 10.0f), pureWhiteLight);
+std::vector<LightSourcePtr> lights = { posLight };
+
+EShapeMesh board;
+EShapeLOD cylinder;
+EShapeLOD cone;
+EShapeData cube;
+
+void buildScene() {
+	board = EShape::createECheckerBoardMesh(copper, polishedCopper, 20.0f, 20.0f, 10);
+	cylinder = EShape::createECylinderLOD(gold, 1.5f, 4.0f);
+	cone = EShape::createEConeLOD(redPlastic, 1.5f, 4.0f);
+	cube = EShape::createECube(cyanPlastic, 2.0f, 2.0f, 2.0f);
+}
+
+void render() {
+	int frameStartTime = glutGet(GLUT_ELAPSED_TIME);
+	frameBuffer.clearColorAndDepthBuffers();
+
+	const float R = 15.0f;
+	const float rads = glm::radians(angle);
+	const glm::vec3 eyePos(R * std::cos(rads), 8.0f, R * std::sin(rads));
+	VertexOps::viewingTransformation = glm::lookAt(eyePos, ORIGIN3D, Y_AXIS);
+
+	if (isDeferred) {
+		gBuffer.clear();
+		FragmentOps::gBuffer = &gBuffer;
+	}
+	const glm::mat4 I(1.0f);
+	VertexOps::render(frameBuffer, board, lights, glm::translate(I, glm::vec3(0.0f, -2.0f, 0.0f)));
+	VertexOps::render(frameBuffer, cylinder, lights, glm::translate(I, glm::vec3(-4.0f, 0.0f, 0.0f)));
+	VertexOps::render(frameBuffer, cone, lights, glm::translate(I, glm::vec3(4.0f, 0.0f, 0.0f)));
+	VertexOps::render(frameBuffer, cube, lights, glm::rotate(glm::translate(I, glm::vec3(0.0f, -1.0f, 4.0f)),
+															glm::radians(30.0f), Y_AXIS));
+	if (isDeferred) {
+		FragmentOps::gBuffer = nullptr;
+		FragmentOps::shadeDeferred(frameBuffer, gBuffer, eyePos, lights, VertexOps::viewingTransformation);
+	}
+
+	frameBuffer.showColorBuffer();
+	int frameEndTime = glutGet(GLUT_ELAPSED_TIME);
+	float totalTimeSec = (frameEndTime - frameStartTime) / 1000.0f;
+	std::cout << "Render time: " << totalTimeSec << " sec." << std::endl;
+}
+
+void resize(int width, int height) {
+	frameBuffer.setFrameBufferSize(width, height);
+	gBuffer.setSize(width, height);
+	VertexOps::setViewport(0, width - 1, 0, height - 1);
+	VertexOps::projectionTransformation = glm::perspective(glm::radians(60.0f), (float)width / height, 0.5f, 100.0f);
+	glutPostRedisplay();
+}
+
+void keyboard(unsigned char key, int x, int y) {
+	switch (std::toupper(key)) {
+	case 'P':
+		isAnimated = !isAnimated;
+		break;
+	case 'B':
+		VertexOps::binnedRasterization = !VertexOps::binnedRasterization;
+		std::cout << "Binned rasterization: " << VertexOps::binnedRasterization << std::endl;
+		break;
+	case 'D':
+		isDeferred = !isDeferred;
+		std::cout << "Deferred shading: " << isDeferred << std::endl;
+		break;
+	case ESCAPE:
+		glutLeaveMainLoop();
+		break;
+	default:
+		std::cout << key << " key pressed." << std::endl;
+	}
+	glutPostRedisplay();
+}
+
+void timer(int id) {
+	glutTimerFunc(TIME_INTERVAL, timer, 0);
+	if (!isAnimated) return;
+	angle += 5.0f;
+	glutPostRedisplay();
+}
+
+int main(int argc, char *argv[]) {
+	glutInit(&argc, argv);
+	glutInitDisplayMode(GLUT_RGB | GLUT_SINGLE);
+	glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+
+	GLuint world_Window = glutCreateWindow(__FILE__);
+
+	glutDisplayFunc(render);
+	glutReshapeFunc(resize);
+	glutKeyboardFunc(keyboard);
+	glutTimerFunc(TIME_INTERVAL, timer, 0);
+	glutMouseFunc(mouseUtility);
+
+	FragmentOps::perPixelLighting = true;
+	VertexOps::binnedRasterization = true;
+	buildScene();
+
+	glutMainLoop();
+	return 0;
+}
@@ -1,9 +1,14 @@
+#include <algorithm>
 #include "FragmentOps.h"
+#include "PhongKernel.h"
+#include "ThreadPool.h"
 
 FogParams FragmentOps::fogParams;
 bool FragmentOps::performDepthTest = true;
 bool FragmentOps::readonlyDepthBuffer = false;
 bool FragmentOps::readonlyColorBuffer = false;
+GBuffer *FragmentOps::gBuffer = nullptr;
+bool FragmentOps::perPixelLighting = false;
 
 /**
  * @fn	float FogParams::fogFactor(const glm::vec3 &fragPos, const glm::vec3 &eyePos) const
@@ -62,8 +67,9 @@ color FragmentOps::applyBlending(float alpha, const color &srcColor, const color
 }
 
 /**
- * @fn	void FragmentOps::processFragment(FrameBuffer &frameBuffer, const glm::vec3 &eyePositionInWorldCoords, const std::vector<LightSourcePtr> lights, const Fragment &fragment, const glm::mat4 &viewingMatrix)
- * @brief	Process the fragment, leaving the results in the framebuffer.
+ * @fn	void FragmentOps::processFragment(FrameBuffer &frameBuffer, const glm::vec3 &eyePositionInWorldCoords, const std::vector<LightSourcePtr> &lights, const Fragment &fragment, const glm::mat4 &viewingMatrix)
+ * @brief	Process the fragment, leaving the results in the framebuffer. When
+ * 			gBuffer is set, a visible fragment is stored there unshaded instead.
  * @param [in,out]	frameBuffer					
  * @param 		  	eyePositionInWorldCoords	The eye position in world coordinates.
  * @param 		  	lights						Vector of lights in scene.
@@ -72,7 +78,7 @@ color FragmentOps::applyBlending(float alpha, const color &srcColor, const color
  */
 
 void FragmentOps::processFragment(FrameBuffer &frameBuffer, const glm::vec3 &eyePositionInWorldCoords,
-										const std::vector<LightSourcePtr> lights,
+										const std::vector<LightSourcePtr> &lights,
 										const Fragment &fragment,
 										const glm::mat4 &viewingMatrix) {
 	const glm::vec3 &eyePos = eyePositionInWorldCoords;
@@ -82,8 +88,292 @@ void FragmentOps::processFragment(FrameBuffer &frameBuffer, const glm::vec3 &eye
 	int Y = (int)fragment.windowPosition.y;
 	DEBUG_PIXEL = (X == xDebug && Y == yDebug);
 	bool passDepthTest = !performDepthTest || Z < frameBuffer.getDepth(X, Y);
+	if (gBuffer != nullptr) {
+		if (passDepthTest) {
+			gBuffer->write(X, Y, fragment.worldNormal, fragment.worldPosition, fragment.materialId);
+			frameBuffer.setDepth(X, Y, Z);
+		}
+		return;
+	}
 	if (passDepthTest) {
 		frameBuffer.setColor(X, Y, fragment.material.ambient);
 		frameBuffer.setDepth(X, Y, Z);
 	}
-}
\ No newline at end of file
+}
+
+/**
+ * @fn	void FragmentQuad::computeDerivatives()
+ * @brief	Computes the derivatives by differencing the quad's fragments: x
+ * 			across the bottom row and y up the left column. Attributes are
+ * 			interpolated linearly in screen space, so these are exact.
+ */
+
+void FragmentQuad::computeDerivatives() {
+	const Fragment &f00 = fragments[0], &f10 = fragments[1], &f01 = fragments[2];
+	ddxPosition = f10.worldPosition - f00.worldPosition;
+	ddyPosition = f01.worldPosition - f00.worldPosition;
+	ddxNormal = f10.worldNormal - f00.worldNormal;
+	ddyNormal = f01.worldNormal - f00.worldNormal;
+	ddxDepth = f10.windowPosition.z - f00.windowPosition.z;
+	ddyDepth = f01.windowPosition.z - f00.windowPosition.z;
+}
+
+/**
+ * @fn	static void lightQuad(const FragmentQuad &quad, const glm::vec3 &eyePos, const LightBlock &lights, color colors[4])
+ * @brief	Lights the four fragments of a quad together, one light at a time.
+ * @param 		  	quad  	The quad.
+ * @param 		  	eyePos	The eye position.
+ * @param 		  	lights	The lights.
+ * @param [in,out]	colors	Receives the color of each fragment.
+ */
+
+static void lightQuad(const FragmentQuad &quad, const glm::vec3 &eyePos, const LightBlock &lights, color colors[4]) {
+	const int NUM_ATTRIBUTES = 16;
+	float attribute[NUM_ATTRIBUTES][4];
+	for (int lane = 0; lane < 4; lane++) {
+		const Fragment &f = quad.fragments[lane];
+		const Material &m = f.material;
+		const float values[NUM_ATTRIBUTES] = { f.worldPosition.x, f.worldPosition.y, f.worldPosition.z,
+												f.worldNormal.x, f.worldNormal.y, f.worldNormal.z,
+												m.ambient.r, m.ambient.g, m.ambient.b,
+												m.diffuse.r, m.diffuse.g, m.diffuse.b,
+												m.specular.r, m.specular.g, m.specular.b, m.shininess };
+		for (int a = 0; a < NUM_ATTRIBUTES; a++) {
+			attribute[a][lane] = values[a];
+		}
+	}
+	SurfaceBatch<vfloat4> s;
+	s.px = vfloat4::load(attribute[0]);
+	s.py = vfloat4::load(attribute[1]);
+	s.pz = vfloat4::load(attribute[2]);
+	s.nx = vfloat4::load(attribute[3]);
+	s.ny = vfloat4::load(attribute[4]);
+	s.nz = vfloat4::load(attribute[5]);
+	completeSurfaceBatch(s, eyePos);
+	s.ambR = vfloat4::load(attribute[6]);
+	s.ambG = vfloat4::load(attribute[7]);
+	s.ambB = vfloat4::load(attribute[8]);
+	s.diffR = vfloat4::load(attribute[9]);
+	s.diffG = vfloat4::load(attribute[10]);
+	s.diffB = vfloat4::load(attribute[11]);
+	s.specR = vfloat4::load(attribute[12]);
+	s.specG = vfloat4::load(attribute[13]);
+	s.specB = vfloat4::load(attribute[14]);
+	s.shininess = vfloat4::load(attribute[15]);
+
+	vfloat4 R(0.0f), G(0.0f), B(0.0f);
+	for (const LightParams &light : lights.flatLights) {
+		accumulatePhong(light, s, R, G, B);
+	}
+	float r[4], g[4], b[4];
+	R.store(r);
+	G.store(g);
+	B.store(b);
+	for (int lane = 0; lane < 4; lane++) {
+		const Fragment &f = quad.fragments[lane];
+		colors[lane] = color(r[lane], g[lane], b[lane]);
+		for (LightSourcePtr light : lights.otherLights) {
+			colors[lane] += light->illuminate(f.worldPosition, f.worldNormal, f.material, lights.eyeFrame, false);
+		}
+	}
+}
+
+/**
+ * @fn	void FragmentOps::processQuad(FrameBuffer &frameBuffer, const glm::vec3 &eyePositionInWorldCoords, const LightBlock &lights, const FragmentQuad &quad)
+ * @brief	Process the covered fragments of a quad, leaving the results in the
+ * 			framebuffer, or in gBuffer when it is set. Depth is tested first, and
+ * 			when perPixelLighting is set the fragments that pass are lit together.
+ * @param [in,out]	frameBuffer					
+ * @param 		  	eyePositionInWorldCoords	The eye position in world coordinates.
+ * @param 		  	lights						The lights, prepared for this draw.
+ * @param 		  	quad						Quad to be processed.
+ */
+
+void FragmentOps::processQuad(FrameBuffer &frameBuffer, const glm::vec3 &eyePositionInWorldCoords,
+								const LightBlock &lights, const FragmentQuad &quad) {
+	int visible = 0;
+	for (int lane = 0; lane < 4; lane++) {
+		if ((quad.coverage & (1 << lane)) == 0) {
+			continue;
+		}
+		const glm::vec3 &p = quad.fragments[lane].windowPosition;
+		int X = (int)p.x;
+		int Y = (int)p.y;
+		DEBUG_PIXEL = (X == xDebug && Y == yDebug);
+		if (!performDepthTest || p.z < frameBuffer.getDepth(X, Y)) {
+			visible |= 1 << lane;
+		}
+	}
+	if (visible == 0) {
+		return;
+	}
+
+	color colors[4];
+	if (gBuffer == nullptr && perPixelLighting) {
+		lightQuad(quad, eyePositionInWorldCoords, lights, colors);
+	}
+	for (int lane = 0; lane < 4; lane++) {
+		if ((visible & (1 << lane)) == 0) {
+			continue;
+		}
+		const Fragment &fragment = quad.fragments[lane];
+		const glm::vec3 &p = fragment.windowPosition;
+		int X = (int)p.x;
+		int Y = (int)p.y;
+		if (gBuffer != nullptr) {
+			gBuffer->write(X, Y, fragment.worldNormal, fragment.worldPosition, fragment.materialId);
+		} else {
+			frameBuffer.setColor(X, Y, perPixelLighting ? colors[lane] : fragment.material.ambient);
+		}
+		frameBuffer.setDepth(X, Y, p.z);
+	}
+}
+
+/**
+ * @struct	MaterialBatchTable
+ * @brief	The G-buffer's material table, one array per coefficient.
+ */
+
+struct MaterialBatchTable {
+	std::vector<float> ambR, ambG, ambB;
+	std::vector<float> diffR, diffG, diffB;
+	std::vector<float> specR, specG, specB;
+	std::vector<float> shininess;
+	MaterialBatchTable(const std::vector<Material> &materials) {
+		for (const Material &m : materials) {
+			ambR.push_back(m.ambient.r); ambG.push_back(m.ambient.g); ambB.push_back(m.ambient.b);
+			diffR.push_back(m.diffuse.r); diffG.push_back(m.diffuse.g); diffB.push_back(m.diffuse.b);
+			specR.push_back(m.specular.r); specG.push_back(m.specular.g); specB.push_back(m.specular.b);
+			shininess.push_back(m.shininess);
+		}
+	}
+};
+
+/**
+ * @fn	static void shadeDeferredRow(FrameBuffer &frameBuffer, const GBuffer &gBuffer, const MaterialBatchTable &table, const glm::vec3 &eyePos, const LightBlock &lights, int y)
+ * @brief	Lights one row of the G-buffer, vfloatN::WIDTH pixels at a time.
+ */
+
+static void shadeDeferredRow(FrameBuffer &frameBuffer, const GBuffer &gBuffer, const MaterialBatchTable &table,
+							const glm::vec3 &eyePos, const LightBlock &lights, int y) {
+	typedef vfloatN VF;
+	const int W = VF::WIDTH;
+	const int width = gBuffer.getWidth();
+	const std::vector<Material> &materials = gBuffer.getMaterials();
+	const std::vector<float> *attributes[6] = { &gBuffer.posX, &gBuffer.posY, &gBuffer.posZ,
+												&gBuffer.normalX, &gBuffer.normalY, &gBuffer.normalZ };
+
+	for (int x0 = 0; x0 < width; x0 += W) {
+		const size_t first = gBuffer.pixelIndex(x0, y);
+		const int lanes = std::min(W, width - x0);
+		int ids[W];
+		bool anyVisible = false;
+		for (int lane = 0; lane < W; lane++) {
+			ids[lane] = lane < lanes ? gBuffer.materialIds[first + lane] : NO_MATERIAL;
+			anyVisible = anyVisible || ids[lane] != NO_MATERIAL;
+		}
+		if (!anyVisible) {
+			continue;
+		}
+
+		// Load the surface attributes, padding a partial batch at the end of the row.
+		VF attribute[6];
+		for (int a = 0; a < 6; a++) {
+			if (lanes == W) {
+				attribute[a] = VF::load(&(*attributes[a])[first]);
+			} else {
+				float padded[W] = {};
+				for (int lane = 0; lane < lanes; lane++) {
+					padded[lane] = (*attributes[a])[first + lane];
+				}
+				attribute[a] = VF::load(padded);
+			}
+		}
+		float coefficients[10][W];
+		const std::vector<float> *columns[10] = { &table.ambR, &table.ambG, &table.ambB,
+												&table.diffR, &table.diffG, &table.diffB,
+												&table.specR, &table.specG, &table.specB, &table.shininess };
+		for (int c = 0; c < 10; c++) {
+			for (int lane = 0; lane < W; lane++) {
+				coefficients[c][lane] = ids[lane] == NO_MATERIAL ? 0.0f : (*columns[c])[ids[lane]];
+			}
+		}
+
+		SurfaceBatch<VF> s;
+		s.px = attribute[0];
+		s.py = attribute[1];
+		s.pz = attribute[2];
+		s.nx = attribute[3];
+		s.ny = attribute[4];
+		s.nz = attribute[5];
+		completeSurfaceBatch(s, eyePos);
+		s.ambR = VF::load(coefficients[0]);
+		s.ambG = VF::load(coefficients[1]);
+		s.ambB = VF::load(coefficients[2]);
+		s.diffR = VF::load(coefficients[3]);
+		s.diffG = VF::load(coefficients[4]);
+		s.diffB = VF::load(coefficients[5]);
+		s.specR = VF::load(coefficients[6]);
+		s.specG = VF::load(coefficients[7]);
+		s.specB = VF::load(coefficients[8]);
+		s.shininess = VF::load(coefficients[9]);
+
+		VF R(0.0f), G(0.0f), B(0.0f);
+		for (const LightParams &light : lights.flatLights) {
+			accumulatePhong(light, s, R, G, B);
+		}
+		float r[W], g[W], b[W], n[3][W], p[3][W];
+		R.store(r);
+		G.store(g);
+		B.store(b);
+		if (!lights.otherLights.empty()) {
+			s.nx.store(n[0]);
+			s.ny.store(n[1]);
+			s.nz.store(n[2]);
+			s.px.store(p[0]);
+			s.py.store(p[1]);
+			s.pz.store(p[2]);
+		}
+		for (int lane = 0; lane < lanes; lane++) {
+			if (ids[lane] == NO_MATERIAL) {
+				continue;
+			}
+			color total(r[lane], g[lane], b[lane]);
+			for (LightSourcePtr light : lights.otherLights) {
+				total += light->illuminate(glm::vec3(p[0][lane], p[1][lane], p[2][lane]),
+											glm::vec3(n[0][lane], n[1][lane], n[2][lane]),
+											materials[ids[lane]], lights.eyeFrame, false);
+			}
+			frameBuffer.setColor(x0 + lane, y, total);
+		}
+	}
+}
+
+/**
+ * @fn	void FragmentOps::shadeDeferred(FrameBuffer &frameBuffer, const GBuffer &gBuffer, const glm::vec3 &eyePositionInWorldCoords, const std::vector<LightSourcePtr> &lights, const glm::mat4 &viewingMatrix)
+ * @brief	The lighting pass of deferred shading. Each pixel the G-buffer holds a
+ * 			surface for is lit once, so the cost depends on the resolution rather
+ * 			than on how many fragments were rasterized. Positional and spot lights
+ * 			are evaluated for several pixels at once; other light types go through
+ * 			illuminate one pixel at a time. Rows are shaded in parallel. Pixels
+ * 			without a surface keep their color.
+ * @param [in,out]	frameBuffer					Framebuffer receiving the colors.
+ * @param 		  	gBuffer						The G-buffer, filled while gBuffer was set.
+ * @param 		  	eyePositionInWorldCoords	The eye position in world coordinates.
+ * @param 		  	lights						Vector of lights in scene.
+ * @param 		  	viewingMatrix				The viewing transformation matrix.
+ */
+
+void FragmentOps::shadeDeferred(FrameBuffer &frameBuffer, const GBuffer &gBuffer,
+								const glm::vec3 &eyePositionInWorldCoords,
+								const std::vector<LightSourcePtr> &lights,
+								const glm::mat4 &viewingMatrix) {
+	LightBlock lightBlock;
+	lightBlock.prepare(lights, viewingMatrix);
+	const MaterialBatchTable table(gBuffer.getMaterials());
+
+	const int height = std::min(gBuffer.getHeight(), frameBuffer.getWindowHeight());
+	ThreadPool::getShared().parallelFor(height, [&](int y) {
+		shadeDeferredRow(frameBuffer, gBuffer, table, eyePositionInWorldCoords, lightBlock, y);
+	});
+}
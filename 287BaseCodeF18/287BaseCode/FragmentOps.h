@@ -1,6 +1,7 @@
 #pragma once
 #include "FrameBuffer.h"
 #include "Light.h"
+#include "GBuffer.h"
 
 /**
  * @enum	fogType
@@ -32,6 +33,27 @@ struct Fragment {
 	Material material;
 	glm::vec3 worldNormal;
 	glm::vec3 worldPosition;
+	int materialId;				//!< Id of material in the G-buffer's table. Only used when shading is deferred.
+	Fragment() : materialId(NO_MATERIAL) {}
+};
+
+/**
+ * @struct	FragmentQuad
+ * @brief	A 2x2 block of fragments from one triangle, processed together. Lanes
+ * 			the triangle does not cover are still interpolated, as helpers, so
+ * 			screen-space derivatives are available for every quad.
+ */
+
+struct FragmentQuad {
+	Fragment fragments[4];		//!< (x, y), (x + 1, y), (x, y + 1), (x + 1, y + 1)
+	int coverage;				//!< Bit i set ==> fragments[i] is inside the triangle.
+	glm::vec3 ddxPosition;		//!< Change in world position per pixel in x
+	glm::vec3 ddyPosition;		//!< Change in world position per pixel in y
+	glm::vec3 ddxNormal;		//!< Change in world normal per pixel in x
+	glm::vec3 ddyNormal;		//!< Change in world normal per pixel in y
+	float ddxDepth;				//!< Change in window z per pixel in x
+	float ddyDepth;				//!< Change in window z per pixel in y
+	void computeDerivatives();
 };
 
 /**
@@ -45,10 +67,18 @@ class FragmentOps {
 		static bool readonlyDepthBuffer;	//!< True ==> rendering will not affect depth buffer. Typically false
 		static bool readonlyColorBuffer;	//!< True ==> rendering will not affect color buffer. Typically false
 		static FogParams fogParams;			//!< Parameters controlling fog effects.
+		static GBuffer *gBuffer;			//!< Non-null ==> fragments are written here and shaded later by shadeDeferred.
+		static bool perPixelLighting;		//!< True ==> quads are lit per fragment. Otherwise the material's ambient color is written.
 		static void FragmentOps::processFragment(FrameBuffer &frameBuffer, const glm::vec3 &eyePositionInWorldCoords,
-														const std::vector<LightSourcePtr> lights, 
+														const std::vector<LightSourcePtr> &lights, 
 														const Fragment &fragment,
 														const glm::mat4 &viewingMatrix);
+		static void processQuad(FrameBuffer &frameBuffer, const glm::vec3 &eyePositionInWorldCoords,
+								const LightBlock &lights, const FragmentQuad &quad);
+		static void shadeDeferred(FrameBuffer &frameBuffer, const GBuffer &gBuffer,
+									const glm::vec3 &eyePositionInWorldCoords,
+									const std::vector<LightSourcePtr> &lights,
+									const glm::mat4 &viewingMatrix);
 	protected:
 		static color FragmentOps::applyFog(const color &destColor,
 											const glm::vec3 &eyePos, const glm::vec3 &fragPos);
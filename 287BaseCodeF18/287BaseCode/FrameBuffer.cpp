@@ -1,6 +1,15 @@
+#include <emmintrin.h>
 #include "Utilities.h"
 #include "FrameBuffer.h"
 
+// 4x4 Bayer matrix, used for ordered dithering during the resolve.
+static const float BAYER4x4[4][4] = {
+	{ 0.0f / 16.0f,  8.0f / 16.0f,  2.0f / 16.0f, 10.0f / 16.0f },
+	{ 12.0f / 16.0f, 4.0f / 16.0f, 14.0f / 16.0f,  6.0f / 16.0f },
+	{ 3.0f / 16.0f, 11.0f / 16.0f,  1.0f / 16.0f,  9.0f / 16.0f },
+	{ 15.0f / 16.0f, 7.0f / 16.0f, 13.0f / 16.0f,  5.0f / 16.0f }
+};
+
 /**
  * @fn	FrameBuffer::FrameBuffer(const int width, const int height)
  * @brief	Constructor
@@ -8,7 +17,14 @@
  * @param	height	The height.
  */
 
-FrameBuffer::FrameBuffer(const int width, const int height) : window(width, height) {
+FrameBuffer::FrameBuffer(const int width, const int height)
+	: window(width, height), colorBuffer(nullptr), depthBuffer(nullptr), accumBuffer(nullptr),
+	  linearBuffer(nullptr) {
+	tileShift = 0;
+	format = RGB8_FORMAT;
+	bytesPerPixel = BYTES_PER_PIXEL;
+	clearColorUB[0] = clearColorUB[1] = clearColorUB[2] = 0;
+	clearColorUB[3] = 255;
 	setFrameBufferSize(width, height);
 }
 
@@ -18,8 +34,10 @@ FrameBuffer::FrameBuffer(const int width, const int height) : window(width, heig
  */
 
 FrameBuffer::~FrameBuffer() {
-	delete[] colorBuffer;
-	delete[] depthBuffer;
+	_mm_free(colorBuffer);
+	_mm_free(depthBuffer);
+	_mm_free(accumBuffer);
+	_mm_free(linearBuffer);
 }
 
 /**
@@ -36,11 +54,290 @@ void FrameBuffer::setFrameBufferSize(int width, int height) {
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	glPixelStorei(GL_PACK_ALIGNMENT, 1);
 
-	delete [] colorBuffer;
-	delete [] depthBuffer;
+	allocateBuffers();
+}
+
+/**
+ * @fn	void FrameBuffer::setTileLayout(int tileSize)
+ * @brief	Chooses between row-major storage (tileSize of 0 or 1) and tile-major
+ * 			storage with square tiles, e.g., 8 or 64. The tile size must be a
+ * 			power of two. All the buffers are reallocated and cleared.
+ * @param	tileSize	Width and height of a tile, in pixels.
+ */
+
+void FrameBuffer::setTileLayout(int tileSize) {
+	if (tileSize < 1 || (tileSize & (tileSize - 1)) != 0) {
+		tileSize = 1;
+	}
+	int shift = 0;
+	while ((1 << shift) < tileSize) {
+		shift++;
+	}
+	if (shift == tileShift) {
+		return;
+	}
+	tileShift = shift;
+	allocateBuffers();
+	clearColorAndDepthBuffers();
+}
+
+/**
+ * @fn	void FrameBuffer::allocateBuffers()
+ * @brief	(Re)allocates every per-pixel buffer, using the current size and layout.
+ */
+
+void FrameBuffer::allocateBuffers() {
+	const int T = 1 << tileShift;
+	tilesX = (window.width + T - 1) >> tileShift;
+	tilesY = (window.height + T - 1) >> tileShift;
+
+	_mm_free(depthBuffer);
+	_mm_free(accumBuffer);
+	_mm_free(linearBuffer);
+	linearBuffer = nullptr;
+
+	allocateColorBuffer();
+	depthBuffer = (float *)_mm_malloc(storedPixels() * sizeof(float), CACHE_LINE_SIZE);
+	accumBuffer = (float *)_mm_malloc(storedPixels() * ACCUM_CHANNELS * sizeof(float), CACHE_LINE_SIZE);
+	clearAccumBuffer();
+
+	for (int level = 0; level < HIZ_LEVELS; level++) {
+		const int blockSize = 1 << (HIZ_SHIFT + level);
+		hizWidth[level] = (window.width + blockSize - 1) / blockSize;
+		hizHeight[level] = (window.height + blockSize - 1) / blockSize;
+		hizMin[level].resize(hizWidth[level] * hizHeight[level]);
+		hizMax[level].resize(hizWidth[level] * hizHeight[level]);
+		hizDirty[level].resize(hizWidth[level] * hizHeight[level]);
+	}
+	resetHiZ();
+}
+
+/**
+ * @fn	void FrameBuffer::resetHiZ()
+ * @brief	Sets every hierarchical depth block to the cleared depth, 1.
+ */
+
+void FrameBuffer::resetHiZ() {
+	for (int level = 0; level < HIZ_LEVELS; level++) {
+		std::fill(hizMin[level].begin(), hizMin[level].end(), 1.0f);
+		std::fill(hizMax[level].begin(), hizMax[level].end(), 1.0f);
+		std::fill(hizDirty[level].begin(), hizDirty[level].end(), (GLubyte)0);
+	}
+}
+
+/**
+ * @fn	void FrameBuffer::refreshHiZ(int level, int bx, int by)
+ * @brief	Recomputes a hierarchical depth block, if it is dirty. Level 0 blocks
+ * 			are computed from the depth buffer and higher levels from the
+ * 			four blocks below them.
+ * @param	level	The level.
+ * @param	bx   	The block's column.
+ * @param	by   	The block's row.
+ */
+
+void FrameBuffer::refreshHiZ(int level, int bx, int by) {
+	const int idx = by * hizWidth[level] + bx;
+	if (!hizDirty[level][idx]) {
+		return;
+	}
+	float lo = FLT_MAX, hi = -FLT_MAX;
+	if (level == 0) {
+		const int size = 1 << HIZ_SHIFT;
+		const int x0 = bx * size, y0 = by * size;
+		const int x1 = std::min(x0 + size, window.width);
+		const int y1 = std::min(y0 + size, window.height);
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				const float d = depthBuffer[pixelIndex(x, y)];
+				lo = std::min(lo, d);
+				hi = std::max(hi, d);
+			}
+		}
+	} else {
+		const int below = level - 1;
+		const int cx1 = std::min(2 * bx + 2, hizWidth[below]);
+		const int cy1 = std::min(2 * by + 2, hizHeight[below]);
+		for (int cy = 2 * by; cy < cy1; cy++) {
+			for (int cx = 2 * bx; cx < cx1; cx++) {
+				refreshHiZ(below, cx, cy);
+				const int child = cy * hizWidth[below] + cx;
+				lo = std::min(lo, hizMin[below][child]);
+				hi = std::max(hi, hizMax[below][child]);
+			}
+		}
+	}
+	hizMin[level][idx] = lo;
+	hizMax[level][idx] = hi;
+	hizDirty[level][idx] = 0;
+}
+
+/**
+ * @fn	float FrameBuffer::getHiZMinDepth(int level, int bx, int by)
+ * @brief	Gets the nearest depth within a hierarchical depth block.
+ * @param	level	The level. Blocks at level L are 8 * 2^L pixels wide.
+ * @param	bx   	The block's column.
+ * @param	by   	The block's row.
+ * @return	The nearest depth in the block.
+ */
+
+float FrameBuffer::getHiZMinDepth(int level, int bx, int by) {
+	refreshHiZ(level, bx, by);
+	return hizMin[level][by * hizWidth[level] + bx];
+}
+
+/**
+ * @fn	float FrameBuffer::getHiZMaxDepth(int level, int bx, int by)
+ * @brief	Gets the farthest depth within a hierarchical depth block.
+ * @param	level	The level. Blocks at level L are 8 * 2^L pixels wide.
+ * @param	bx   	The block's column.
+ * @param	by   	The block's row.
+ * @return	The farthest depth in the block.
+ */
+
+float FrameBuffer::getHiZMaxDepth(int level, int bx, int by) {
+	refreshHiZ(level, bx, by);
+	return hizMax[level][by * hizWidth[level] + bx];
+}
+
+/**
+ * @fn	bool FrameBuffer::isOccluded(int x0, int y0, int x1, int y1, float nearestDepth)
+ * @brief	Determines whether anything at nearestDepth or farther would fail the
+ * 			depth test everywhere in a rectangle. Uses the finest level at
+ * 			which the rectangle spans at most 2x2 blocks.
+ * @param	x0				Left edge of the rectangle, inclusive.
+ * @param	y0				Bottom edge of the rectangle, inclusive.
+ * @param	x1				Right edge of the rectangle, inclusive.
+ * @param	y1				Top edge of the rectangle, inclusive.
+ * @param	nearestDepth	The nearest depth being drawn in the rectangle.
+ * @return	True iff the rectangle is hidden at that depth.
+ */
+
+bool FrameBuffer::isOccluded(int x0, int y0, int x1, int y1, float nearestDepth) {
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, window.width - 1);
+	y1 = std::min(y1, window.height - 1);
+	if (x0 > x1 || y0 > y1) {
+		return true;
+	}
+	int level = 0;
+	while (level < HIZ_LEVELS - 1 &&
+		((x1 >> (HIZ_SHIFT + level)) - (x0 >> (HIZ_SHIFT + level)) > 1 ||
+		 (y1 >> (HIZ_SHIFT + level)) - (y0 >> (HIZ_SHIFT + level)) > 1)) {
+		level++;
+	}
+	const int s = HIZ_SHIFT + level;
+	for (int by = y0 >> s; by <= (y1 >> s); by++) {
+		for (int bx = x0 >> s; bx <= (x1 >> s); bx++) {
+			if (nearestDepth < getHiZMaxDepth(level, bx, by)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * @fn	void FrameBuffer::allocateColorBuffer()
+ * @brief	(Re)allocates the color buffer, using the current size, layout and format.
+ */
+
+void FrameBuffer::allocateColorBuffer() {
+	_mm_free(colorBuffer);
+	colorBuffer = (GLubyte *)_mm_malloc(storedPixels() * bytesPerPixel, CACHE_LINE_SIZE);
+	if (linearBuffer != nullptr) {
+		_mm_free(linearBuffer);
+		linearBuffer = nullptr;
+	}
+}
+
+/**
+ * @fn	GLubyte *FrameBuffer::getColorTile(int tx, int ty)
+ * @brief	Gets the first byte of a tile of the color buffer. In tile-major order
+ * 			the tile's pixels follow contiguously, row by row.
+ * @param	tx	The tile's column.
+ * @param	ty	The tile's row.
+ * @return	Pointer to the tile's first pixel.
+ */
+
+GLubyte *FrameBuffer::getColorTile(int tx, int ty) {
+	return colorBuffer + bytesPerPixel * pixelIndex(tx << tileShift, ty << tileShift);
+}
+
+/**
+ * @fn	float *FrameBuffer::getDepthTile(int tx, int ty)
+ * @brief	Gets the first depth of a tile of the depth buffer.
+ * @param	tx	The tile's column.
+ * @param	ty	The tile's row.
+ * @return	Pointer to the tile's first depth.
+ */
+
+float *FrameBuffer::getDepthTile(int tx, int ty) {
+	return depthBuffer + pixelIndex(tx << tileShift, ty << tileShift);
+}
+
+/**
+ * @fn	void FrameBuffer::copyColorToLinear(GLubyte *dest) const
+ * @brief	Copies the visible part of the color buffer into a row-major array,
+ * 			one tile row at a time. Padding pixels are dropped.
+ * @param [in,out]	dest	Destination; width * height * getBytesPerPixel() bytes.
+ */
+
+void FrameBuffer::copyColorToLinear(GLubyte *dest) const {
+	if (!isTiled()) {
+		std::memcpy(dest, colorBuffer, (size_t)window.width * window.height * bytesPerPixel);
+		return;
+	}
+	const int T = 1 << tileShift;
+	const size_t tileRowBytes = (size_t)T * bytesPerPixel;
+	const size_t destRowBytes = (size_t)window.width * bytesPerPixel;
+	const GLubyte *src = colorBuffer;
+	for (int ty = 0; ty < tilesY; ty++) {
+		const int rows = std::min(T, window.height - ty * T);
+		for (int tx = 0; tx < tilesX; tx++, src += tileRowBytes * T) {
+			const size_t rowBytes = (size_t)std::min(T, window.width - tx * T) * bytesPerPixel;
+			GLubyte *d = dest + (size_t)ty * T * destRowBytes + (size_t)tx * tileRowBytes;
+			for (int r = 0; r < rows; r++, d += destRowBytes) {
+				std::memcpy(d, src + r * tileRowBytes, rowBytes);
+			}
+		}
+	}
+}
+
+/**
+ * @fn	const GLubyte *FrameBuffer::getLinearColorBuffer() const
+ * @brief	Gets the color buffer in row-major order, linearizing it first if
+ * 			it is tiled.
+ * @return	The row-major colors, valid until the framebuffer is next changed.
+ */
 
-	colorBuffer = new GLubyte[window.area() * BYTES_PER_PIXEL];
-	depthBuffer = new float[window.area()];
+const GLubyte *FrameBuffer::getLinearColorBuffer() const {
+	if (!isTiled()) {
+		return colorBuffer;
+	}
+	if (linearBuffer == nullptr) {
+		linearBuffer = (GLubyte *)_mm_malloc((size_t)window.width * window.height * bytesPerPixel, CACHE_LINE_SIZE);
+	}
+	copyColorToLinear(linearBuffer);
+	return linearBuffer;
+}
+
+/**
+ * @fn	void FrameBuffer::setColorFormat(colorBufferFormat fmt)
+ * @brief	Chooses between packed RGB8 pixels and padded RGBA8 pixels. With
+ * 			RGBA8 every pixel store is an aligned 32-bit write. The color
+ * 			buffer's contents are cleared.
+ * @param	fmt	The new format.
+ */
+
+void FrameBuffer::setColorFormat(colorBufferFormat fmt) {
+	if (fmt == format) {
+		return;
+	}
+	format = fmt;
+	bytesPerPixel = (fmt == RGBA8_FORMAT) ? PADDED_BYTES_PER_PIXEL : BYTES_PER_PIXEL;
+	allocateColorBuffer();
+	clearColorAndDepthBuffers();
 }
 
 /**
@@ -61,14 +358,32 @@ void FrameBuffer::setClearColor(const color &clear) {
  */
 
 void FrameBuffer::clearColorAndDepthBuffers() {
-	for (int y = 0; y < window.height; ++y) {
-		for (int x = 0; x < window.width; ++x) {
-			std::memcpy(colorBuffer + BYTES_PER_PIXEL * (x + y * window.width),
-				clearColorUB, BYTES_PER_PIXEL);
-		}
+	// Build a 48 byte pattern: 16 RGB pixels or 12 RGBA pixels. Both tile it exactly.
+	GLubyte pattern[48];
+	for (int i = 0; i < 48; i += bytesPerPixel) {
+		std::memcpy(pattern + i, clearColorUB, bytesPerPixel);
 	}
-	const int SZ = window.area();
-	std::fill(depthBuffer, depthBuffer + SZ, 1.0f);
+	const __m128i p0 = _mm_loadu_si128((const __m128i *)pattern);
+	const __m128i p1 = _mm_loadu_si128((const __m128i *)(pattern + 16));
+	const __m128i p2 = _mm_loadu_si128((const __m128i *)(pattern + 32));
+
+	const size_t colorBytes = (size_t)storedPixels() * bytesPerPixel;
+	size_t i = 0;
+	for (; i + 48 <= colorBytes; i += 48) {
+		_mm_store_si128((__m128i *)(colorBuffer + i), p0);
+		_mm_store_si128((__m128i *)(colorBuffer + i + 16), p1);
+		_mm_store_si128((__m128i *)(colorBuffer + i + 32), p2);
+	}
+	std::memcpy(colorBuffer + i, pattern, colorBytes - i);
+
+	const size_t SZ = storedPixels();
+	const __m128 farDepth = _mm_set1_ps(1.0f);
+	size_t j = 0;
+	for (; j + 4 <= SZ; j += 4) {
+		_mm_store_ps(depthBuffer + j, farDepth);
+	}
+	std::fill(depthBuffer + j, depthBuffer + SZ, 1.0f);
+	resetHiZ();
 }
 
 /**
@@ -78,7 +393,8 @@ void FrameBuffer::clearColorAndDepthBuffers() {
 
 void FrameBuffer::showColorBuffer() const {
 	glRasterPos2d(-1, -1);
-	glDrawPixels(window.width, window.height, GL_RGB, GL_UNSIGNED_BYTE, colorBuffer);
+	glDrawPixels(window.width, window.height, format == RGBA8_FORMAT ? GL_RGBA : GL_RGB,
+					GL_UNSIGNED_BYTE, getLinearColorBuffer());
 	glFlush();
 }
 
@@ -99,9 +415,180 @@ void FrameBuffer::setColor(int x, int y, const color &rgb) {
 
 	GLubyte c[] = { (GLubyte)(clampedColor.r * 255),
 					(GLubyte)(clampedColor.g * 255),
-					(GLubyte)(clampedColor.b * 255) };
+					(GLubyte)(clampedColor.b * 255),
+					255 };
+
+	GLubyte *dest = colorBuffer + bytesPerPixel * pixelIndex(x, y);
+	if (format == RGBA8_FORMAT) {
+		GLuint packed;
+		std::memcpy(&packed, c, PADDED_BYTES_PER_PIXEL);
+		*(GLuint *)dest = packed;
+	} else {
+		std::memcpy(dest, c, BYTES_PER_PIXEL);
+	}
+}
 
-	std::memcpy(colorBuffer + BYTES_PER_PIXEL * (x + y * window.width), c, BYTES_PER_PIXEL);
+/**
+ * @fn	void FrameBuffer::convertToRGB8(const color *src, GLubyte *dest, int count)
+ * @brief	Clamps and converts a run of colors into packed 8-bit RGB. Four pixels
+ * 			are converted per iteration.
+ * @param 		  	src  	The colors to convert.
+ * @param [in,out]	dest 	Destination; 3 bytes per pixel.
+ * @param 		  	count	Number of pixels.
+ */
+
+void FrameBuffer::convertToRGB8(const color *src, GLubyte *dest, int count) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const float *in = (const float *)src;
+	int i = 0;
+	for (; i + 4 <= count; i += 4, in += 12, dest += 12) {
+		// 4 pixels are 12 floats: rgbr gbrg brgb
+		__m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in), zero), one), scale);
+		__m128 b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + 4), zero), one), scale);
+		__m128 c = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + 8), zero), one), scale);
+		__m128i lo = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+		__m128i hi = _mm_packs_epi32(_mm_cvttps_epi32(c), _mm_setzero_si128());
+		__m128i bytes = _mm_packus_epi16(lo, hi);
+		_mm_storel_epi64((__m128i *)dest, bytes);
+		int last = _mm_cvtsi128_si32(_mm_srli_si128(bytes, 8));
+		std::memcpy(dest + 8, &last, 4);
+	}
+	for (; i < count; i++, in += 3, dest += 3) {
+		for (int k = 0; k < 3; k++) {
+			dest[k] = (GLubyte)(glm::clamp(in[k], 0.0f, 1.0f) * 255);
+		}
+	}
+}
+
+/**
+ * @fn	void FrameBuffer::convertToRGBA8(const color *src, GLubyte *dest, int count)
+ * @brief	Clamps and converts a run of colors into padded 8-bit RGBA, with
+ * 			alpha set to 255. Four pixels are written with one 16 byte store.
+ * @param 		  	src  	The colors to convert.
+ * @param [in,out]	dest 	Destination; 4 bytes per pixel.
+ * @param 		  	count	Number of pixels.
+ */
+
+void FrameBuffer::convertToRGBA8(const color *src, GLubyte *dest, int count) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const __m128 alphaMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	const __m128 opaque = _mm_setr_ps(0.0f, 0.0f, 0.0f, 255.0f);
+	const float *in = (const float *)src;
+
+	// Each pixel is loaded as rgb plus the next pixel's red, which is then replaced by alpha.
+	// The last pixel of the run is converted separately to avoid reading past the end.
+	int i = 0;
+	for (; i + 4 < count; i += 4, in += 12, dest += 16) {
+		__m128 p[4];
+		for (int k = 0; k < 4; k++) {
+			__m128 c = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + 3 * k), zero), one), scale);
+			p[k] = _mm_or_ps(_mm_and_ps(c, alphaMask), opaque);
+		}
+		__m128i lo = _mm_packs_epi32(_mm_cvttps_epi32(p[0]), _mm_cvttps_epi32(p[1]));
+		__m128i hi = _mm_packs_epi32(_mm_cvttps_epi32(p[2]), _mm_cvttps_epi32(p[3]));
+		_mm_storeu_si128((__m128i *)dest, _mm_packus_epi16(lo, hi));
+	}
+	for (; i < count; i++, in += 3, dest += 4) {
+		for (int k = 0; k < 3; k++) {
+			dest[k] = (GLubyte)(glm::clamp(in[k], 0.0f, 1.0f) * 255);
+		}
+		dest[3] = 255;
+	}
+}
+
+/**
+ * @fn	void FrameBuffer::convertSpan(const color *src, GLubyte *dest, int count) const
+ * @brief	Converts a run of colors using this framebuffer's format.
+ * @param 		  	src  	The colors to convert.
+ * @param [in,out]	dest 	Destination in the color buffer.
+ * @param 		  	count	Number of pixels.
+ */
+
+void FrameBuffer::convertSpan(const color *src, GLubyte *dest, int count) const {
+	if (format == RGBA8_FORMAT) {
+		convertToRGBA8(src, dest, count);
+	} else {
+		convertToRGB8(src, dest, count);
+	}
+}
+
+/**
+ * @fn	void FrameBuffer::setColorSpanUnchecked(int x, int y, int count, const color *colors)
+ * @brief	Writes a horizontal run of colors starting at (x, y). No bounds checking
+ * 			is done; the whole span must lie inside the window.
+ * @param	x	  	The x coordinate of the first pixel.
+ * @param	y	  	The y coordinate.
+ * @param	count 	Number of pixels.
+ * @param	colors	The colors to write.
+ */
+
+void FrameBuffer::setColorSpanUnchecked(int x, int y, int count, const color *colors) {
+	if (!isTiled()) {
+		convertSpan(colors, colorBuffer + bytesPerPixel * pixelIndex(x, y), count);
+		return;
+	}
+	// Split the span where it crosses into the next tile.
+	const int T = 1 << tileShift;
+	while (count > 0) {
+		const int n = std::min(count, T - (x & (T - 1)));
+		convertSpan(colors, colorBuffer + bytesPerPixel * pixelIndex(x, y), n);
+		x += n;
+		colors += n;
+		count -= n;
+	}
+}
+
+/**
+ * @fn	void FrameBuffer::fillColorSpanUnchecked(int x, int y, int count, const color &C)
+ * @brief	Writes the same color to a horizontal run of pixels starting at (x, y).
+ * 			No bounds checking is done.
+ * @param	x	 	The x coordinate of the first pixel.
+ * @param	y	 	The y coordinate.
+ * @param	count	Number of pixels.
+ * @param	C	 	The color to write.
+ */
+
+void FrameBuffer::fillColorSpanUnchecked(int x, int y, int count, const color &C) {
+	GLubyte c[PADDED_BYTES_PER_PIXEL];
+	convertSpan(&C, c, 1);
+	GLuint packed;
+	std::memcpy(&packed, c, PADDED_BYTES_PER_PIXEL);
+
+	const int T = getTileSize();
+	while (count > 0) {
+		const int n = isTiled() ? std::min(count, T - (x & (T - 1))) : count;
+		GLubyte *dest = colorBuffer + bytesPerPixel * pixelIndex(x, y);
+		if (format == RGBA8_FORMAT) {
+			std::fill((GLuint *)dest, (GLuint *)dest + n, packed);
+		} else {
+			for (int i = 0; i < n; i++, dest += BYTES_PER_PIXEL) {
+				std::memcpy(dest, c, BYTES_PER_PIXEL);
+			}
+		}
+		x += n;
+		count -= n;
+	}
+}
+
+/**
+ * @fn	void FrameBuffer::setColorTileUnchecked(int x, int y, int width, int height, const color *colors)
+ * @brief	Writes a rectangular block of colors whose lower left corner is (x, y).
+ * 			The colors are stored row by row. No bounds checking is done.
+ * @param	x	  	The x coordinate of the lower left corner.
+ * @param	y	  	The y coordinate of the lower left corner.
+ * @param	width 	Width of the tile.
+ * @param	height	Height of the tile.
+ * @param	colors	width*height colors.
+ */
+
+void FrameBuffer::setColorTileUnchecked(int x, int y, int width, int height, const color *colors) {
+	for (int row = 0; row < height; row++) {
+		setColorSpanUnchecked(x, y + row, width, colors + row * width);
+	}
 }
 
 /**
@@ -116,10 +603,10 @@ color FrameBuffer::getColor(int x, int y) const {
 	float red, green, blue;
 
 	if (checkInWindow(x, y)) {
-		GLubyte c[BYTES_PER_PIXEL];
+		GLubyte c[PADDED_BYTES_PER_PIXEL];
 
 		// Retrieve color values from the color buffer
-		std::memcpy(c, colorBuffer + BYTES_PER_PIXEL * (x + y * window.width), BYTES_PER_PIXEL);
+		std::memcpy(c, colorBuffer + bytesPerPixel * pixelIndex(x, y), bytesPerPixel);
 
 		// Convert individual color components back to floating point values
 		red = c[0] / 255.0f;
@@ -156,7 +643,8 @@ void FrameBuffer::setDepth(float x, float y, float depth) {
 
 void FrameBuffer::setDepth(int x, int y, float depth) {
 	if (checkInWindow(x, y)) {
-		depthBuffer[y * window.width + x] = depth;
+		depthBuffer[pixelIndex(x, y)] = depth;
+		markHiZDirty(x, y);
 	}
 }
 
@@ -170,7 +658,7 @@ void FrameBuffer::setDepth(int x, int y, float depth) {
 
 float FrameBuffer::getDepth(int x, int y) const {
 	if (checkInWindow(x, y)) {
-		return depthBuffer[y * window.width + x];
+		return depthBuffer[pixelIndex(x, y)];
 	} else {
 		return 0.0f;
 	}
@@ -214,3 +702,193 @@ void FrameBuffer::setPixel(int x, int y, const color &C, float depth) {
 	setDepth(x, y, depth);
 	setColor(x, y, C);
 }
+
+
+/**
+ * @fn	void FrameBuffer::clearAccumBuffer()
+ * @brief	Discards all the samples in the accumulation buffer.
+ */
+
+void FrameBuffer::clearAccumBuffer() {
+	std::fill(accumBuffer, accumBuffer + storedPixels() * ACCUM_CHANNELS, 0.0f);
+}
+
+/**
+ * @fn	void FrameBuffer::clearAccumBuffer(const BoundingBoxi &rect)
+ * @brief	Discards the samples of the pixels in a rectangle.
+ * @param	rect	The pixels, inclusive; it must lie within the window.
+ */
+
+void FrameBuffer::clearAccumBuffer(const BoundingBoxi &rect) {
+	for (int y = rect.ly; y <= rect.ry; y++) {
+		for (int x = rect.lx; x <= rect.rx; x++) {
+			_mm_store_ps(accumBuffer + ACCUM_CHANNELS * pixelIndex(x, y), _mm_setzero_ps());
+		}
+	}
+}
+
+/**
+ * @fn	void FrameBuffer::addSample(int x, int y, const color &C, float weight)
+ * @brief	Adds an unclamped sample to the accumulation buffer at (x, y).
+ * @param	x	  	The x coordinate.
+ * @param	y	  	The y coordinate.
+ * @param	C	  	The sample's radiance.
+ * @param	weight	The weight of the sample. Usually 1.
+ */
+
+void FrameBuffer::addSample(int x, int y, const color &C, float weight) {
+	if (!checkInWindow(x, y)) {
+		return;
+	}
+	float *p = accumBuffer + ACCUM_CHANNELS * pixelIndex(x, y);
+	_mm_store_ps(p, _mm_add_ps(_mm_load_ps(p),
+		_mm_setr_ps(weight * C.r, weight * C.g, weight * C.b, weight)));
+}
+
+/**
+ * @fn	float FrameBuffer::getSampleCount(int x, int y) const
+ * @brief	Gets the (weighted) number of samples accumulated at (x, y).
+ * @param	x	The x coordinate.
+ * @param	y	The y coordinate.
+ * @return	The number of samples at (x, y).
+ */
+
+float FrameBuffer::getSampleCount(int x, int y) const {
+	if (checkInWindow(x, y)) {
+		return accumBuffer[ACCUM_CHANNELS * pixelIndex(x, y) + 3];
+	} else {
+		return 0.0f;
+	}
+}
+
+/**
+ * @fn	void ToneMapper::prepare(const ToneMapParams &P)
+ * @brief	Sets the parameters, rebuilding the gamma table if the gamma changed.
+ * @param	P	The tone mapping parameters.
+ */
+
+void ToneMapper::prepare(const ToneMapParams &P) {
+	params = P;
+	if (params.gamma != 1.0f && gammaLUTValue != params.gamma) {
+		for (int i = 0; i < GAMMA_LUT_SIZE; i++) {
+			gammaLUT[i] = 255.0f * std::pow(i / (GAMMA_LUT_SIZE - 1.0f), 1.0f / params.gamma);
+		}
+		gammaLUTValue = params.gamma;
+	}
+}
+
+/**
+ * @fn	static inline int toneMapPixel(const ToneMapper &mapper, __m128 c, int x, int y)
+ * @brief	Tone maps one averaged color, held in the low three lanes.
+ * @param	mapper	The prepared tone mapper.
+ * @param	c	  	The color.
+ * @param	x	  	The pixel's x coordinate, which picks the dither offset.
+ * @param	y	  	The pixel's y coordinate.
+ * @return	The 8-bit red, green and blue in the low three bytes.
+ */
+
+static inline int toneMapPixel(const ToneMapper &mapper, __m128 c, int x, int y) {
+	const ToneMapParams &params = mapper.params;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale255 = _mm_set1_ps(255.0f);
+	c = _mm_mul_ps(c, _mm_set1_ps(params.exposure));
+
+	if (params.type == REINHARD_TONE_MAP) {
+		c = _mm_div_ps(c, _mm_add_ps(one, c));
+	} else if (params.type == FILMIC_TONE_MAP) {
+		// Filmic curve (Narkowicz's ACES fit): x(ax + b) / (x(cx + d) + e)
+		const __m128 fa = _mm_set1_ps(2.51f);
+		const __m128 fb = _mm_set1_ps(0.03f);
+		const __m128 fc = _mm_set1_ps(2.43f);
+		const __m128 fd = _mm_set1_ps(0.59f);
+		const __m128 fe = _mm_set1_ps(0.14f);
+		__m128 num = _mm_mul_ps(c, _mm_add_ps(_mm_mul_ps(fa, c), fb));
+		__m128 den = _mm_add_ps(_mm_mul_ps(c, _mm_add_ps(_mm_mul_ps(fc, c), fd)), fe);
+		c = _mm_div_ps(num, den);
+	}
+	c = _mm_min_ps(_mm_max_ps(c, zero), one);
+
+	float encoded[4];
+	if (params.gamma != 1.0f) {
+		const __m128 lutScale = _mm_set1_ps(GAMMA_LUT_SIZE - 1.0f);
+		__m128i idx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, lutScale), _mm_set1_ps(0.5f)));
+		int lanes[4];
+		_mm_storeu_si128((__m128i *)lanes, idx);
+		encoded[0] = mapper.gammaLUT[lanes[0]];
+		encoded[1] = mapper.gammaLUT[lanes[1]];
+		encoded[2] = mapper.gammaLUT[lanes[2]];
+		encoded[3] = 0.0f;
+	} else {
+		_mm_storeu_ps(encoded, _mm_mul_ps(c, scale255));
+	}
+
+	__m128 e = _mm_loadu_ps(encoded);
+	if (params.dither) {
+		e = _mm_min_ps(_mm_add_ps(e, _mm_set1_ps(BAYER4x4[y & 3][x & 3])), scale255);
+	}
+	__m128i q = _mm_cvttps_epi32(e);
+	q = _mm_packs_epi32(q, q);
+	q = _mm_packus_epi16(q, q);
+	return _mm_cvtsi128_si32(q);
+}
+
+/**
+ * @fn	void ToneMapper::convertToRGB8(const color *src, GLubyte *dest, int count, int x, int y) const
+ * @brief	Tone maps a run of averaged colors along a row into packed 8-bit RGB,
+ * 			exactly as resolving the same colors in a framebuffer would.
+ * @param 		  	src  	The colors.
+ * @param [in,out]	dest 	Destination; 3 bytes per pixel.
+ * @param 		  	count	Number of pixels.
+ * @param 		  	x	 	Image x coordinate of the first pixel.
+ * @param 		  	y	 	Image y coordinate of the row.
+ */
+
+void ToneMapper::convertToRGB8(const color *src, GLubyte *dest, int count, int x, int y) const {
+	for (int i = 0; i < count; i++, dest += BYTES_PER_PIXEL) {
+		const int packed = toneMapPixel(*this, _mm_setr_ps(src[i].r, src[i].g, src[i].b, 0.0f), x + i, y);
+		std::memcpy(dest, &packed, BYTES_PER_PIXEL);
+	}
+}
+
+/**
+ * @fn	void FrameBuffer::resolveAccumBuffer(const ToneMapParams &params)
+ * @brief	Converts the accumulated samples into 8-bit colors. The average of
+ * 			each pixel is scaled by the exposure, tone mapped, gamma encoded
+ * 			and (optionally) dithered. Pixels without samples are left unchanged.
+ * @param	params	The tone mapping parameters.
+ */
+
+void FrameBuffer::resolveAccumBuffer(const ToneMapParams &params) {
+	resolveAccumBuffer(params, BoundingBoxi(0, window.width - 1, 0, window.height - 1));
+}
+
+/**
+ * @fn	void FrameBuffer::resolveAccumBuffer(const ToneMapParams &params, const BoundingBoxi &rect)
+ * @brief	Converts the accumulated samples of the pixels in a rectangle into
+ * 			8-bit colors, as resolveAccumBuffer does for the whole window.
+ * @param	params	The tone mapping parameters.
+ * @param	rect  	The pixels, inclusive; it must lie within the window.
+ */
+
+void FrameBuffer::resolveAccumBuffer(const ToneMapParams &params, const BoundingBoxi &rect) {
+	toneMapper.prepare(params);
+	for (int y = rect.ly; y <= rect.ry; y++) {
+		for (int x = rect.lx; x <= rect.rx; x++) {
+			const size_t idx = pixelIndex(x, y);
+			const float *src = accumBuffer + ACCUM_CHANNELS * idx;
+			GLubyte *dest = colorBuffer + bytesPerPixel * idx;
+			if (src[3] <= 0.0f) {
+				continue;
+			}
+			__m128 s = _mm_load_ps(src);
+			__m128 n = _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 3));
+			const int packed = toneMapPixel(toneMapper, _mm_div_ps(s, n), x, y);
+			if (format == RGBA8_FORMAT) {
+				*(GLuint *)dest = (GLuint)packed | 0xFF000000;
+			} else {
+				std::memcpy(dest, &packed, BYTES_PER_PIXEL);
+			}
+		}
+	}
+}
@@ -1,15 +1,77 @@
 #pragma once
 
+#include <vector>
 #include "defs.h"
 #include "ColorAndMaterials.h"
 
 const int BYTES_PER_PIXEL = 3;			//!< RGB requires 3 bytes.
+const int PADDED_BYTES_PER_PIXEL = 4;	//!< RGBA requires 4 bytes.
+const int ACCUM_CHANNELS = 4;			//!< RGB plus the number of samples.
+const int GAMMA_LUT_SIZE = 4096;		//!< Entries in the gamma encoding table.
+const int CACHE_LINE_SIZE = 64;			//!< Alignment of the per-pixel buffers.
+const int HIZ_LEVELS = 4;				//!< Hierarchical depth levels: 8x8, 16x16, 32x32 and 64x64 pixels.
+const int HIZ_SHIFT = 3;				//!< log2 of the width of a level 0 hierarchical depth block.
+
+/**
+ * @enum	toneMapType
+ * @brief	Represents the different operators used when resolving HDR samples.
+ */
+
+enum toneMapType { NO_TONE_MAP, REINHARD_TONE_MAP, FILMIC_TONE_MAP };
+
+/**
+ * @enum	colorBufferFormat
+ * @brief	Represents the possible layouts of a color buffer pixel.
+ */
+
+enum colorBufferFormat { RGB8_FORMAT, RGBA8_FORMAT };
+
+/**
+ * @struct	ToneMapParams
+ * @brief	Parameters used when resolving the accumulation buffer into the color buffer.
+ */
+
+struct ToneMapParams {
+	float exposure;		//!< Scale applied to the averaged radiance.
+	toneMapType type;	//!< Tone mapping operator.
+	float gamma;		//!< Display gamma. 1 means no gamma encoding.
+	bool dither;		//!< True ==> add ordered dithering before quantizing.
+	ToneMapParams(float exp = 1.0f, toneMapType tm = NO_TONE_MAP, float g = 1.0f, bool d = false)
+		: exposure(exp), type(tm), gamma(g), dither(d) {
+	}
+};
+
+/**
+ * @struct	ToneMapper
+ * @brief	Turns averaged HDR colors into 8-bit colors: exposure, tone mapping,
+ * 			gamma encoding and, optionally, ordered dithering. Keeps the gamma
+ * 			table of the last parameters it was prepared with. Resolving the
+ * 			accumulation buffer and writing an image straight to a file both
+ * 			use it, so the two give the same pixels.
+ */
+
+struct ToneMapper {
+	ToneMapParams params;				//!< Parameters prepared for
+	float gammaLUT[GAMMA_LUT_SIZE];		//!< Maps [0,1] linear values to gamma encoded [0,255]
+	float gammaLUTValue;				//!< Gamma used to build gammaLUT
+	ToneMapper() : gammaLUTValue(0.0f) {}
+	void prepare(const ToneMapParams &params);
+	void convertToRGB8(const color *src, GLubyte *dest, int count, int x, int y) const;
+};
 
 /**
  * @struct	FrameBuffer
  * @brief	Represents a framebuffer. Two identically sized 2D arrays. The color
  * 			buffer stores the colors and the depth buffer stores the corresponding
  * 			depth at each pixel.
+ * 			
+ * 			The buffers are either row-major or tile-major. In tile-major order
+ * 			each tileSize x tileSize tile is a contiguous, cache line aligned
+ * 			block, and the buffers are padded out to a whole number of tiles.
+ * 			
+ * 			A hierarchical depth pyramid holds the nearest and farthest depth of
+ * 			each 8x8 block, and of 16x16, 32x32 and 64x64 blocks above that.
+ * 			Writes only mark blocks dirty; a block is recomputed when next read.
  */
 
 struct FrameBuffer {
@@ -31,10 +93,87 @@ struct FrameBuffer {
 	float getDepth(float x, float y) const;
 
 	void setPixel(int x, int y, const color &C, float depth);
+
+	float getHiZMinDepth(int level, int bx, int by);
+	float getHiZMaxDepth(int level, int bx, int by);
+	bool isOccluded(int x0, int y0, int x1, int y1, float nearestDepth);
+
+	void setTileLayout(int tileSize);
+	bool isTiled() const { return tileShift > 0; }
+	int getTileSize() const { return 1 << tileShift; }
+	int getTilesX() const { return tilesX; }
+	int getTilesY() const { return tilesY; }
+	GLubyte *getColorTile(int tx, int ty);
+	float *getDepthTile(int tx, int ty);
+	void copyColorToLinear(GLubyte *dest) const;
+	const GLubyte *getLinearColorBuffer() const;
+	int getBytesPerPixel() const { return bytesPerPixel; }
+
+	/**
+	 * @fn	size_t pixelIndex(int x, int y) const
+	 * @brief	Index of pixel (x, y) within the per-pixel buffers. With a tile
+	 * 			shift of 0 this reduces to the row-major index x + y * width.
+	 * 			Computed in 64 bits so very large framebuffers do not overflow.
+	 * @param	x	The x coordinate.
+	 * @param	y	The y coordinate.
+	 * @return	The index.
+	 */
+
+	size_t pixelIndex(int x, int y) const {
+		const int mask = (1 << tileShift) - 1;
+		return (((size_t)(y >> tileShift) * tilesX + (x >> tileShift)) << (2 * tileShift)) |
+				((y & mask) << tileShift) | (x & mask);
+	}
+
+	void setColorFormat(colorBufferFormat fmt);
+	colorBufferFormat getColorFormat() const { return format; }
+	void setColorSpanUnchecked(int x, int y, int count, const color *colors);
+	void fillColorSpanUnchecked(int x, int y, int count, const color &C);
+	void setColorTileUnchecked(int x, int y, int width, int height, const color *colors);
+	static void convertToRGB8(const color *src, GLubyte *dest, int count);
+	static void convertToRGBA8(const color *src, GLubyte *dest, int count);
+
+	void clearAccumBuffer();
+	void clearAccumBuffer(const BoundingBoxi &rect);
+	void addSample(int x, int y, const color &C, float weight = 1.0f);
+	float getSampleCount(int x, int y) const;
+	void resolveAccumBuffer(const ToneMapParams &params = ToneMapParams());
+	void resolveAccumBuffer(const ToneMapParams &params, const BoundingBoxi &rect);
 protected:
 	bool checkInWindow(int x, int y) const;
 	Window window;							//!< Dimensions of framebuffer
-	GLubyte clearColorUB[BYTES_PER_PIXEL];	//!< Clear color
+	int tileShift;							//!< log2 of the tile size. 0 means row-major
+	int tilesX;								//!< Tiles per row (the width when row-major)
+	int tilesY;								//!< Rows of tiles (the height when row-major)
+	colorBufferFormat format;				//!< Layout of each pixel in the color buffer
+	int bytesPerPixel;						//!< 3 for RGB8, 4 for RGBA8
+	GLubyte clearColorUB[PADDED_BYTES_PER_PIXEL];	//!< Clear color
 	GLubyte *colorBuffer;					//!< 2D array for holding colors
 	float *depthBuffer;						//!< 2D array for holding depths
+	float *accumBuffer;						//!< 2D array of HDR samples: r, g, b and sample count
+	mutable GLubyte *linearBuffer;			//!< Row-major copy of a tiled color buffer, for display
+	ToneMapper toneMapper;					//!< Resolves the accumulation buffer
+	int hizWidth[HIZ_LEVELS];				//!< Blocks per row at each level
+	int hizHeight[HIZ_LEVELS];				//!< Rows of blocks at each level
+	std::vector<float> hizMin[HIZ_LEVELS];	//!< Nearest depth in each block
+	std::vector<float> hizMax[HIZ_LEVELS];	//!< Farthest depth in each block
+	std::vector<GLubyte> hizDirty[HIZ_LEVELS];	//!< Nonzero ==> block must be recomputed
+	void resetHiZ();
+	void refreshHiZ(int level, int bx, int by);
+	/**
+	 * @fn	void markHiZDirty(int x, int y)
+	 * @brief	Marks the blocks containing (x, y) as out of date, at every level.
+	 * @param	x	The x coordinate.
+	 * @param	y	The y coordinate.
+	 */
+	void markHiZDirty(int x, int y) {
+		for (int level = 0; level < HIZ_LEVELS; level++) {
+			const int s = HIZ_SHIFT + level;
+			hizDirty[level][(y >> s) * hizWidth[level] + (x >> s)] = 1;
+		}
+	}
+	size_t storedPixels() const { return ((size_t)tilesX * tilesY) << (2 * tileShift); }
+	void allocateBuffers();
+	void allocateColorBuffer();
+	void convertSpan(const color *src, GLubyte *dest, int count) const;
 };
@@ -0,0 +1,160 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include "FrameWriter.h"
+
+/**
+ * @fn	AsyncFrameWriter::AsyncFrameWriter(int numSlots)
+ * @brief	Constructor. Starts the writer thread.
+ * @param	numSlots	Number of frames that may be buffered; 2 or 3.
+ */
+
+AsyncFrameWriter::AsyncFrameWriter(int numSlots)
+	: slots(glm::clamp(numSlots, MIN_FRAME_SLOTS, MAX_FRAME_SLOTS)),
+	  framesInFlight(0), framesWritten(0), done(false) {
+	for (unsigned int i = 0; i < slots.size(); i++) {
+		freeSlots.push_back(i);
+	}
+	writer = std::thread(&AsyncFrameWriter::writerLoop, this);
+}
+
+/**
+ * @fn	AsyncFrameWriter::~AsyncFrameWriter()
+ * @brief	Destructor. Writes any frames still queued, then stops the writer thread.
+ */
+
+AsyncFrameWriter::~AsyncFrameWriter() {
+	flush();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		done = true;
+	}
+	slotQueued.notify_one();
+	writer.join();
+}
+
+/**
+ * @fn	void AsyncFrameWriter::submit(const FrameBuffer &frameBuffer, const std::string &filename)
+ * @brief	Copies the framebuffer's colors into a free slot and queues them for
+ * 			writing. Blocks while every slot is waiting to be written.
+ * @param	frameBuffer	The completed frame.
+ * @param	filename   	The PPM file to write.
+ */
+
+void AsyncFrameWriter::submit(const FrameBuffer &frameBuffer, const std::string &filename) {
+	int slotIndex;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		slotFreed.wait(lock, [this] { return !freeSlots.empty(); });
+		slotIndex = freeSlots.front();
+		freeSlots.pop_front();
+	}
+
+	// The slot is owned by this thread until it is queued.
+	FrameSlot &slot = slots[slotIndex];
+	slot.width = frameBuffer.getWindowWidth();
+	slot.height = frameBuffer.getWindowHeight();
+	slot.bytesPerPixel = frameBuffer.getBytesPerPixel();
+	slot.filename = filename;
+	slot.pixels.resize((size_t)slot.width * slot.height * slot.bytesPerPixel);
+	frameBuffer.copyColorToLinear(slot.pixels.data());
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingSlots.push_back(slotIndex);
+		framesInFlight++;
+	}
+	slotQueued.notify_one();
+}
+
+/**
+ * @fn	void AsyncFrameWriter::flush()
+ * @brief	Blocks until every submitted frame has been written.
+ */
+
+void AsyncFrameWriter::flush() {
+	std::unique_lock<std::mutex> lock(mutex);
+	slotFreed.wait(lock, [this] { return framesInFlight == 0; });
+}
+
+/**
+ * @fn	int AsyncFrameWriter::getFramesWritten() const
+ * @brief	Gets the number of frames written so far.
+ * @return	The number of frames written.
+ */
+
+int AsyncFrameWriter::getFramesWritten() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return framesWritten;
+}
+
+/**
+ * @fn	void AsyncFrameWriter::writerLoop()
+ * @brief	Body of the writer thread. Writes queued frames in submission order.
+ */
+
+void AsyncFrameWriter::writerLoop() {
+	while (true) {
+		int slotIndex;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			slotQueued.wait(lock, [this] { return done || !pendingSlots.empty(); });
+			if (pendingSlots.empty()) {
+				return;
+			}
+			slotIndex = pendingSlots.front();
+			pendingSlots.pop_front();
+		}
+
+		const FrameSlot &slot = slots[slotIndex];
+		writePPM(slot.filename, slot.pixels.data(), slot.width, slot.height, slot.bytesPerPixel);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			freeSlots.push_back(slotIndex);
+			framesInFlight--;
+			framesWritten++;
+		}
+		slotFreed.notify_all();
+	}
+}
+
+/**
+ * @fn	bool AsyncFrameWriter::writePPM(const std::string &filename, const GLubyte *pixels, int width, int height, int bytesPerPixel)
+ * @brief	Writes row-major pixels, bottom row first, as a binary (P6) PPM file.
+ * @param	filename	 	Filename of the file.
+ * @param	pixels		 	The pixels.
+ * @param	width		 	The width.
+ * @param	height		 	The height.
+ * @param	bytesPerPixel	3 for RGB8, 4 for RGBA8. Alpha is dropped.
+ * @return	True iff the file was written.
+ */
+
+bool AsyncFrameWriter::writePPM(const std::string &filename, const GLubyte *pixels,
+								int width, int height, int bytesPerPixel) {
+	FILE *file = std::fopen(filename.c_str(), "wb");
+	if (file == nullptr) {
+		std::cerr << "Unable to write frame: " << filename << std::endl;
+		return false;
+	}
+	std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+	std::vector<GLubyte> row((size_t)width * BYTES_PER_PIXEL);
+	bool ok = true;
+	for (int y = height - 1; y >= 0 && ok; y--) {
+		const GLubyte *src = pixels + (size_t)y * width * bytesPerPixel;
+		if (bytesPerPixel == BYTES_PER_PIXEL) {
+			ok = std::fwrite(src, 1, row.size(), file) == row.size();
+		} else {
+			for (int x = 0; x < width; x++) {
+				std::memcpy(&row[x * BYTES_PER_PIXEL], src + x * bytesPerPixel, BYTES_PER_PIXEL);
+			}
+			ok = std::fwrite(row.data(), 1, row.size(), file) == row.size();
+		}
+	}
+	std::fclose(file);
+	if (!ok) {
+		std::cerr << "Problem writing frame: " << filename << std::endl;
+	}
+	return ok;
+}
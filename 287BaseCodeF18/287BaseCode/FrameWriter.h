@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "FrameBuffer.h"
+
+const int MIN_FRAME_SLOTS = 2;		//!< Double buffered.
+const int MAX_FRAME_SLOTS = 3;		//!< Triple buffered.
+
+/**
+ * @struct	FrameSlot
+ * @brief	One completed frame waiting to be written. The pixel storage is
+ * 			reused from frame to frame.
+ */
+
+struct FrameSlot {
+	std::vector<GLubyte> pixels;	//!< Row-major pixels, bottom row first
+	int width, height;				//!< Dimensions of the frame
+	int bytesPerPixel;				//!< 3 for RGB8, 4 for RGBA8
+	std::string filename;			//!< Where the frame is written
+	FrameSlot() : width(0), height(0), bytesPerPixel(BYTES_PER_PIXEL) {}
+};
+
+/**
+ * @struct	AsyncFrameWriter
+ * @brief	Writes completed frames to disk on a background thread, so that
+ * 			rendering frame N+1 overlaps writing frame N. Frames are copied
+ * 			into a fixed number of slots. When every slot is in use, submit
+ * 			blocks until the writer frees one, which bounds the memory used.
+ */
+
+struct AsyncFrameWriter {
+	AsyncFrameWriter(int numSlots = MIN_FRAME_SLOTS);
+	~AsyncFrameWriter();
+	void submit(const FrameBuffer &frameBuffer, const std::string &filename);
+	void flush();
+	int getFramesWritten() const;
+	static bool writePPM(const std::string &filename, const GLubyte *pixels,
+							int width, int height, int bytesPerPixel);
+protected:
+	void writerLoop();
+	std::vector<FrameSlot> slots;		//!< Frame storage
+	std::deque<int> freeSlots;			//!< Slots available to submit
+	std::deque<int> pendingSlots;		//!< Slots waiting to be written, in order
+	int framesInFlight;					//!< Submitted frames not yet written
+	int framesWritten;					//!< Number of frames written so far
+	bool done;							//!< True ==> writer thread should exit
+	mutable std::mutex mutex;
+	std::condition_variable slotFreed;	//!< Signalled when the writer finishes a frame
+	std::condition_variable slotQueued;	//!< Signalled when a frame is submitted
+	std::thread writer;
+};
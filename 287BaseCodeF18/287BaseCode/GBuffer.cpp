@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cstring>
+#include "GBuffer.h"
+#include "MaterialLibrary.h"
+
+/**
+ * @fn	GBuffer::GBuffer(int width, int height)
+ * @brief	Constructs a cleared G-buffer.
+ * @param	width 	The width.
+ * @param	height	The height.
+ */
+
+GBuffer::GBuffer(int width, int height) : width(0), height(0) {
+	setSize(width, height);
+}
+
+/**
+ * @fn	void GBuffer::setSize(int W, int H)
+ * @brief	Resizes the buffer, which also clears it.
+ * @param	W	The width.
+ * @param	H	The height.
+ */
+
+void GBuffer::setSize(int W, int H) {
+	width = W;
+	height = H;
+	const size_t N = (size_t)W * H;
+	normalX.assign(N, 0.0f);
+	normalY.assign(N, 0.0f);
+	normalZ.assign(N, 0.0f);
+	posX.assign(N, 0.0f);
+	posY.assign(N, 0.0f);
+	posZ.assign(N, 0.0f);
+	materialIds.assign(N, NO_MATERIAL);
+}
+
+/**
+ * @fn	void GBuffer::clear()
+ * @brief	Marks every pixel as empty. Call along with clearing the framebuffer's
+ * 			depth buffer. The material table is kept.
+ */
+
+void GBuffer::clear() {
+	std::fill(materialIds.begin(), materialIds.end(), NO_MATERIAL);
+}
+
+/**
+ * @fn	int GBuffer::findOrAddMaterial(const Material &material)
+ * @brief	Gets the id of a material, adding it to the table if it is new. The
+ * 			table is indexed by hash, so the cost does not grow with its size.
+ * 			Safe to call from several threads.
+ * @param	material	The material.
+ * @return	The material's id.
+ */
+
+int GBuffer::findOrAddMaterial(const Material &material) {
+	const uint32_t h = MaterialLibrary::hash(material);
+	std::lock_guard<std::mutex> lock(materialMutex);
+	auto range = materialIndex.equal_range(h);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (std::memcmp(&materials[it->second], &material, sizeof(Material)) == 0) {
+			return it->second;
+		}
+	}
+	materials.push_back(material);
+	materialIndex.insert(std::make_pair(h, (int)materials.size() - 1));
+	return (int)materials.size() - 1;
+}
+
+/**
+ * @fn	void GBuffer::clearMaterials()
+ * @brief	Empties the material table. Ids handed out earlier become invalid.
+ */
+
+void GBuffer::clearMaterials() {
+	std::lock_guard<std::mutex> lock(materialMutex);
+	materials.clear();
+	materialIndex.clear();
+}
+
+/**
+ * @fn	void GBuffer::write(int x, int y, const glm::vec3 &normal, const glm::vec3 &position, int materialId)
+ * @brief	Stores the surface seen at a pixel. Pixels outside the buffer are ignored.
+ * @param	x		  	The x coordinate.
+ * @param	y		  	The y coordinate.
+ * @param	normal	  	The world normal.
+ * @param	position  	The world position.
+ * @param	materialId	The material id.
+ */
+
+void GBuffer::write(int x, int y, const glm::vec3 &normal, const glm::vec3 &position, int materialId) {
+	if (x < 0 || x >= width || y < 0 || y >= height) {
+		return;
+	}
+	const size_t i = pixelIndex(x, y);
+	normalX[i] = normal.x;
+	normalY[i] = normal.y;
+	normalZ[i] = normal.z;
+	posX[i] = position.x;
+	posY[i] = position.y;
+	posZ[i] = position.z;
+	materialIds[i] = materialId;
+}
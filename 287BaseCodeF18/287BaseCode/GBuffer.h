@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <unordered_map>
+#include "defs.h"
+#include "ColorAndMaterials.h"
+
+const int NO_MATERIAL = -1;		//!< Material id of a pixel no fragment has reached.
+
+/**
+ * @struct	GBuffer
+ * @brief	Geometry buffer used by deferred shading. For each pixel it holds
+ * 			the world normal, world position and material id of the nearest
+ * 			fragment, one component per row-major array so the lighting pass
+ * 			can load several pixels at once. Depth is kept in the framebuffer's
+ * 			depth buffer, which decides which fragment is nearest. Materials
+ * 			are stored once in a table and referred to by id; the rasterizer
+ * 			looks the ids up once per draw, not per triangle.
+ */
+
+struct GBuffer {
+	GBuffer(int width = 0, int height = 0);
+	void setSize(int width, int height);
+	void clear();
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int findOrAddMaterial(const Material &material);
+	const std::vector<Material> &getMaterials() const { return materials; }
+	void clearMaterials();
+	void write(int x, int y, const glm::vec3 &normal, const glm::vec3 &position, int materialId);
+	size_t pixelIndex(int x, int y) const { return (size_t)y * width + x; }
+	std::vector<float> normalX, normalY, normalZ;	//!< World normal of each pixel
+	std::vector<float> posX, posY, posZ;			//!< World position of each pixel
+	std::vector<int> materialIds;					//!< Material id of each pixel, or NO_MATERIAL
+protected:
+	int width, height;								//!< Dimensions of the buffer
+	std::vector<Material> materials;				//!< The material table
+	std::unordered_multimap<uint32_t, int> materialIndex;	//!< Ids of the materials, by hash
+	std::mutex materialMutex;						//!< Guards the material table
+};
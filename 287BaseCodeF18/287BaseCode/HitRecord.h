@@ -3,6 +3,7 @@
 #include <vector>
 #include "defs.h"
 #include "ColorAndMaterials.h"
+#include "MaterialLibrary.h"
 #include "Image.h"
 #include "Utilities.h"
 
@@ -15,7 +16,7 @@ struct HitRecord {
 	float t;					//!< the t value where the intersection took place.
 	glm::vec3 interceptPoint;	//!< the (x,y,z) value where the intersection took place.
 	glm::vec3 surfaceNormal;	//!< the normal vector at the intersection point.
-	Material material;			//!< the Material value of the object.
+	MaterialId materialId;		//!< the object's material, in the shared MaterialLibrary.
 	Image *texture;				//!< the texture associated with this object, if any.
 	float u, v;					//!< (u,v) correpsonding to intersection point.
 
@@ -26,9 +27,20 @@ struct HitRecord {
 
 	HitRecord() {
 		t = FLT_MAX;
+		materialId = DEFAULT_MATERIAL_ID;
 		texture = nullptr; 
 	}
 
+	/**
+	 * @fn	const Material &getMaterial() const
+	 * @brief	Gets the material of the object that was hit.
+	 * @return	The material.
+	 */
+
+	const Material &getMaterial() const {
+		return MaterialLibrary::getShared()[materialId];
+	}
+
 	/**
 	 * @fn	static HitRecord getClosest(const std::vector<HitRecord> &hits)
 	 * @brief	Gets a closest, give a vector of hits.
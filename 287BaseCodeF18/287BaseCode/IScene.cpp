@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "IScene.h"
 
 /**
@@ -7,7 +8,7 @@
  * @param 		  	showAxis 	True to show, false to hide the xyz axes on the render.
  */
 
-IScene::IScene(RaytracingCamera *theCamera, bool showAxis) {
+IScene::IScene(RaytracingCamera *theCamera, bool showAxis) : rebuildReady(false) {
 	camera = theCamera;
 
 	const float L = 20.0f;
@@ -15,23 +16,136 @@ IScene::IScene(RaytracingCamera *theCamera, bool showAxis) {
 	const float W = 0.1f;
 	const float R = W/2;
 	if (showAxis) {
-//		IShapePtr xaxis = new ICylinderX(glm::vec3(L2, 0, 0), R, L);
-		IShapePtr yaxis = new ICylinderY(glm::vec3(0, L2, 0), R, L);
-//		IShapePtr zaxis = new ICylinderZ(glm::vec3(0, 0, L2), R, L);
-//		visibleObjects.push_back(new VisibleIShape(xaxis, red));
-		visibleObjects.push_back(new VisibleIShape(yaxis, green));
-//		visibleObjects.push_back(new VisibleIShape(zaxis, blue));
+//		IShapePtr xaxis = create<ICylinderX>(glm::vec3(L2, 0, 0), R, L);
+		IShapePtr yaxis = create<ICylinderY>(glm::vec3(0, L2, 0), R, L);
+//		IShapePtr zaxis = create<ICylinderZ>(glm::vec3(0, 0, L2), R, L);
+//		visibleObjects.push_back(create<VisibleIShape>(xaxis, red));
+		visibleObjects.push_back(create<VisibleIShape>(yaxis, green));
+//		visibleObjects.push_back(create<VisibleIShape>(zaxis, blue));
 	}
 }
 
 /**
  * @fn	void IScene::addObject(const VisibleIShapePtr &obj)
- * @brief	Adds an visible object to the scene
+ * @brief	Adds an visible object to the scene. Any hierarchy built over the
+ * 			objects so far is discarded.
  * @param	obj	The object to be added.
  */
 
 void IScene::addObject(const VisibleIShapePtr &obj) {
 	visibleObjects.push_back(obj);
+	bvh.clear();
+}
+
+/**
+ * @fn	IScene::~IScene()
+ * @brief	Destructor. Waits for any background rebuild.
+ */
+
+IScene::~IScene() {
+	cancelRebuild();
+}
+
+/**
+ * @fn	void IScene::addDynamicObject(const VisibleIShapePtr &obj)
+ * @brief	Adds a visible object that may move. Moving objects are kept in their
+ * 			own hierarchy, which is refit rather than rebuilt, so the static
+ * 			hierarchy survives animation. Call markMoved after moving one.
+ * @param	obj	The object to be added.
+ */
+
+void IScene::addDynamicObject(const VisibleIShapePtr &obj) {
+	cancelRebuild();
+	dynamicObjects.push_back(obj);
+	dynamicMoved.push_back(false);
+	dynamicBvh.clear();
+}
+
+/**
+ * @fn	bool IScene::makeDynamic(const VisibleIShapePtr &obj)
+ * @brief	Moves a visible object from the static objects to the dynamic ones, so
+ * 			it can be animated. The static hierarchy must then be rebuilt.
+ * @param	obj	The object, added earlier with addObject.
+ * @return	True iff the object was found among the static objects.
+ */
+
+bool IScene::makeDynamic(const VisibleIShapePtr &obj) {
+	std::vector<VisibleIShapePtr>::iterator it = std::find(visibleObjects.begin(), visibleObjects.end(), obj);
+	if (it == visibleObjects.end()) {
+		return false;
+	}
+	visibleObjects.erase(it);
+	bvh.clear();
+	addDynamicObject(obj);
+	return true;
+}
+
+/**
+ * @fn	void IScene::markMoved(const VisibleIShapePtr &obj)
+ * @brief	Flags a dynamic object whose shape has changed, so the next
+ * 			updateDynamicObjects refits its part of the hierarchy.
+ * @param	obj	The object, which must have been added with addDynamicObject.
+ */
+
+void IScene::markMoved(const VisibleIShapePtr &obj) {
+	for (unsigned int i = 0; i < dynamicObjects.size(); i++) {
+		if (dynamicObjects[i] == obj) {
+			dynamicMoved[i] = true;
+			return;
+		}
+	}
+}
+
+/**
+ * @fn	void IScene::updateDynamicObjects()
+ * @brief	Brings the dynamic hierarchy up to date; call once per frame, after
+ * 			moving objects and before rendering. Moved objects are refit bottom
+ * 			up. Once refitting has degraded the tree too far, a new one is built
+ * 			on a background thread from a snapshot of the boxes, and swapped in
+ * 			(and refit to where the objects are by then) on a later frame.
+ */
+
+void IScene::updateDynamicObjects() {
+	if (dynamicObjects.empty()) {
+		return;
+	}
+	if (rebuildThread.joinable() && rebuildReady) {
+		rebuildThread.join();
+		std::swap(dynamicBvh, rebuiltBvh);
+		rebuiltBvh.clear();
+		// The new tree's boxes are from the snapshot; anything may have moved since.
+		std::fill(dynamicMoved.begin(), dynamicMoved.end(), true);
+	}
+	if (!dynamicBvh.isBuiltFor(dynamicObjects)) {
+		dynamicBvh.build(dynamicObjects);
+	} else {
+		dynamicBvh.refit(dynamicObjects, dynamicMoved);
+	}
+	std::fill(dynamicMoved.begin(), dynamicMoved.end(), false);
+
+	if (!rebuildThread.joinable() && dynamicBvh.needsRebuild()) {
+		std::vector<glm::vec3> lo, hi;
+		std::vector<bool> bounded;
+		BVH::gatherBounds(dynamicObjects, lo, hi, bounded);
+		rebuildReady = false;
+		rebuildThread = std::thread([this, lo = std::move(lo), hi = std::move(hi), bounded = std::move(bounded)]() {
+			rebuiltBvh.build(lo, hi, bounded);
+			rebuildReady = true;
+		});
+	}
+}
+
+/**
+ * @fn	void IScene::cancelRebuild()
+ * @brief	Waits for any background rebuild and throws its result away.
+ */
+
+void IScene::cancelRebuild() {
+	if (rebuildThread.joinable()) {
+		rebuildThread.join();
+	}
+	rebuiltBvh.clear();
+	rebuildReady = false;
 }
 
 /**
@@ -42,7 +156,9 @@ void IScene::addObject(const VisibleIShapePtr &obj) {
  */
 
 void IScene::addTransparentObject(const VisibleIShapePtr &obj, float alpha) {
-	obj->material.alpha = alpha;
+	Material mat = obj->getMaterial();
+	mat.alpha = alpha;
+	obj->materialId = MaterialLibrary::getShared().findOrAdd(mat);
 	transparentObjects.push_back(obj);
 }
 
@@ -65,3 +181,61 @@ void IScene::addObject(const PositionalLightPtr &light) {
 void IScene::changeCamera(RaytracingCamera *cam) {
 	camera = cam;
 }
+
+/**
+ * @fn	void IScene::clear()
+ * @brief	Empties the scene and frees every object it owns, i.e., everything
+ * 			made with create(). If the camera was one of the scene's cameras, the
+ * 			scene is left without one.
+ */
+
+void IScene::clear() {
+	cancelRebuild();
+	if (std::find(cameras.begin(), cameras.end(), camera) != cameras.end()) {
+		camera = nullptr;
+	}
+	lights.clear();
+	visibleObjects.clear();
+	transparentObjects.clear();
+	dynamicObjects.clear();
+	dynamicMoved.clear();
+	cameras.clear();
+	bvh.clear();
+	dynamicBvh.clear();
+	arena.release();
+}
+
+/**
+ * @fn	void IScene::buildAccelerationStructure()
+ * @brief	Builds the hierarchies over the static and dynamic objects. Call after
+ * 			the last object is added; until then, findIntersection tests every
+ * 			object.
+ */
+
+void IScene::buildAccelerationStructure() {
+	bvh.build(visibleObjects);
+	cancelRebuild();
+	dynamicBvh.build(dynamicObjects);
+	std::fill(dynamicMoved.begin(), dynamicMoved.end(), false);
+}
+
+/**
+ * @fn	HitRecord IScene::findIntersection(const Ray &ray) const
+ * @brief	Searches for the first intersection with the static and dynamic
+ * 			visible objects, using each one's hierarchy if it is built.
+ * @param	ray	The ray.
+ * @return	The closest intersection that is in front of the camera.
+ */
+
+HitRecord IScene::findIntersection(const Ray &ray) const {
+	HitRecord theHit = bvh.isBuiltFor(visibleObjects) ? bvh.findIntersection(ray, visibleObjects)
+														: VisibleIShape::findIntersection(ray, visibleObjects);
+	if (!dynamicObjects.empty()) {
+		HitRecord dynamicHit = dynamicBvh.isBuiltFor(dynamicObjects) ? dynamicBvh.findIntersection(ray, dynamicObjects)
+																	: VisibleIShape::findIntersection(ray, dynamicObjects);
+		if (dynamicHit.t < theHit.t) {
+			theHit = dynamicHit;
+		}
+	}
+	return theHit;
+}
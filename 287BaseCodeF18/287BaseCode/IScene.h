@@ -1,12 +1,16 @@
 #pragma once
 #include <vector>
 #include <map>
+#include <thread>
+#include <atomic>
 #include "Defs.h"
 #include "Light.h"
 #include "Camera.h"
 #include "Light.h"
 #include "EShape.h"
 #include "IShape.h"
+#include "BVH.h"
+#include "SceneArena.h"
 
 /**
  * @struct	IScene
@@ -18,9 +22,29 @@ struct IScene {
 	std::vector<VisibleIShapePtr> visibleObjects;		//!< All the visible objects in the scene
 	std::vector<VisibleIShapePtr> transparentObjects;	//!< All the transparent objects in the scene
 	RaytracingCamera *camera;							//!< The one camera in the scene
+	std::vector<RaytracingCamera *> cameras;			//!< All cameras that came with the scene, e.g., from a scene file
+	BVH bvh;											//!< Hierarchy over visibleObjects, once built
+	std::vector<VisibleIShapePtr> dynamicObjects;		//!< Visible objects that may move between frames
+	std::vector<bool> dynamicMoved;						//!< Whether each dynamic object moved since the last update
+	BVH dynamicBvh;										//!< Hierarchy over dynamicObjects, refit every frame
+	SceneArena arena;									//!< Owns the objects created with create()
 	IScene(RaytracingCamera *theCamera, bool withAxis = false);
+	~IScene();
 	void addObject(const VisibleIShapePtr &obj);
+	void addDynamicObject(const VisibleIShapePtr &obj);
+	bool makeDynamic(const VisibleIShapePtr &obj);
+	void markMoved(const VisibleIShapePtr &obj);
+	void updateDynamicObjects();
 	void addTransparentObject(const VisibleIShapePtr &obj, float alpha);
 	void addObject(const PositionalLightPtr &light);
 	void changeCamera(RaytracingCamera *cam);
+	void clear();
+	template <class T, class... Args> T *create(Args&&... args) { return arena.create<T>(std::forward<Args>(args)...); }
+	void buildAccelerationStructure();
+	HitRecord findIntersection(const Ray &ray) const;
+protected:
+	void cancelRebuild();
+	std::thread rebuildThread;							//!< Builds rebuiltBvh in the background
+	std::atomic<bool> rebuildReady;						//!< True ==> rebuiltBvh is done
+	BVH rebuiltBvh;										//!< Replacement for dynamicBvh, while it is built
 };
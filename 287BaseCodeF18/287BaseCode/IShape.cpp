@@ -1,5 +1,6 @@
 #include <vector>
 #include "IShape.h"
+#include "RenderStats.h"
 
 /**
  * @fn	IShape::IShape()
@@ -22,6 +23,29 @@ void IShape::getTexCoords(const glm::vec3 &pt, float &u, float &v) const {
 	u = v = 0;
 }
 
+/**
+ * @fn	bool IShape::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the shape. The default is that the
+ * 			shape is unbounded (e.g., a plane), so no box is produced.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True iff the shape is bounded and lo/hi were set.
+ */
+
+bool IShape::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	return false;
+}
+
+/**
+ * @fn	void IShape::translate(const glm::vec3 &offset)
+ * @brief	Moves the shape. By default a shape stays where it is; the concrete
+ * 			shapes override this.
+ * @param	offset	How far to move it.
+ */
+
+void IShape::translate(const glm::vec3 &offset) {
+}
+
 /**
  * @fn	glm::vec3 IShape::movePointOffSurface(const glm::vec3 &pt, const glm::vec3 &n)
  * @brief	Compute point that is slightly off surface.
@@ -42,10 +66,22 @@ glm::vec3 IShape::movePointOffSurface(const glm::vec3 &pt, const glm::vec3 &n) {
  */
 
 VisibleIShape::VisibleIShape(IShapePtr shapePtr, const Material &mat)
-	: material(mat), shape(shapePtr) {
+	: VisibleIShape(shapePtr, MaterialLibrary::getShared().findOrAdd(mat)) {
+}
+
+/**
+ * @fn	VisibleIShape::VisibleIShape(IShapePtr shapePtr, MaterialId matId)
+ * @brief	Represents an visible, implicit shape.
+ * @param	shapePtr	Pointer to the implicit shape.
+ * @param	matId		Id of the material, in the shared MaterialLibrary.
+ */
+
+VisibleIShape::VisibleIShape(IShapePtr shapePtr, MaterialId matId)
+	: materialId(matId), shape(shapePtr) {
 	texture = nullptr;
 	lu = lv = 0.0f;
 	ru = rv = 1.0f;
+	shapeType = shapePtr != nullptr ? RenderCounters::getShapeType(*shapePtr) : 0;
 }
 
 /**
@@ -58,7 +94,14 @@ VisibleIShape::VisibleIShape(IShapePtr shapePtr, const Material &mat)
 void VisibleIShape::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	shape->findClosestIntersection(ray, hit);
 	if (hit.t < FLT_MAX) {
-		hit.material = material;
+		hit.materialId = materialId;
+	}
+	RenderCounters *counters = RenderCounters::current;
+	if (counters != nullptr) {
+		counters->shapeTests[shapeType]++;
+		if (hit.t < FLT_MAX && hit.t > 0) {
+			counters->shapeHits[shapeType]++;
+		}
 	}
 }
 
@@ -107,7 +150,7 @@ HitRecord VisibleIShape::findIntersection(const Ray &ray, const std::vector<Visi
 		surfaces[i]->findClosestIntersection(ray, thisHit);
 		if (thisHit.t < theHit.t && thisHit.t > 0) {
 			theHit = thisHit;
-			theHit.material = surfaces[i]->material;
+			theHit.materialId = surfaces[i]->materialId;
 
 			//In ExerciseTexture 
 			theHit.texture = surfaces[i]->texture;
@@ -146,6 +189,33 @@ void IDisk::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	}
 }
 
+/**
+ * @fn	bool IDisk::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the disk. Along each axis, the disk
+ * 			extends radius * sqrt(1 - n[i]^2) from its center.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True.
+ */
+
+bool IDisk::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	const glm::vec3 unitN = glm::normalize(n);
+	const glm::vec3 extent = radius * glm::sqrt(glm::max(glm::vec3(1.0f) - unitN * unitN, glm::vec3(0.0f)));
+	lo = center - extent;
+	hi = center + extent;
+	return true;
+}
+
+/**
+ * @fn	void IDisk::translate(const glm::vec3 &offset)
+ * @brief	Moves the disk.
+ * @param	offset	How far to move it.
+ */
+
+void IDisk::translate(const glm::vec3 &offset) {
+	center += offset;
+}
+
 /**
  * @fn	ISphere::ISphere(const glm::vec3 & position, float radius)
  * @brief	Implicit representation of a 3D sphere.
@@ -169,6 +239,21 @@ void ISphere::getTexCoords(const glm::vec3 &pt, float &u, float &v) const {
 	u = v = 0.0f;
 }
 
+/**
+ * @fn	bool ISphere::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the sphere. J is -R^2.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True.
+ */
+
+bool ISphere::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	const glm::vec3 extent(std::sqrt(-qParams.J));
+	lo = center - extent;
+	hi = center + extent;
+	return true;
+}
+
 /**
  * @fn	void ISphere::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const
  * @see textbook.
@@ -267,6 +352,37 @@ void IBox::findClosestIntersection(const Ray &ray, HitRecord &theHit) const {
 	}
 }
 
+/**
+ * @fn	bool IBox::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the box's sides.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True.
+ */
+
+bool IBox::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	rects[0].getBounds(lo, hi);
+	for (unsigned int i = 1; i < rects.size(); i++) {
+		glm::vec3 rectLo, rectHi;
+		rects[i].getBounds(rectLo, rectHi);
+		lo = glm::min(lo, rectLo);
+		hi = glm::max(hi, rectHi);
+	}
+	return true;
+}
+
+/**
+ * @fn	void IBox::translate(const glm::vec3 &offset)
+ * @brief	Moves the box, i.e., each of its sides.
+ * @param	offset	How far to move it.
+ */
+
+void IBox::translate(const glm::vec3 &offset) {
+	for (unsigned int i = 0; i < rects.size(); i++) {
+		rects[i].translate(offset);
+	}
+}
+
 /**
  * @fn	QuadricParameters::QuadricParameters() : QuadricParameters(std::vector<float> {1, 1, 1, 0, 0, 0, 0, 0, 0, -1})
  * @brief	Default constructor
@@ -407,6 +523,16 @@ void IPlane::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	}
 }
 
+/**
+ * @fn	void IPlane::translate(const glm::vec3 &offset)
+ * @brief	Moves the plane.
+ * @param	offset	How far to move it.
+ */
+
+void IPlane::translate(const glm::vec3 &offset) {
+	a += offset;
+}
+
 /**
  * @fn	IPlane::IPlane(const glm::vec3 &point, const glm::vec3 &normal)
  * @brief	Constructor
@@ -511,6 +637,43 @@ void IRect::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	}
 }
 
+/**
+ * @fn	bool IRect::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the rectangle. Only rectangles
+ * 			facing along an axis are limited by findClosestIntersection; any other
+ * 			one behaves as its infinite plane.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True iff the rectangle faces along an axis.
+ */
+
+bool IRect::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	glm::vec3 extent;
+	if (std::abs(n[0]) == 1) {	// yz plane
+		extent = glm::vec3(0, W2, H2);
+	} else if (std::abs(n[1]) == 1) {	// xz plane
+		extent = glm::vec3(W2, 0, H2);
+	} else if (std::abs(n[2]) == 1) {	// xy plane
+		extent = glm::vec3(W2, H2, 0);
+	} else {
+		return false;
+	}
+	lo = center - extent;
+	hi = center + extent;
+	return true;
+}
+
+/**
+ * @fn	void IRect::translate(const glm::vec3 &offset)
+ * @brief	Moves the rectangle.
+ * @param	offset	How far to move it.
+ */
+
+void IRect::translate(const glm::vec3 &offset) {
+	center += offset;
+	plane.translate(offset);
+}
+
 /**
  * @fn	IConvexPolygon::IConvexPolygon(const std::vector<glm::vec3> &vertices)
  * @brief	Constructs a convex polygon, given the vector of vertices.
@@ -537,6 +700,36 @@ void IConvexPolygon::findClosestIntersection(const Ray &ray, HitRecord &hit) con
 	}
 }
 
+/**
+ * @fn	bool IConvexPolygon::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the polygon's vertices.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True.
+ */
+
+bool IConvexPolygon::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	lo = hi = v[0];
+	for (unsigned int i = 1; i < v.size(); i++) {
+		lo = glm::min(lo, v[i]);
+		hi = glm::max(hi, v[i]);
+	}
+	return true;
+}
+
+/**
+ * @fn	void IConvexPolygon::translate(const glm::vec3 &offset)
+ * @brief	Moves the polygon.
+ * @param	offset	How far to move it.
+ */
+
+void IConvexPolygon::translate(const glm::vec3 &offset) {
+	IPlane::translate(offset);
+	for (unsigned int i = 0; i < v.size(); i++) {
+		v[i] += offset;
+	}
+}
+
 /**
  * @fn	bool IConvexPolygon::isInside(const glm::vec3 &point) const
  * @brief	Query if 'point' is inside
@@ -686,7 +879,7 @@ int IQuadricSurface::findIntersections(const Ray &ray, HitRecord hits[2]) const
  */
 
 void IQuadricSurface::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
-	static HitRecord hits[2];
+	HitRecord hits[2];
 	hit.t = FLT_MAX;
 
 	int numIntercepts = findIntersections(ray, hits);
@@ -707,6 +900,17 @@ void IQuadricSurface::findClosestIntersection(const Ray &ray, HitRecord &hit) co
 	}
 }
 
+/**
+ * @fn	void IQuadricSurface::translate(const glm::vec3 &offset)
+ * @brief	Moves the quadric. Its parameters are relative to its center, so only
+ * 			the center changes.
+ * @param	offset	How far to move it.
+ */
+
+void IQuadricSurface::translate(const glm::vec3 &offset) {
+	center += offset;
+}
+
 /**
  * @fn	glm::vec3 IQuadricSurface::normal(const glm::vec3 &P) const
  * @brief	Normals the given p
@@ -740,7 +944,7 @@ IConeY::IConeY(const glm::vec3 &pos, float rad, float height, const QuadricParam
 void IConeY::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	const glm::vec3 &rayOrigin = ray.origin;
 	const glm::vec3 &rayDirection = ray.direction;
-	static HitRecord hits[2];
+	HitRecord hits[2];
 	int numHits = IConeY::findIntersections(ray, hits);
 	for (int i = 0; i < numHits; i++) {
 		if (hits[i].interceptPoint.y < center.y + height / 2 &&
@@ -765,7 +969,7 @@ IConeY::IConeY(const glm::vec3 &pos, float rad, float len)
 void IConeY::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	const glm::vec3 &rayOrigin = ray.origin;
 	const glm::vec3 &rayDirection = ray.direction;
-	static HitRecord hits[2];
+	HitRecord hits[2];
 	int numHits = ICone::findIntersections(ray, hits);
 	for (int i = 0; i < numHits; i++) {
 		// float currentRadius = ((length / 2) - hits[i].interceptPoint.y) * (radius / length);
@@ -780,6 +984,23 @@ void IConeY::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	hit.t = FLT_MAX;
 }
 
+/**
+ * @fn	bool IConeY::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the cone. Its radius grows by radius
+ * 			per unit of y away from the center, out to length / 2.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True.
+ */
+
+bool IConeY::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	const float L2 = length / 2.0f;
+	const glm::vec3 extent(radius * L2, L2, radius * L2);
+	lo = center - extent;
+	hi = center + extent;
+	return true;
+}
+
 /**
  * @fn	ICylinder::ICylinder(const glm::vec3 &pos, float R, float L, const QuadricParameters &qParams)
  * @brief	Constructs an implicit representation of a cylinder.
@@ -865,7 +1086,7 @@ ICylinderY::ICylinderY(const glm::vec3 &pos, float rad, float len)
 void ICylinderY::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	const glm::vec3 &rayOrigin = ray.origin;
 	const glm::vec3 &rayDirection = ray.direction;
-	static HitRecord hits[2];
+	HitRecord hits[2];
 	int numHits = ICylinder::findIntersections(ray, hits);
 	for (int i = 0; i < numHits; i++) {
 		if (hits[i].interceptPoint.y < center.y + length / 2 &&
@@ -877,6 +1098,21 @@ void ICylinderY::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	hit.t = FLT_MAX;
 }
 
+/**
+ * @fn	bool ICylinderY::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the cylinder.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True.
+ */
+
+bool ICylinderY::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	const glm::vec3 extent(radius, length / 2.0f, radius);
+	lo = center - extent;
+	hi = center + extent;
+	return true;
+}
+
 IClosedCylinderY::IClosedCylinderY(const glm::vec3 &pos, float rad, float len) 
 	: ICylinder(pos, rad, len, QuadricParameters::cylinderYQParams(rad)) {
 	IDisk(pos + (0.0f, len / 2.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), rad);
@@ -888,7 +1124,7 @@ void IClosedCylinderY::findClosestIntersection(const Ray &ray, HitRecord &hit) c
 	const glm::vec3 &rayDirection = ray.direction;
 	IPlane p(center, glm::vec3(0.0f, 1.0f, 0.0f));
 	p.findClosestIntersection(ray, hit);
-	static HitRecord hits[2];
+	HitRecord hits[2];
 	int numHits = ICylinder::findIntersections(ray, hits);
 	for (int i = 0; i < numHits; i++) {
 		if (hits[i].interceptPoint.y < center.y + length / 2 &&
@@ -903,6 +1139,21 @@ void IClosedCylinderY::findClosestIntersection(const Ray &ray, HitRecord &hit) c
 	hit.t = FLT_MAX;
 }
 
+/**
+ * @fn	bool IClosedCylinderY::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the cylinder.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True.
+ */
+
+bool IClosedCylinderY::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	const glm::vec3 extent(radius, length / 2.0f, radius);
+	lo = center - extent;
+	hi = center + extent;
+	return true;
+}
+
 /**
 * @fn	void ICylinderY::getTexCoords(const glm::vec3 &pt, float &u, float &v) const
 * @brief	Gets tex coordinates
@@ -940,7 +1191,7 @@ ICylinderX::ICylinderX(const glm::vec3 &pos, float rad, float len)
 void ICylinderX::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	const glm::vec3 &rayOrigin = ray.origin;
 	const glm::vec3 &rayDirection = ray.direction;
-	static HitRecord hits[2];
+	HitRecord hits[2];
 	int numHits = ICylinder::findIntersections(ray, hits);
 	for (int i = 0; i < numHits; i++) {
 		if (hits[i].interceptPoint.x < center.x + length / 2 &&
@@ -952,6 +1203,21 @@ void ICylinderX::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	hit.t = FLT_MAX;
 }
 
+/**
+ * @fn	bool ICylinderX::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the cylinder.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True.
+ */
+
+bool ICylinderX::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	const glm::vec3 extent(length / 2.0f, radius, radius);
+	lo = center - extent;
+	hi = center + extent;
+	return true;
+}
+
 /**
 * @fn	void ICylinderY::getTexCoords(const glm::vec3 &pt, float &u, float &v) const
 * @brief	Gets tex coordinates
@@ -989,7 +1255,7 @@ ICylinderZ::ICylinderZ(const glm::vec3 &pos, float rad, float len)
 void ICylinderZ::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	const glm::vec3 &rayOrigin = ray.origin;
 	const glm::vec3 &rayDirection = ray.direction;
-	static HitRecord hits[2];
+	HitRecord hits[2];
 	int numHits = ICylinder::findIntersections(ray, hits);
 	for (int i = 0; i < numHits; i++) {
 		if (hits[i].interceptPoint.z < center.z + length / 2 &&
@@ -1001,6 +1267,21 @@ void ICylinderZ::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	hit.t = FLT_MAX;
 }
 
+/**
+ * @fn	bool ICylinderZ::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the cylinder.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True.
+ */
+
+bool ICylinderZ::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	const glm::vec3 extent(radius, radius, length / 2.0f);
+	lo = center - extent;
+	hi = center + extent;
+	return true;
+}
+
 /**
 * @fn	void ICylinderY::getTexCoords(const glm::vec3 &pt, float &u, float &v) const
 * @brief	Gets tex coordinates
@@ -1063,6 +1344,33 @@ void ITriangle::findClosestIntersection(const Ray &ray, HitRecord &hit) const {
 	}
 }
 
+/**
+ * @fn	bool ITriangle::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the triangle.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True.
+ */
+
+bool ITriangle::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	lo = glm::min(a, glm::min(b, c));
+	hi = glm::max(a, glm::max(b, c));
+	return true;
+}
+
+/**
+ * @fn	void ITriangle::translate(const glm::vec3 &offset)
+ * @brief	Moves the triangle.
+ * @param	offset	How far to move it.
+ */
+
+void ITriangle::translate(const glm::vec3 &offset) {
+	a += offset;
+	b += offset;
+	c += offset;
+	plane.translate(offset);
+}
+
 /**
  * @fn	IEllipsoid::IEllipsoid(const glm::vec3 &position, const glm::vec3 &sz) : IQuadricSurface(QuadricParameters::ellipoidParameters(sz), position)
  * @brief	Constructs an implicit representation of an ellipsoid.
@@ -1121,4 +1429,20 @@ void IEllipsoid::computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq)
 		//G * Ro.x +
 		//H * Ro.y +
 		I * Ro.z + J;
+}
+
+/**
+ * @fn	bool IEllipsoid::getBounds(glm::vec3 &lo, glm::vec3 &hi) const
+ * @brief	Computes an axis-aligned box enclosing the ellipsoid. A, B and C are
+ * 			1 / size^2.
+ * @param [in,out]	lo	The lower corner of the box.
+ * @param [in,out]	hi	The upper corner of the box.
+ * @return	True.
+ */
+
+bool IEllipsoid::getBounds(glm::vec3 &lo, glm::vec3 &hi) const {
+	const glm::vec3 extent(1.0f / std::sqrt(qParams.A), 1.0f / std::sqrt(qParams.B), 1.0f / std::sqrt(qParams.C));
+	lo = center - extent;
+	hi = center + extent;
+	return true;
 }
\ No newline at end of file
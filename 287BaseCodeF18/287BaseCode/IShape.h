@@ -21,6 +21,14 @@ struct Ray {
 	glm::vec3 getPoint(float t) const {
 		return origin + t * direction;
 	}
+	static Ray fromUnitDirection(const glm::vec3 &rayOrigin, const glm::vec3 &unitDirection) {
+		Ray ray;
+		ray.origin = rayOrigin;
+		ray.direction = unitDirection;
+		return ray;
+	}
+protected:
+	Ray() {}
 };
 
 /**
@@ -32,6 +40,8 @@ struct IShape {
 	IShape();
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const = 0;
 	virtual void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
+	virtual void translate(const glm::vec3 &offset);
 	static glm::vec3 movePointOffSurface(const glm::vec3 &pt, const glm::vec3 &n);
 };
 
@@ -41,14 +51,17 @@ struct IShape {
  */
 
 struct VisibleIShape {
-	Material material;	//!< Material for this shape.
+	MaterialId materialId;	//!< Material for this shape, in the shared MaterialLibrary.
 	IShapePtr shape;	//!< Pointer to underlying implicit shape.
 	Image *texture;		//!< Texture associated with this shape, if any.
 	float lu;			//!< left u value
 	float ru;			//!< right u value
 	float lv;			//!< left v value
 	float rv;			//!< right v value
+	int shapeType;		//!< Index of the shape's type, for RenderCounters
 	VisibleIShape(IShapePtr shapePtr, const Material &mat);
+	VisibleIShape(IShapePtr shapePtr, MaterialId matId);
+	const Material &getMaterial() const { return MaterialLibrary::getShared()[materialId]; }
 	void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
 	void setTexture(Image *tex, float leftU, float rightU, float bottomV, float topV);
 	void setTexture(Image *tex);
@@ -67,6 +80,7 @@ struct IPlane : public IShape {
 	IPlane(const std::vector<glm::vec3> &vertices);
 	IPlane(const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec3 &p3);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual void translate(const glm::vec3 &offset);
 	bool insidePlane(const glm::vec3 &point) const;
 	void findIntersection(const glm::vec3 &p1, const glm::vec3 &p2, float &t) const;
 };
@@ -80,6 +94,8 @@ struct IPlane : public IShape {
 struct IDisk : public IShape {
 	IDisk(const glm::vec3 &position, const glm::vec3 &n, float rad);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
+	virtual void translate(const glm::vec3 &offset);
 	glm::vec3 center;	//!< center point of disk
 	glm::vec3 n;		//!< normal vector of disk
 	float radius;
@@ -94,6 +110,8 @@ struct IDisk : public IShape {
 struct IRect : public IShape {
 	IRect(const glm::vec3 &position, const glm::vec3 &normal, float W, float H);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
+	virtual void translate(const glm::vec3 &offset);
 	float width;		//!< width of rectangle
 	float height;		//!< height of rectangle
 	glm::vec3 center;	//!< center point of rectangle
@@ -113,6 +131,8 @@ struct IBox : public IShape {
 	IBox(const glm::vec3 &center, const glm::vec3 &size);
 	IBox(const glm::vec3 &center, float size);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
+	virtual void translate(const glm::vec3 &offset);
 protected:
 	std::vector<IRect> rects;	//!< 6 rectangles corresponding to sides of box.
 };
@@ -148,6 +168,8 @@ struct IConvexPolygon : public IPlane {
 	glm::vec3 n;
 	IConvexPolygon(const std::vector<glm::vec3> &vertices);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
+	virtual void translate(const glm::vec3 &offset);
 	bool isInside(const glm::vec3 &point) const;
 };
 
@@ -163,6 +185,8 @@ struct ITriangle : public IShape {
 	IPlane plane;	//!< the plane this triangle lies on.
 	ITriangle(const glm::vec3 &A, const glm::vec3 &B, const glm::vec3 &C);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
+	virtual void translate(const glm::vec3 &offset);
 	bool inside(const glm::vec3 &pt) const;
 };
 
@@ -180,6 +204,7 @@ struct IQuadricSurface : public IShape {
 					const glm::vec3 & position);
 	IQuadricSurface(const glm::vec3 & position = glm::vec3(0, 0, 0));
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual void translate(const glm::vec3 &offset);
 	int findIntersections(const Ray &ray, HitRecord hits[2]) const;
 	glm::vec3 normal(const glm::vec3 &pt) const;
 	virtual void computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const;
@@ -198,6 +223,7 @@ protected:
 struct ISphere : IQuadricSurface {
 	ISphere(const glm::vec3 &position, float radius);
 	virtual void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
 	virtual void computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const;
 };
 
@@ -237,6 +263,7 @@ struct ICone : public IQuadricSurface {
 struct IConeY : public ICone {
 	IConeY(const glm::vec3 &position, float R, float len);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
 	// probably don't need this
 	// void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
 };
@@ -262,11 +289,13 @@ struct ICylinderY : public ICylinder {
 	ICylinderY(const glm::vec3 &position, float R, float len);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
 	void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
 };
 
 struct IClosedCylinderY : public ICylinder {
 	IClosedCylinderY(const glm::vec3 &position, float R, float len);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
 };
 
 /**
@@ -278,6 +307,7 @@ struct ICylinderX : public ICylinder {
 	ICylinderX(const glm::vec3 &position, float R, float len);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
 	void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
 };
 
 /**
@@ -289,6 +319,7 @@ struct ICylinderZ : public ICylinder {
 	ICylinderZ(const glm::vec3 &position, float R, float len);
 	virtual void findClosestIntersection(const Ray &ray, HitRecord &hit) const;
 	void getTexCoords(const glm::vec3 &pt, float &u, float &v) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
 };
 
 /**
@@ -299,4 +330,5 @@ struct ICylinderZ : public ICylinder {
 struct IEllipsoid : public IQuadricSurface {
 	IEllipsoid(const glm::vec3 &position, const glm::vec3 &sz);
 	virtual void computeAqBqCq(const Ray &ray, float &Aq, float &Bq, float &Cq) const;
+	virtual bool getBounds(glm::vec3 &lo, glm::vec3 &hi) const;
 };
\ No newline at end of file
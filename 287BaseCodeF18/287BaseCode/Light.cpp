@@ -144,6 +144,18 @@ color PositionalLight::illuminate(const glm::vec3 &interceptWorldCoords,
 	
 }
 
+/**
+ * @fn	bool PositionalLight::canReach(const glm::vec3 &point) const
+ * @brief	Determines whether this light could light a point at all. If not, its
+ * 			illuminate returns black whether or not the point is in shadow.
+ * @param	point	The point, in world coordinates.
+ * @return	True iff the light is on.
+ */
+
+bool PositionalLight::canReach(const glm::vec3 &point) const {
+	return isOn;
+}
+
 /**
  * @fn	color SpotLight::illuminate(const HitRecord &hit, const glm::vec3 &viewingDir, const Frame &eyeFrame, bool inShadow) const
  * @brief	Computes the color this light produces in raytracing applications.
@@ -172,6 +184,58 @@ color SpotLight::illuminate(const glm::vec3 &interceptWorldCoords,
 	return black;
 }
 
+/**
+ * @fn	bool SpotLight::canReach(const glm::vec3 &point) const
+ * @brief	Determines whether this light could light a point at all. If not, its
+ * 			illuminate returns black whether or not the point is in shadow.
+ * @param	point	The point, in world coordinates.
+ * @return	True iff the light is on and the point is within its cone.
+ */
+
+bool SpotLight::canReach(const glm::vec3 &point) const {
+	float cosTheta = glm::cos(fov / 2.0f);
+	float cosAlpha = cosBetween(spotDirection, (point - lightPosition));
+	return isOn && cosAlpha >= cosTheta;
+}
+
+/**
+ * @fn	void flattenLights(const std::vector<LightSourcePtr> &lights, std::vector<LightParams> &flat, std::vector<LightSourcePtr> &others)
+ * @brief	Flattens the positional and spot lights that are on into LightParams.
+ * 			Lights of any other type are returned in others, to be evaluated
+ * 			through illuminate.
+ * @param 		  	lights	The lights in the scene.
+ * @param [in,out]	flat  	Receives the flattened lights.
+ * @param [in,out]	others	Receives the lights that could not be flattened.
+ */
+
+void flattenLights(const std::vector<LightSourcePtr> &lights,
+					std::vector<LightParams> &flat, std::vector<LightSourcePtr> &others) {
+	flat.clear();
+	others.clear();
+	for (LightSourcePtr light : lights) {
+		const PositionalLight *pl = dynamic_cast<const PositionalLight *>(light);
+		if (pl == nullptr) {
+			others.push_back(light);
+			continue;
+		}
+		if (!pl->isOn) {
+			continue;
+		}
+		LightParams params;
+		params.position = pl->lightPosition;
+		params.ambient = pl->lightColorComponents.ambient;
+		params.diffuse = pl->lightColorComponents.diffuse;
+		params.specular = pl->lightColorComponents.specular;
+		params.attenuationIsTurnedOn = pl->attenuationIsTurnedOn;
+		params.attenuationParams = pl->attenuationParams;
+		const SpotLight *sl = dynamic_cast<const SpotLight *>(light);
+		params.isSpot = sl != nullptr;
+		params.spotDirection = params.isSpot ? glm::normalize(sl->spotDirection) : glm::vec3(0, 0, 0);
+		params.cosCutoff = params.isSpot ? glm::cos(sl->fov / 2.0f) : -1.0f;
+		flat.push_back(params);
+	}
+}
+
 /**
 * @fn	ostream &operator << (std::ostream &os, const LightAttenuationParameters &at)
 * @brief	Output stream for light attenuation parameters.
@@ -218,4 +282,16 @@ std::ostream &operator << (std::ostream &os, const SpotLight &sl) {
 	os << pl;
 	os << " FOV " << sl.fov << std::endl;
 	return os;
-}
\ No newline at end of file
+}
+
+/**
+ * @fn	void LightBlock::prepare(const std::vector<LightSourcePtr> &lights, const glm::mat4 &viewingMatrix)
+ * @brief	Sorts the lights and sets the camera frame. Keeps the vectors' capacity.
+ * @param	lights		 	The lights in the scene.
+ * @param	viewingMatrix	The viewing transformation matrix.
+ */
+
+void LightBlock::prepare(const std::vector<LightSourcePtr> &lights, const glm::mat4 &viewingMatrix) {
+	flattenLights(lights, flatLights, otherLights);
+	eyeFrame = Frame::createOrthoNormalBasis(viewingMatrix);
+}
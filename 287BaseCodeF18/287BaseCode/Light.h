@@ -87,6 +87,7 @@ struct PositionalLight : public LightSource {
 							const glm::vec3 &normal,
 							const Material &material,
 							const Frame &eyeFrame, bool inShadow) const;
+	virtual bool canReach(const glm::vec3 &point) const;
 	friend std::ostream &operator << (std::ostream &os, const PositionalLight &pl);
 };
 
@@ -107,6 +108,7 @@ struct SpotLight : public PositionalLight {
 							const glm::vec3 &normal,
 							const Material &material,
 							const Frame &eyeFrame, bool inShadow) const;
+	virtual bool canReach(const glm::vec3 &point) const;
 	friend std::ostream &operator << (std::ostream &os, const SpotLight &pl);
 };
 
@@ -129,3 +131,35 @@ color totalColor(const Material &mat, const LightColor &lightColor,
 typedef LightSource *LightSourcePtr;
 typedef PositionalLight *PositionalLightPtr;
 typedef SpotLight *SpotLightPtr;
+
+/**
+ * @struct	LightParams
+ * @brief	A positional or spot light flattened into plain data, so batches of
+ * 			points can be lit without virtual calls.
+ */
+
+struct LightParams {
+	glm::vec3 position;								//!< The position of the light.
+	color ambient, diffuse, specular;				//!< The three light components.
+	bool attenuationIsTurnedOn;						//!< true if attenuation is active.
+	LightAttenuationParameters attenuationParams;	//!< Attenuation parameters.
+	bool isSpot;									//!< true if the cone test applies.
+	glm::vec3 spotDirection;						//!< Normalized direction of a spot light.
+	float cosCutoff;								//!< Cosine of half a spot light's fov.
+};
+
+void flattenLights(const std::vector<LightSourcePtr> &lights,
+					std::vector<LightParams> &flat, std::vector<LightSourcePtr> &others);
+
+/**
+ * @struct	LightBlock
+ * @brief	The lights of a draw, sorted once into the flattened positional and
+ * 			spot lights and the rest, together with the camera frame.
+ */
+
+struct LightBlock {
+	std::vector<LightParams> flatLights;		//!< Positional and spot lights, evaluated in SIMD batches
+	std::vector<LightSourcePtr> otherLights;	//!< Everything else, evaluated through illuminate
+	Frame eyeFrame;								//!< The camera frame
+	void prepare(const std::vector<LightSourcePtr> &lights, const glm::mat4 &viewingMatrix);
+};
@@ -0,0 +1,308 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include "MappedImage.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+/**
+ * @fn	static uint64_t mappingGranularity()
+ * @brief	Mapping offsets must be a multiple of this.
+ * @return	The allocation granularity (Win32) or page size (POSIX).
+ */
+
+static uint64_t mappingGranularity() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwAllocationGranularity;
+#else
+	return (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+/**
+ * @fn	MappedImage::MappedImage()
+ * @brief	Constructs an image with no file.
+ */
+
+MappedImage::MappedImage()
+	: width(0), height(0), headerBytes(0), fileSize(0), view(nullptr), viewLength(0), viewDelta(0) {
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = nullptr;
+#else
+	fd = -1;
+#endif
+}
+
+/**
+ * @fn	MappedImage::~MappedImage()
+ * @brief	Destructor. Closes the file.
+ */
+
+MappedImage::~MappedImage() {
+	close();
+}
+
+/**
+ * @fn	bool MappedImage::create(const std::string &filename, int W, int H)
+ * @brief	Creates a PPM file of the given size and writes its header. The pixels
+ * 			are then written using mapRows.
+ * @param	filename	Filename of the file.
+ * @param	W			The width.
+ * @param	H			The height.
+ * @return	True iff the file was created.
+ */
+
+bool MappedImage::create(const std::string &filename, int W, int H) {
+	close();
+	char header[64];
+	int n = std::sprintf(header, "P6\n%d %d\n255\n", W, H);
+	const uint64_t size = (uint64_t)n + (uint64_t)W * H * BYTES_PER_PIXEL;
+
+#ifdef _WIN32
+	file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+						CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		std::cerr << "Unable to create image: " << filename << std::endl;
+		return false;
+	}
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+								(DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFF), nullptr);
+	if (mapping == nullptr) {
+		std::cerr << "Unable to map image: " << filename << std::endl;
+		close();
+		return false;
+	}
+#else
+	fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		std::cerr << "Unable to create image: " << filename << std::endl;
+		return false;
+	}
+	if (ftruncate(fd, (off_t)size) != 0) {
+		std::cerr << "Unable to size image: " << filename << std::endl;
+		close();
+		return false;
+	}
+#endif
+
+	width = W;
+	height = H;
+	headerBytes = n;
+	fileSize = size;
+
+	GLubyte *dest = mapBytes(0, n);
+	if (dest == nullptr) {
+		close();
+		return false;
+	}
+	std::memcpy(dest, header, n);
+	unmapRows();
+	return true;
+}
+
+/**
+ * @fn	GLubyte *MappedImage::mapBytes(uint64_t offset, size_t length)
+ * @brief	Maps part of the file, replacing any current mapping.
+ * @param	offset	Offset of the first byte.
+ * @param	length	Number of bytes.
+ * @return	Pointer to the byte at offset, or nullptr on failure.
+ */
+
+GLubyte *MappedImage::mapBytes(uint64_t offset, size_t length) {
+	unmapRows();
+	const uint64_t granularity = mappingGranularity();
+	const uint64_t start = offset - offset % granularity;
+	viewDelta = (size_t)(offset - start);
+	viewLength = length + viewDelta;
+
+#ifdef _WIN32
+	view = MapViewOfFile(mapping, FILE_MAP_WRITE,
+						(DWORD)(start >> 32), (DWORD)(start & 0xFFFFFFFF), viewLength);
+#else
+	view = mmap(nullptr, viewLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)start);
+	if (view == MAP_FAILED) {
+		view = nullptr;
+	}
+#endif
+	if (view == nullptr) {
+		std::cerr << "Unable to map " << length << " bytes at offset " << offset << std::endl;
+		viewLength = viewDelta = 0;
+		return nullptr;
+	}
+	return (GLubyte *)view + viewDelta;
+}
+
+/**
+ * @fn	GLubyte *MappedImage::mapRows(int firstRow, int numRows)
+ * @brief	Maps a band of rows, replacing any current mapping. Rows are numbered
+ * 			in file order, i.e., row 0 is the top of the image.
+ * @param	firstRow	The first row of the band.
+ * @param	numRows 	Number of rows in the band.
+ * @return	Pointer to the first pixel of firstRow, or nullptr on failure.
+ */
+
+GLubyte *MappedImage::mapRows(int firstRow, int numRows) {
+	return mapBytes(headerBytes + firstRow * getRowBytes(), (size_t)(numRows * getRowBytes()));
+}
+
+/**
+ * @fn	void MappedImage::unmapRows()
+ * @brief	Releases the current mapping. Its pages are written back by the OS,
+ * 			so the band no longer counts against resident memory.
+ */
+
+void MappedImage::unmapRows() {
+	if (view == nullptr) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(view);
+#else
+	munmap(view, viewLength);
+#endif
+	view = nullptr;
+	viewLength = viewDelta = 0;
+}
+
+/**
+ * @fn	void MappedImage::close()
+ * @brief	Unmaps and closes the file.
+ */
+
+void MappedImage::close() {
+	unmapRows();
+#ifdef _WIN32
+	if (mapping != nullptr) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+#endif
+	fileSize = 0;
+}
+
+/**
+ * @fn	MappedFile::MappedFile()
+ * @brief	Constructs a mapping with no file.
+ */
+
+MappedFile::MappedFile()
+	: fileSize(0), view(nullptr) {
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = nullptr;
+#else
+	fd = -1;
+#endif
+}
+
+/**
+ * @fn	MappedFile::~MappedFile()
+ * @brief	Destructor. Unmaps and closes the file.
+ */
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+/**
+ * @fn	bool MappedFile::open(const std::string &filename)
+ * @brief	Maps a whole file for reading, replacing any file already open.
+ * @param	filename	Filename of the file.
+ * @return	True iff the file was opened and mapped. An empty file cannot be mapped.
+ */
+
+bool MappedFile::open(const std::string &filename) {
+	close();
+#ifdef _WIN32
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+						OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		close();
+		return false;
+	}
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		std::cerr << "Unable to map file: " << filename << std::endl;
+		close();
+		return false;
+	}
+	view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	fileSize = (uint64_t)size.QuadPart;
+#else
+	fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	const off_t size = lseek(fd, 0, SEEK_END);
+	if (size <= 0) {
+		close();
+		return false;
+	}
+	view = mmap(nullptr, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED) {
+		view = nullptr;
+	}
+	fileSize = (uint64_t)size;
+#endif
+	if (view == nullptr) {
+		std::cerr << "Unable to map file: " << filename << std::endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn	void MappedFile::close()
+ * @brief	Unmaps and closes the file.
+ */
+
+void MappedFile::close() {
+#ifdef _WIN32
+	if (view != nullptr) {
+		UnmapViewOfFile(view);
+	}
+	if (mapping != nullptr) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (view != nullptr) {
+		munmap(view, (size_t)fileSize);
+	}
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+#endif
+	view = nullptr;
+	fileSize = 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include "FrameBuffer.h"
+
+/**
+ * @struct	MappedImage
+ * @brief	A binary (P6) PPM file that is written through a memory mapping. Only
+ * 			a band of rows is mapped at a time, so images far larger than memory
+ * 			(e.g., 32k x 32k) can be produced band by band. All file offsets are
+ * 			64 bit.
+ */
+
+struct MappedImage {
+	MappedImage();
+	~MappedImage();
+	bool create(const std::string &filename, int width, int height);
+	GLubyte *mapRows(int firstRow, int numRows);
+	void unmapRows();
+	void close();
+	bool isOpen() const { return fileSize > 0; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	uint64_t getRowBytes() const { return (uint64_t)width * BYTES_PER_PIXEL; }
+protected:
+	GLubyte *mapBytes(uint64_t offset, size_t length);
+	int width, height;			//!< Dimensions of the image
+	uint64_t headerBytes;		//!< Size of the PPM header
+	uint64_t fileSize;			//!< Total size of the file. 0 when no file is open
+	void *view;					//!< Start of the current mapping
+	size_t viewLength;			//!< Length of the current mapping
+	size_t viewDelta;			//!< Bytes from view to the requested offset
+#ifdef _WIN32
+	void *file;					//!< Win32 file handle
+	void *mapping;				//!< Win32 file mapping handle
+#else
+	int fd;						//!< POSIX file descriptor
+#endif
+};
+
+/**
+ * @struct	MappedFile
+ * @brief	A whole file mapped read-only into memory, e.g., a compiled scene. Its
+ * 			pages are read in by the OS as they are first touched.
+ */
+
+struct MappedFile {
+	MappedFile();
+	~MappedFile();
+	bool open(const std::string &filename);
+	void close();
+	const unsigned char *getData() const { return (const unsigned char *)view; }
+	uint64_t getSize() const { return fileSize; }
+protected:
+	uint64_t fileSize;			//!< Size of the file. 0 when no file is open
+	void *view;					//!< Start of the mapping
+#ifdef _WIN32
+	void *file;					//!< Win32 file handle
+	void *mapping;				//!< Win32 file mapping handle
+#else
+	int fd;						//!< POSIX file descriptor
+#endif
+};
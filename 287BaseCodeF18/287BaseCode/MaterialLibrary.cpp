@@ -0,0 +1,65 @@
+#include <cstring>
+#include <stdexcept>
+#include "MaterialLibrary.h"
+
+/**
+ * @fn	MaterialLibrary::MaterialLibrary()
+ * @brief	Constructs a library holding only the default material.
+ */
+
+MaterialLibrary::MaterialLibrary() {
+	findOrAdd(Material());
+}
+
+/**
+ * @fn	uint32_t MaterialLibrary::hash(const Material &material)
+ * @brief	Hashes the bytes of a material (FNV-1a).
+ * @param	material	The material.
+ * @return	The hash.
+ */
+
+uint32_t MaterialLibrary::hash(const Material &material) {
+	const unsigned char *bytes = (const unsigned char *)&material;
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < sizeof(Material); i++) {
+		h = (h ^ bytes[i]) * 16777619u;
+	}
+	return h;
+}
+
+/**
+ * @fn	MaterialId MaterialLibrary::findOrAdd(const Material &material)
+ * @brief	Gets the id of a material, adding it if it is new. Materials are the
+ * 			same only if every value, including alpha, is.
+ * @param	material	The material.
+ * @return	Its id. Throws std::length_error if the material is new and the
+ * 			library already holds MAX_MATERIALS.
+ */
+
+MaterialId MaterialLibrary::findOrAdd(const Material &material) {
+	const uint32_t h = hash(material);
+	auto range = index.equal_range(h);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (std::memcmp(&materials[it->second], &material, sizeof(Material)) == 0) {
+			return it->second;
+		}
+	}
+	if ((int)materials.size() >= MAX_MATERIALS) {
+		throw std::length_error("Material library is full");
+	}
+	const MaterialId id = (MaterialId)materials.size();
+	materials.push_back(material);
+	index.insert(std::make_pair(h, id));
+	return id;
+}
+
+/**
+ * @fn	MaterialLibrary &MaterialLibrary::getShared()
+ * @brief	Gets the library that visible shapes and meshes use, created on first use.
+ * @return	The shared library.
+ */
+
+MaterialLibrary &MaterialLibrary::getShared() {
+	static MaterialLibrary library;
+	return library;
+}
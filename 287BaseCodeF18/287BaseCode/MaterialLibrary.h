@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "ColorAndMaterials.h"
+
+typedef uint16_t MaterialId;
+
+const MaterialId DEFAULT_MATERIAL_ID = 0;	//!< Id of Material(), which every library starts with.
+const int MAX_MATERIALS = 65536;			//!< Most materials a MaterialId can tell apart.
+
+/**
+ * @struct	MaterialLibrary
+ * @brief	A table of distinct materials. Objects, hit records and mesh vertices
+ * 			refer to a material by its 16-bit id instead of carrying a copy.
+ * 			Add materials while building a scene; once rendering starts, only
+ * 			look them up, which is then safe from any thread. Materials are
+ * 			never removed, so ids stay valid; reloading a scene adds nothing,
+ * 			as equal materials share an id.
+ */
+
+struct MaterialLibrary {
+	MaterialLibrary();
+	MaterialId findOrAdd(const Material &material);
+	const Material &operator [](MaterialId id) const { return materials[id]; }
+	int size() const { return (int)materials.size(); }
+	static MaterialLibrary &getShared();
+	static uint32_t hash(const Material &material);
+protected:
+	std::vector<Material> materials;						//!< The materials, by id
+	std::unordered_multimap<uint32_t, MaterialId> index;	//!< Ids of the materials, by hash
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "SimdMath.h"
+#include "Light.h"
+
+/**
+ * @struct	SurfaceBatch
+ * @brief	The surface properties of VF::WIDTH points, stored one component
+ * 			per vector, i.e., structure-of-arrays.
+ */
+
+template <class VF>
+struct SurfaceBatch {
+	VF px, py, pz;						//!< World position
+	VF nx, ny, nz;						//!< Unit normal
+	VF vx, vy, vz;						//!< Unit vector toward the eye
+	VF ambR, ambG, ambB;				//!< Ambient material property
+	VF diffR, diffG, diffB;				//!< Diffuse material property
+	VF specR, specG, specB;				//!< Specular material property
+	VF shininess;						//!< Shininess material property
+};
+
+/**
+ * @fn	template <class VF> inline void completeSurfaceBatch(SurfaceBatch<VF> &s, const glm::vec3 &eyePos)
+ * @brief	Normalizes the batch's normals, leaving zero normals alone, and fills in
+ * 			the unit vectors toward the eye.
+ * @param [in,out]	s	  	The points, with positions and normals set.
+ * @param 		  	eyePos	The eye position.
+ */
+
+template <class VF>
+inline void completeSurfaceBatch(SurfaceBatch<VF> &s, const glm::vec3 &eyePos) {
+	const VF zero(0.0f), one(1.0f);
+	const VF nLength = vsqrt(s.nx * s.nx + s.ny * s.ny + s.nz * s.nz);
+	const VF invN = one / select(nLength > zero, nLength, one);
+	s.nx = s.nx * invN;
+	s.ny = s.ny * invN;
+	s.nz = s.nz * invN;
+	s.vx = VF(eyePos.x) - s.px;
+	s.vy = VF(eyePos.y) - s.py;
+	s.vz = VF(eyePos.z) - s.pz;
+	const VF invV = one / vsqrt(s.vx * s.vx + s.vy * s.vy + s.vz * s.vz);
+	s.vx = s.vx * invV;
+	s.vy = s.vy * invV;
+	s.vz = s.vz * invV;
+}
+
+/**
+ * @fn	template <class VF> inline void accumulatePhong(const LightParams &light, const SurfaceBatch<VF> &s, VF &R, VF &G, VF &B)
+ * @brief	Adds the color one light produces at each point of a batch. Follows
+ * 			PositionalLight::illuminate and SpotLight::illuminate, without shadows.
+ * @param 		  	light	The light.
+ * @param 		  	s	 	The points.
+ * @param [in,out]	R	 	Red, accumulated.
+ * @param [in,out]	G	 	Green, accumulated.
+ * @param [in,out]	B	 	Blue, accumulated.
+ */
+
+template <class VF>
+inline void accumulatePhong(const LightParams &light, const SurfaceBatch<VF> &s, VF &R, VF &G, VF &B) {
+	const VF zero(0.0f), one(1.0f);
+
+	// l = normalize(lightPosition - P)
+	VF lx = VF(light.position.x) - s.px;
+	VF ly = VF(light.position.y) - s.py;
+	VF lz = VF(light.position.z) - s.pz;
+	const VF distance = vsqrt(lx * lx + ly * ly + lz * lz);
+	const VF invDistance = one / distance;
+	lx = lx * invDistance;
+	ly = ly * invDistance;
+	lz = lz * invDistance;
+
+	// r = normalize(2 (l . n) n - l)
+	const VF ln = lx * s.nx + ly * s.ny + lz * s.nz;
+	VF rx = VF(2.0f) * ln * s.nx - lx;
+	VF ry = VF(2.0f) * ln * s.ny - ly;
+	VF rz = VF(2.0f) * ln * s.nz - lz;
+	const VF invR = one / vsqrt(rx * rx + ry * ry + rz * rz);
+	const VF rv = (rx * s.vx + ry * s.vy + rz * s.vz) * invR;
+	const VF specularFactor = select(rv >= zero, vpow(vmax(rv, zero), s.shininess), zero);
+
+	VF r = s.ambR * VF(light.ambient.r) +
+			vmin(vmax(s.diffR * VF(light.diffuse.r) * ln, zero), one) +
+			s.specR * VF(light.specular.r) * specularFactor;
+	VF g = s.ambG * VF(light.ambient.g) +
+			vmin(vmax(s.diffG * VF(light.diffuse.g) * ln, zero), one) +
+			s.specG * VF(light.specular.g) * specularFactor;
+	VF b = s.ambB * VF(light.ambient.b) +
+			vmin(vmax(s.diffB * VF(light.diffuse.b) * ln, zero), one) +
+			s.specB * VF(light.specular.b) * specularFactor;
+
+	VF scale = one;
+	if (light.attenuationIsTurnedOn) {
+		const LightAttenuationParameters &at = light.attenuationParams;
+		scale = one / (VF(at.constant) + VF(at.linear) * distance + VF(at.quadratic) * distance * distance);
+	}
+	if (light.isSpot) {
+		// The angle between the spot direction and P - lightPosition, i.e., -l.
+		const VF cosAlpha = zero - (VF(light.spotDirection.x) * lx + VF(light.spotDirection.y) * ly +
+									VF(light.spotDirection.z) * lz);
+		scale = select(cosAlpha >= VF(light.cosCutoff), scale, zero);
+	}
+	R = R + r * scale;
+	G = G + g * scale;
+	B = B + b * scale;
+}
@@ -1,4 +1,5 @@
 #include <ctime>
+#include <cstdio>
 #include "Defs.h"
 #include "IShape.h"
 #include "FrameBuffer.h"
@@ -8,10 +9,14 @@
 #include "Image.h"
 #include "Camera.h"
 #include "Rasterization.h"
+#include "FrameWriter.h"
+#include "SceneLoader.h"
+#include "SequenceRenderer.h"
 
 // new header files
 #include <utility>
 #include <cctype>
+#include <cstring>
 #include "ColorAndMaterials.h"
 
 int currLight = 0;
@@ -22,108 +27,183 @@ bool isAnimated = false;
 int numReflections = 0;
 int antiAliasing = 1;
 bool twoViewOn = false;
+bool isRecording = false;
+int frameNumber = 0;
+VisibleIShapePtr bouncingSphere = nullptr;
+VisibleIShapePtr glassBall = nullptr;
 
 // new global variable
 Image im("usflag.ppm");
 
-std::vector<PositionalLightPtr> lights = {
-						new PositionalLight(glm::vec3(10, 10, 10), pureWhiteLight),
-						new SpotLight(glm::vec3(2, 5, -2), glm::vec3(0,-1,0), glm::radians(80.0f), pureWhiteLight)
-};
-
-PositionalLightPtr posLight = lights[0];
-SpotLightPtr spotLight = (SpotLightPtr)lights[1];
+// The built-in scene's lights, owned by the scene; empty when a scene file is loaded.
+std::vector<PositionalLightPtr> lights;
+PositionalLightPtr posLight = nullptr;
+SpotLightPtr spotLight = nullptr;
 
 FrameBuffer frameBuffer(WINDOW_WIDTH, WINDOW_HEIGHT);
 RayTracer rayTrace(lightGray);
-PerspectiveCamera pCamera(glm::vec3(0, 10, 10), ORIGIN3D, Y_AXIS, M_PI_2);
-OrthographicCamera oCamera(glm::vec3(0, 10, 10), ORIGIN3D, Y_AXIS, 25.0f);
+AsyncFrameWriter frameWriter(3);
+PerspectiveCamera pCamera(glm::vec3(0, 15, 15), ORIGIN3D, Y_AXIS, M_PI_2);
+OrthographicCamera oCamera(glm::vec3(0, 15, 15), ORIGIN3D, Y_AXIS, 25.0f);
 RaytracingCamera *cameras[] = { &pCamera, &oCamera };
+PerspectiveCamera sideCamera(glm::vec3(0, 15, 15), glm::vec3(-8, 2, 3), Y_AXIS, M_PI_2);
 int currCamera = 0;
 IScene scene(cameras[currCamera], false);
+DirtyRegion dirtyRegion;
+bool fullRedraw = true;
+RenderStats renderStats;
 
 void render() {
 	rayTrace.anti_aliasing = antiAliasing;
-	rayTrace.myTwoViewOn = twoViewOn;
 	int frameStartTime = glutGet(GLUT_ELAPSED_TIME);
-	cameras[currCamera]->calculateViewingParameters(frameBuffer.getWindowWidth()/2, frameBuffer.getWindowHeight());
-	cameras[currCamera]->changeConfiguration(glm::vec3(0, 15, 15), ORIGIN3D, Y_AXIS);
-	rayTrace.raytraceScene(frameBuffer, numReflections, scene);
+	scene.updateDynamicObjects();
+	const bool isTracing = twoViewOn || fullRedraw || !dirtyRegion.isEmpty();
+	if (twoViewOn) {
+		const int W = frameBuffer.getWindowWidth();
+		const int H = frameBuffer.getWindowHeight();
+		std::vector<RenderView> views;
+		views.push_back(RenderView(cameras[currCamera], 0, 0, W / 2, H));
+		views.push_back(RenderView(&sideCamera, W / 2, 0, W - W / 2, H));
+		rayTrace.raytraceViews(frameBuffer, numReflections, scene, views);
+	} else if (fullRedraw) {
+		rayTrace.raytraceScene(frameBuffer, numReflections, scene);
+	} else if (!dirtyRegion.isEmpty()) {
+		rayTrace.raytraceRects(frameBuffer, numReflections, scene, dirtyRegion.rects);
+	} else {
+		frameBuffer.showColorBuffer();
+	}
+	fullRedraw = false;
+	dirtyRegion.clear();
+	if (isRecording) {
+		char filename[32];
+		std::sprintf(filename, "frame%04d.ppm", frameNumber++);
+		frameWriter.submit(frameBuffer, filename);
+	}
 
 	int frameEndTime = glutGet(GLUT_ELAPSED_TIME); // Get end time
 	float totalTimeSec = (frameEndTime - frameStartTime) / 1000.0f;
 	std::cout << "Render time: " << totalTimeSec << " sec." << std::endl;
+	// Redraws with nothing to trace leave the last render's statistics alone.
+	if (rayTrace.stats != nullptr && isTracing) {
+		std::cout << renderStats;
+		renderStats.saveJSON("renderstats.json");
+	}
 }
 
 void resize(int width, int height) {
 	frameBuffer.setFrameBufferSize(width, height);
 	cameras[currCamera]->calculateViewingParameters(width, height);
+	fullRedraw = true;
 	glutPostRedisplay();
 } 
 
 void buildScene() {
-	IShape *plane = new IPlane(glm::vec3(0.0f, -2.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	ISphere *sphere = new ISphere(glm::vec3(-4.0f, 0.0f, 5.0f), 2.0f);
-	IEllipsoid *ellipsoid = new IEllipsoid(glm::vec3(8.0f, 0.0f, 5.0f), glm::vec3(2.0f, 1.0f, 2.0f));
+	IShape *plane = scene.create<IPlane>(glm::vec3(0.0f, -2.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	ISphere *sphere = scene.create<ISphere>(glm::vec3(-4.0f, 0.0f, 5.0f), 2.0f);
+	IEllipsoid *ellipsoid = scene.create<IEllipsoid>(glm::vec3(8.0f, 0.0f, 5.0f), glm::vec3(2.0f, 1.0f, 2.0f));
 
 	// y axis
-	ICylinder *y_axis = new ICylinderY(glm::vec3(0.0f, 0.0f, 0.0f), 0.1f, 40.0f);
+	ICylinder *y_axis = scene.create<ICylinderY>(glm::vec3(0.0f, 0.0f, 0.0f), 0.1f, 40.0f);
 	// cylinder along y axis will be at position glm::vec3(0,0,0)
-	ICylinder *cylinderY = new ICylinderY(glm::vec3(15.0f, 0.0f, 0.0f), 2.0f, 10.0f);
+	ICylinder *cylinderY = scene.create<ICylinderY>(glm::vec3(15.0f, 0.0f, 0.0f), 2.0f, 10.0f);
 	// disk for closing the end of the cylinder
-	IShape *topDisk = new IDisk(glm::vec3(0.0f, 7.5f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 2.0f);
+	IShape *topDisk = scene.create<IDisk>(glm::vec3(0.0f, 7.5f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 2.0f);
 	
 	// x axis
-	ICylinder *x_axis = new ICylinderX(glm::vec3(0.0f, 0.0f, 0.0f), 0.1f, 40.0f);
+	ICylinder *x_axis = scene.create<ICylinderX>(glm::vec3(0.0f, 0.0f, 0.0f), 0.1f, 40.0f);
 	// cylinder along x axis will be at position glm::vec3(0,0,0)
-	ICylinder *cylinderX = new ICylinderX(glm::vec3(-13.0f, 0.0f, 0.0f), 1.5f, 10.0f);
+	ICylinder *cylinderX = scene.create<ICylinderX>(glm::vec3(-13.0f, 0.0f, 0.0f), 1.5f, 10.0f);
 
 	// z axis
-	ICylinder *z_axis = new ICylinderZ(glm::vec3(0.0f, 0.0f, 0.0f), 0.1f, 40.0f);
+	ICylinder *z_axis = scene.create<ICylinderZ>(glm::vec3(0.0f, 0.0f, 0.0f), 0.1f, 40.0f);
 
 	// cone along y axis
-	IConeY *cone = new IConeY(glm::vec3(-6.0f, 3.0f, -12.0f), 1.0f, 5.0f);
+	IConeY *cone = scene.create<IConeY>(glm::vec3(-6.0f, 3.0f, -12.0f), 1.0f, 5.0f);
 
 	// transparent plane 
-	IShape *myPlane = new IPlane(glm::vec3(-1.0f, 0.2f, 0.0f), glm::vec3(-1.0f, 0.0f, 1.0f));
+	IShape *myPlane = scene.create<IPlane>(glm::vec3(-1.0f, 0.2f, 0.0f), glm::vec3(-1.0f, 0.0f, 1.0f));
 
 	// cylinder with closed ends
-	IClosedCylinderY *closedCylinderY = new IClosedCylinderY(glm::vec3(0.0f, 0.0f, 0.0f), 2.0f, 8.0f);
+	IClosedCylinderY *closedCylinderY = scene.create<IClosedCylinderY>(glm::vec3(0.0f, 0.0f, 0.0f), 2.0f, 8.0f);
 	
-	scene.addObject(new VisibleIShape(plane, tin));
-	scene.addObject(new VisibleIShape(sphere, silver));
-	scene.addObject(new VisibleIShape(ellipsoid, redPlastic));
+	scene.addObject(scene.create<VisibleIShape>(plane, tin));
+	// the sphere bounces while animated, so it goes in the dynamic hierarchy
+	scene.addDynamicObject(bouncingSphere = scene.create<VisibleIShape>(sphere, silver));
+	scene.addObject(scene.create<VisibleIShape>(ellipsoid, redPlastic));
 
 	// new object
 	// y axis
-	//scene.addObject(new VisibleIShape(y_axis, green));
+	//scene.addObject(scene.create<VisibleIShape>(y_axis, green));
 	// cylinder along y axis with image
 	VisibleIShapePtr pictureObj;
-	scene.addObject(pictureObj = new VisibleIShape(cylinderY, greenPlastic));
+	scene.addObject(pictureObj = scene.create<VisibleIShape>(cylinderY, greenPlastic));
 	pictureObj->setTexture(&im);
 	// disk for closing the end of the cylinder
-	//scene.addObject(new VisibleIShape(topDisk, gold));
+	//scene.addObject(scene.create<VisibleIShape>(topDisk, gold));
 
 	// x axis
-	//scene.addObject(new VisibleIShape(x_axis, red));
+	//scene.addObject(scene.create<VisibleIShape>(x_axis, red));
 	// clinder along x axis
-	scene.addObject(new VisibleIShape(cylinderX, cyanPlastic));
+	scene.addObject(scene.create<VisibleIShape>(cylinderX, cyanPlastic));
 
 	// z axis
-	//scene.addObject(new VisibleIShape(z_axis, blue));
+	//scene.addObject(scene.create<VisibleIShape>(z_axis, blue));
 
 	// cone along z axis
-	scene.addObject(new VisibleIShape(cone, whitePlastic));
+	scene.addObject(scene.create<VisibleIShape>(cone, whitePlastic));
 
 	// transparent plane
-	// scene.addObject(new VisibleIShape(myPlane, blue));
-	scene.addTransparentObject(new VisibleIShape(myPlane, blue), 0.4f);
+	// scene.addObject(scene.create<VisibleIShape>(myPlane, blue));
+	scene.addTransparentObject(scene.create<VisibleIShape>(myPlane, blue), 0.4f);
+	// slides with the arrow keys
+	ISphere *ball = scene.create<ISphere>(glm::vec3(0.0f, 4.0f, 8.0f), 1.0f);
+	scene.addTransparentObject(glassBall = scene.create<VisibleIShape>(ball, cyanPlastic), 0.5f);
 
 	// cylinder with closed ends
-	scene.addObject(new VisibleIShape(closedCylinderY, gold));
+	scene.addObject(scene.create<VisibleIShape>(closedCylinderY, gold));
+
+	posLight = scene.create<PositionalLight>(glm::vec3(10, 10, 10), pureWhiteLight);
+	spotLight = scene.create<SpotLight>(glm::vec3(2, 5, -2), glm::vec3(0, -1, 0), glm::radians(80.0f), pureWhiteLight);
+	lights = { posLight, spotLight };
+	scene.addObject(posLight);
+	scene.addObject(spotLight);
+	scene.buildAccelerationStructure();
+}
 
-	scene.addObject(lights[0]);
-	scene.addObject(lights[1]);
+void renderTurntable(int numFrames) {
+	// one turn of the camera around the scene, while the sphere bobs and the light swings over
+	SequenceRenderer sequence;
+	const float R = 20.0f;
+	for (int i = 0; i <= 8; i++) {
+		const float a = i * 2.0f * M_PI / 8;
+		sequence.addCameraKeyframe(i / 8.0f, glm::vec3(R * std::sin(a), 15.0f, R * std::cos(a)), ORIGIN3D, Y_AXIS);
+	}
+	if (posLight != nullptr) {
+		sequence.addLightKeyframe(posLight, 0.0f, glm::vec3(10, 10, 10));
+		sequence.addLightKeyframe(posLight, 0.5f, glm::vec3(-10, 10, 10));
+		sequence.addLightKeyframe(posLight, 1.0f, glm::vec3(10, 10, 10));
+	}
+	if (bouncingSphere != nullptr) {
+		sequence.addObjectKeyframe(bouncingSphere, 0.0f, glm::vec3(0, 0, 0));
+		sequence.addObjectKeyframe(bouncingSphere, 0.5f, glm::vec3(0, 3, 0));
+		sequence.addObjectKeyframe(bouncingSphere, 1.0f, glm::vec3(0, 0, 0));
+	}
+	const Frame savedFrame = scene.camera->cameraFrame;
+	SequenceStats stats;
+	if (sequence.render(scene, rayTrace, frameBuffer, numReflections, numFrames, "turntable", frameWriter, stats)) {
+		std::cout << stats;
+	}
+	// Put the camera back where the turntable found it.
+	scene.camera->cameraFrame = savedFrame;
+	scene.camera->calculateViewingParameters(frameBuffer.getWindowWidth(), frameBuffer.getWindowHeight());
+}
+
+void slideGlassBall(float dx) {
+	// Shadow rays ignore transparent objects, so only the pixels the ball
+	// covers before and after the move change.
+	dirtyRegion.addObject(*cameras[currCamera], *glassBall);
+	glassBall->shape->translate(glm::vec3(dx, 0.0f, 0.0f));
+	dirtyRegion.addObject(*cameras[currCamera], *glassBall);
 }
 
 void incrementClamp(float &v, float delta, float lo, float hi) {
@@ -135,8 +215,15 @@ void incrementClamp(int &v, int delta, int lo, int hi) {
 }
 
 void timer(int id) {
-	if (isAnimated) {
-		// modify something in your scene
+	if (isAnimated && bouncingSphere != nullptr) {
+		z += inc;
+		if (z < 0.0f || z > 3.0f) {
+			inc = -inc;
+		}
+		((ISphere *)bouncingSphere->shape)->center.y = z;
+		scene.markMoved(bouncingSphere);
+		// Its shadow and reflections fall outside its bounds.
+		fullRedraw = true;
 	}
 	glutTimerFunc(TIME_INTERVAL, timer, 0);
 	glutPostRedisplay();
@@ -144,6 +231,10 @@ void timer(int id) {
 
 void keyboard(unsigned char key, int x, int y) {
 	const float INC = 0.5f;
+	if (lights.empty() && std::isalpha(key) && std::strchr("ABOVQWERXYZJKLF", std::toupper(key)) != nullptr) {
+		std::cout << "Only the built-in scene's lights can be edited" << std::endl;
+		return;
+	}
 	switch (key) {
 	case 'A':
 	case 'a':	currLight = 0;
@@ -233,6 +324,23 @@ void keyboard(unsigned char key, int x, int y) {
 				break;
 	case '?':	twoViewOn = !twoViewOn;
 				break;
+	case 'G':
+	case 'g':	isRecording = !isRecording;
+				std::cout << "Recording: " << isRecording << std::endl;
+				break;
+	case 'T':
+	case 't':	renderTurntable(isupper(key) ? 120 : 24);
+				break;
+	case 'S':
+	case 's':	rayTrace.stats = rayTrace.stats == nullptr ? &renderStats : nullptr;
+				std::cout << "Statistics " << (rayTrace.stats != nullptr ? "ON" : "OFF") << std::endl;
+				break;
+	case 'H':
+	case 'h':	rayTrace.raytraceToFile("poster.ppm", 8 * frameBuffer.getWindowWidth(),
+									8 * frameBuffer.getWindowHeight(), numReflections, scene);
+				cameras[currCamera]->calculateViewingParameters(frameBuffer.getWindowWidth(), frameBuffer.getWindowHeight());
+				std::cout << "Wrote poster.ppm" << std::endl;
+				break;
 	case ESCAPE:
 		glutLeaveMainLoop();
 		break;
@@ -240,6 +348,7 @@ void keyboard(unsigned char key, int x, int y) {
 		std::cout << (int)key << "unmapped key pressed." << std::endl;
 	}
 
+	fullRedraw = true;
 	glutPostRedisplay();
 }
 
@@ -248,11 +357,18 @@ void special(int key, int x, int y) {
 	switch (key) {
 		case GLUT_KEY_PAGE_DOWN: break;
 		case GLUT_KEY_PAGE_UP: break;
-		case GLUT_KEY_RIGHT: break;
-		case GLUT_KEY_LEFT: break;
+		case GLUT_KEY_RIGHT:
+		case GLUT_KEY_LEFT:
+			if (glassBall != nullptr) {
+				slideGlassBall(key == GLUT_KEY_RIGHT ? INC : -INC);
+				glutPostRedisplay();
+				return;
+			}
+			break;
 		default:
 			std::cout << key << " special key pressed." << std::endl;
 	}
+	fullRedraw = true;
 	glutPostRedisplay();
 }
 
@@ -278,7 +394,20 @@ int main(int argc, char *argv[]) {
 	glutSpecialFunc(special);
 	glutMouseFunc(mouse);
 	glutTimerFunc(TIME_INTERVAL, timer, 0);
-	buildScene();
+	// Each traced tile then fills contiguous memory, written a whole pixel at a time.
+	frameBuffer.setTileLayout(RAY_TILE_SIZE);
+	frameBuffer.setColorFormat(RGBA8_FORMAT);
+	if (argc > 1) {
+		// e.g., ProjectRaytrace.scene; compiled to ProjectRaytrace.scene.bin on first use.
+		if (!SceneLoader::load(argv[1], scene)) {
+			return 1;
+		}
+		if (!scene.cameras.empty()) {
+			cameras[currCamera] = scene.camera;
+		}
+	} else {
+		buildScene();
+	}
 
 	glutMainLoop();
 
@@ -1,4 +1,7 @@
 #include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <emmintrin.h>
 #include "Rasterization.h"
 
 /**
@@ -64,10 +67,10 @@ static void drawHorizontalLine(FrameBuffer &fb, int y, int left, int right, cons
 	}
 	left = left < 0 ? 0 : left;
 	right = right >= W ? W - 1 : right;
-	for (int x = left; x <= right; x++) {
-		if (inRectangle((float)x, (float)y, 0.0f, 0.0f, W - 1.0f, H - 1.0f))
-			fb.setColor(x, y, rgb);
+	if (y < 0 || y >= H || left > right) {
+		return;
 	}
+	fb.fillColorSpanUnchecked(left, y, right - left + 1, rgb);
 }
 
 /**
@@ -579,9 +582,311 @@ static inline float f20(const VertexData &v0, const VertexData &v1, const Vertex
 
 }
 
+/**
+ * @struct	TriangleSetup
+ * @brief	Per-triangle constants, computed once before rasterization. Edge i is
+ * 			the edge opposite vertex i, so its edge function is the unnormalized
+ * 			barycentric weight of vertex i (f12, f20 and f01). Edge function i is
+ * 			((A[i] * x + B[i] * y) + P[i]) - Q[i], evaluated in the same order as
+ * 			f12, f20 and f01 so that pixels exactly on a shared edge get exactly
+ * 			zero from both triangles and the tie rule gives the pixel to one.
+ */
+
+struct TriangleSetup {
+	float A[3], B[3], P[3], Q[3];	//!< Edge function coefficients
+	float sign[3];					//!< Orients edge i so the interior is positive
+	float invArea[3];				//!< Converts oriented edge function i into a barycentric weight
+	bool acceptZero[3];				//!< Tie rule: accept pixels exactly on edge i
+	float margin;					//!< Rounding allowance for the block tests
+	int xMin, xMax, yMin, yMax;		//!< Bounding box, clipped to the window
+};
+
+/**
+ * @fn	static void setupEdge(TriangleSetup &setup, int i, const glm::vec4 &a, const glm::vec4 &b, float f, float fOffscreen)
+ * @brief	Fills in edge i, which runs from a to b.
+ * @param [in,out]	setup	  	The triangle setup.
+ * @param 		  	i		  	Index of the edge.
+ * @param 		  	a		  	First endpoint.
+ * @param 		  	b		  	Second endpoint.
+ * @param 		  	f		  	Edge function evaluated at the opposite vertex.
+ * @param 		  	fOffscreen	Edge function evaluated at (-1, -1).
+ */
+
+static void setupEdge(TriangleSetup &setup, int i, const glm::vec4 &a, const glm::vec4 &b,
+						float f, float fOffscreen) {
+	setup.A[i] = a.y - b.y;
+	setup.B[i] = b.x - a.x;
+	setup.P[i] = a.x * b.y;
+	setup.Q[i] = b.x * a.y;
+	setup.sign[i] = f > 0 ? 1.0f : -1.0f;
+	setup.invArea[i] = 1.0f / (setup.sign[i] * f);
+	setup.acceptZero[i] = f * fOffscreen > 0;
+}
+
+/**
+ * @fn	static bool setupTriangle(const BoundingBoxi &scissor, const VertexData &v0, const VertexData &v1, const VertexData &v2, TriangleSetup &setup)
+ * @brief	Computes the edge functions and bounding box of a triangle.
+ * @param 		  	scissor	   	Inclusive pixel rectangle the bounding box is clipped to.
+ * @param 		  	v0		   	v0.
+ * @param 		  	v1		   	v1.
+ * @param 		  	v2		   	v2.
+ * @param [in,out]	setup	   	The triangle setup.
+ * @return	False if the triangle is degenerate or entirely outside the scissor rectangle.
+ */
+
+static bool setupTriangle(const BoundingBoxi &scissor,
+							const VertexData &v0, const VertexData &v1, const VertexData &v2,
+							TriangleSetup &setup) {
+	float fAlpha = f12(v0, v1, v2, v0.position.x, v0.position.y);
+	float fBeta = f20(v0, v1, v2, v1.position.x, v1.position.y);
+	float fGamma = f01(v0, v1, v2, v2.position.x, v2.position.y);
+	if (fAlpha == 0.0f || fBeta == 0.0f || fGamma == 0.0f) {
+		return false;
+	}
+
+	setupEdge(setup, 0, v1.position, v2.position, fAlpha, f12(v0, v1, v2, -1, -1));
+	setupEdge(setup, 1, v2.position, v0.position, fBeta, f20(v0, v1, v2, -1, -1));
+	setupEdge(setup, 2, v0.position, v1.position, fGamma, f01(v0, v1, v2, -1, -1));
+
+	setup.xMin = std::max(scissor.lx, (int)glm::floor(min(v0.position.x, v1.position.x, v2.position.x)));
+	setup.xMax = std::min(scissor.rx, (int)glm::ceil(max(v0.position.x, v1.position.x, v2.position.x)));
+	setup.yMin = std::max(scissor.ly, (int)glm::floor(min(v0.position.y, v1.position.y, v2.position.y)));
+	setup.yMax = std::min(scissor.ry, (int)glm::ceil(max(v0.position.y, v1.position.y, v2.position.y)));
+
+	float magnitude = 0.0f;
+	for (int i = 0; i < 3; i++) {
+		magnitude = std::max(magnitude, std::abs(setup.A[i]) * (setup.xMax + 4) +
+							std::abs(setup.B[i]) * (setup.yMax + 4) +
+							std::abs(setup.P[i]) + std::abs(setup.Q[i]));
+	}
+	setup.margin = magnitude * 1.0e-5f;
+	return setup.xMin <= setup.xMax && setup.yMin <= setup.yMax;
+}
+
+/**
+ * @fn	static void shadeQuad(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const LightBlock &lights, const VertexData &v0, const VertexData &v1, const VertexData &v2, const TriangleSetup &setup, int materialId, int x, int y, int coverage, const float e[3][4])
+ * @brief	Interpolates the vertex attributes at the four pixels of a 2x2 quad
+ * 			and processes the quad. Uncovered pixels are interpolated too, so the
+ * 			quad has derivatives, but their material is skipped. When shading is
+ * 			deferred the material is not interpolated; the fragments carry the
+ * 			triangle's material id instead.
+ * @param	materialId	Id of the triangle's material in the G-buffer, or NO_MATERIAL.
+ * @param	x		  	Left column of the quad.
+ * @param	y		  	Bottom row of the quad.
+ * @param	coverage  	Bit i set ==> pixel i of the quad is inside the triangle.
+ * @param	e		  	Oriented edge functions at the quad's pixels.
+ */
+
+static void shadeQuad(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const LightBlock &lights,
+						const VertexData &v0, const VertexData &v1, const VertexData &v2,
+						const TriangleSetup &setup, int materialId,
+						int x, int y, int coverage, const float e[3][4]) {
+	FragmentQuad quad;
+	quad.coverage = coverage;
+	for (int lane = 0; lane < 4; lane++) {
+		float alpha = e[0][lane] * setup.invArea[0];
+		float beta = e[1][lane] * setup.invArea[1];
+		float gamma = e[2][lane] * setup.invArea[2];
+
+		// Interpolate vertex attributes using alpha, beta, and gamma weights
+		Fragment &fragment = quad.fragments[lane];
+		fragment.materialId = materialId;
+		if (materialId == NO_MATERIAL && (coverage & (1 << lane)) != 0) {
+			fragment.material = barycentricWeighting(alpha, beta, gamma,
+													v0.material, v1.material, v2.material);
+		}
+		fragment.worldNormal = barycentricWeighting(alpha, beta, gamma,
+													v0.normal, v1.normal, v2.normal);
+		fragment.worldPosition = barycentricWeighting(alpha, beta, gamma,
+													v0.worldPosition, v1.worldPosition, v2.worldPosition);
+		float z = barycentricWeighting(alpha, beta, gamma,
+										v0.position.z, v1.position.z, v2.position.z);
+		fragment.windowPosition = glm::vec3(x + (lane & 1), y + (lane >> 1), z);
+	}
+	quad.computeDerivatives();
+	FragmentOps::processQuad(frameBuffer, eyePos, lights, quad);
+}
+
+/**
+ * @fn	static void rasterizeTriangle(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const LightBlock &lights, const VertexData &v0, const VertexData &v1, const VertexData &v2, const BoundingBoxi &scissor)
+ * @brief	Draw filled triangle, clipped to a scissor rectangle. The bounding
+ * 			box is walked in 4x4 pixel blocks whose corner edge values are
+ * 			stepped incrementally. Blocks entirely outside an edge are rejected
+ * 			and blocks entirely inside all three edges skip the coverage test.
+ * 			The remaining blocks are tested four pixels of a row at a time.
+ * 			Covered pixels are shaded in 2x2 quads.
+ * 			When depth testing is on, the whole triangle, and then each block,
+ * 			is checked against the framebuffer's hierarchical depth first, so
+ * 			hidden pixels are never interpolated. When FragmentOps::gBuffer is
+ * 			set, the triangle is drawn into it with the given material id.
+ * @param [in,out]	frameBuffer  	Framebuffer.
+ * @param 		  	eyePos		 	Eye position.
+ * @param 		  	lights		 	The lights, prepared for this draw.
+ * @param 		  	v0			 	v0.
+ * @param 		  	v1			 	v1.
+ * @param 		  	v2			 	v2.
+ * @param 		  	scissor		 	Inclusive pixel rectangle to draw within. Must lie within the window.
+ * @param 		  	materialId	 	Id of the triangle's material in the G-buffer, or NO_MATERIAL.
+ */
+
+static void rasterizeTriangle(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const LightBlock &lights,
+								const VertexData &v0, const VertexData &v1, const VertexData &v2,
+								const BoundingBoxi &scissor, int materialId) {
+	const int BLOCK = 4;
+	TriangleSetup setup;
+	if (!setupTriangle(scissor, v0, v1, v2, setup)) {
+		return;
+	}
+
+	// Window z is linear in x and y: z = zA * x + zB * y + zC.
+	const bool useHiZ = FragmentOps::performDepthTest;
+	const float triMinZ = min(v0.position.z, v1.position.z, v2.position.z);
+	const float z[3] = { v0.position.z, v1.position.z, v2.position.z };
+	float zA = 0.0f, zB = 0.0f, zC = 0.0f;
+	for (int i = 0; i < 3; i++) {
+		const float w = z[i] * setup.sign[i] * setup.invArea[i];
+		zA += w * setup.A[i];
+		zB += w * setup.B[i];
+		zC += w * (setup.P[i] - setup.Q[i]);
+	}
+	// Interpolated fragment depths can come out slightly below both triMinZ and
+	// the plane's minimum, so every bound is lowered by the margin after it is
+	// taken; a block is only rejected if each fragment would fail Z < depth.
+	const float zMargin = 1.0e-5f * (1.0f + std::abs(zA) * (setup.xMax + BLOCK) +
+									std::abs(zB) * (setup.yMax + BLOCK) + std::abs(zC));
+	const float zMinOffset = std::min(0.0f, (BLOCK - 1) * zA) + std::min(0.0f, (BLOCK - 1) * zB);
+	if (useHiZ && frameBuffer.isOccluded(setup.xMin, setup.yMin, setup.xMax, setup.yMax, triMinZ - zMargin)) {
+		return;
+	}
+
+	// Per edge: the offsets to the block corners where the oriented edge function
+	// is largest and smallest, and the tie rule as a mask.
+	float rejectOffset[3], acceptOffset[3];
+	__m128 tieMask[3];
+	for (int i = 0; i < 3; i++) {
+		const float A = setup.sign[i] * setup.A[i], B = setup.sign[i] * setup.B[i];
+		rejectOffset[i] = std::max(0.0f, (BLOCK - 1) * A) + std::max(0.0f, (BLOCK - 1) * B) + setup.margin;
+		acceptOffset[i] = std::min(0.0f, (BLOCK - 1) * A) + std::min(0.0f, (BLOCK - 1) * B) - setup.margin;
+		tieMask[i] = _mm_castsi128_ps(_mm_set1_epi32(setup.acceptZero[i] ? -1 : 0));
+	}
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 laneX = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	const __m128i laneXi = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i colLo = _mm_set1_epi32(setup.xMin - 1);
+	const __m128i colHi = _mm_set1_epi32(setup.xMax + 1);
+
+	const int bx0 = setup.xMin & ~(BLOCK - 1);
+	const int by0 = setup.yMin & ~(BLOCK - 1);
+	for (int by = by0; by <= setup.yMax; by += BLOCK) {
+		// Oriented edge functions at the lower left corner of the first block in this row
+		float corner[3];
+		for (int i = 0; i < 3; i++) {
+			corner[i] = setup.sign[i] * (setup.A[i] * bx0 + setup.B[i] * by + setup.P[i] - setup.Q[i]);
+		}
+		for (int bx = bx0; bx <= setup.xMax; bx += BLOCK) {
+			bool reject = false, accept = true;
+			for (int i = 0; i < 3; i++) {
+				reject = reject || corner[i] + rejectOffset[i] < 0.0f;
+				accept = accept && corner[i] + acceptOffset[i] > 0.0f;
+				corner[i] += setup.sign[i] * BLOCK * setup.A[i];
+			}
+			if (reject) {
+				continue;
+			}
+			if (useHiZ) {
+				const float blockMinZ = std::max(triMinZ, zA * bx + zB * by + zC + zMinOffset) - zMargin;
+				if (frameBuffer.isOccluded(bx, by, bx + BLOCK - 1, by + BLOCK - 1, blockMinZ)) {
+					continue;
+				}
+			}
+
+			// Only pixels inside the clipped bounding box are drawn.
+			__m128i x4i = _mm_add_epi32(_mm_set1_epi32(bx), laneXi);
+			const int colBits = _mm_movemask_ps(_mm_castsi128_ps(
+									_mm_and_si128(_mm_cmpgt_epi32(x4i, colLo), _mm_cmplt_epi32(x4i, colHi))));
+			const __m128 x4 = _mm_add_ps(_mm_set1_ps((float)bx), laneX);
+			__m128 Ax[3];
+			for (int i = 0; i < 3; i++) {
+				Ax[i] = _mm_mul_ps(_mm_set1_ps(setup.A[i]), x4);
+			}
+
+			// Two rows at a time, which are then split into 2x2 quads.
+			for (int qy = by; qy < by + BLOCK; qy += 2) {
+				if (qy > setup.yMax || qy + 1 < setup.yMin) {
+					continue;
+				}
+				float rowE[2][3][4];
+				int rowBits[2];
+				for (int r = 0; r < 2; r++) {
+					const int y = qy + r;
+					__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+					for (int i = 0; i < 3; i++) {
+						__m128 f = _mm_add_ps(Ax[i], _mm_set1_ps(setup.B[i] * y));
+						f = _mm_sub_ps(_mm_add_ps(f, _mm_set1_ps(setup.P[i])), _mm_set1_ps(setup.Q[i]));
+						const __m128 e = _mm_mul_ps(f, _mm_set1_ps(setup.sign[i]));
+						__m128 onEdge = _mm_and_ps(_mm_cmpeq_ps(e, zero), tieMask[i]);
+						inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(e, zero), onEdge));
+						_mm_storeu_ps(rowE[r][i], e);
+					}
+					const bool rowInBox = y >= setup.yMin && y <= setup.yMax;
+					rowBits[r] = rowInBox ? colBits & (accept ? 0xF : _mm_movemask_ps(inside)) : 0;
+				}
+				if ((rowBits[0] | rowBits[1]) == 0) {
+					continue;
+				}
+				for (int qx = 0; qx < BLOCK; qx += 2) {
+					const int coverage = ((rowBits[0] >> qx) & 3) | (((rowBits[1] >> qx) & 3) << 2);
+					if (coverage == 0) {
+						continue;
+					}
+					float e[3][4];
+					for (int i = 0; i < 3; i++) {
+						e[i][0] = rowE[0][i][qx];
+						e[i][1] = rowE[0][i][qx + 1];
+						e[i][2] = rowE[1][i][qx];
+						e[i][3] = rowE[1][i][qx + 1];
+					}
+					shadeQuad(frameBuffer, eyePos, lights, v0, v1, v2, setup, materialId, bx + qx, qy, coverage, e);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @fn	static const int *findTriangleMaterials(const std::vector<VertexData> &vertices, std::vector<int> &ids)
+ * @brief	When shading is deferred, gets the G-buffer id of each triangle's
+ * 			material, taken from its first vertex. This is done once per draw,
+ * 			before rasterizing, so the triangles, possibly rasterized in
+ * 			parallel, neither search the table nor lock it. Successive triangles
+ * 			with the same material share one lookup.
+ * @param 		  	vertices	The vector of vertice-triplets.
+ * @param [in,out]	ids			Receives an id per triangle.
+ * @return	The ids, or nullptr when shading is not deferred.
+ */
+
+static const int *findTriangleMaterials(const std::vector<VertexData> &vertices, std::vector<int> &ids) {
+	GBuffer *gBuffer = FragmentOps::gBuffer;
+	if (gBuffer == nullptr) {
+		return nullptr;
+	}
+	ids.clear();
+	const Material *previous = nullptr;
+	int id = NO_MATERIAL;
+	for (int i = 0; i < (int)vertices.size() - 2; i += 3) {
+		const Material &material = vertices[i].material;
+		if (previous == nullptr || std::memcmp(previous, &material, sizeof(Material)) != 0) {
+			id = gBuffer->findOrAddMaterial(material);
+			previous = &material;
+		}
+		ids.push_back(id);
+	}
+	return ids.data();
+}
+
 /**
  * @fn	void drawFilledTriangle(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights, const VertexData &v0, const VertexData &v1, const VertexData &v2, const glm::mat4 &viewingMatrix)
- * @brief	Draw filled triangle.
+ * @brief	Draw filled triangle, clipped to the window.
  * @param [in,out]	frameBuffer  	Framebuffer.
  * @param 		  	eyePos		 	Eye position.
  * @param 		  	lights		 	Vector of lights in scene.
@@ -594,47 +899,31 @@ static inline float f20(const VertexData &v0, const VertexData &v1, const Vertex
 void drawFilledTriangle(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights,
 						const VertexData &v0, const VertexData &v1, const VertexData &v2,
 						const glm::mat4 &viewingMatrix) {
-	// Find minimimum and maximum x and y limits for the triangle
-	float xMin = glm::floor(min(v0.position.x, v1.position.x, v2.position.x));
-	float xMax = glm::ceil(max(v0.position.x, v1.position.x, v2.position.x));
-	float yMin = glm::floor(min(v0.position.y, v1.position.y, v2.position.y));
-	float yMax = glm::ceil(max(v0.position.y, v1.position.y, v2.position.y));
+	BoundingBoxi window(0, frameBuffer.getWindowWidth() - 1, 0, frameBuffer.getWindowHeight() - 1);
+	drawFilledTriangle(frameBuffer, eyePos, lights, v0, v1, v2, viewingMatrix, window);
+}
 
-	float fAlpha = f12(v0, v1, v2, v0.position.x, v0.position.y);
-	float fBeta = f20(v0, v1, v2, v1.position.x, v1.position.y);
-	float fGamma = f01(v0, v1, v2, v2.position.x, v2.position.y);
+/**
+ * @fn	void drawFilledTriangle(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights, const VertexData &v0, const VertexData &v1, const VertexData &v2, const glm::mat4 &viewingMatrix, const BoundingBoxi &scissor)
+ * @brief	Draw filled triangle, clipped to a scissor rectangle.
+ * @param [in,out]	frameBuffer  	Framebuffer.
+ * @param 		  	eyePos		 	Eye position.
+ * @param 		  	lights		 	Vector of lights in scene.
+ * @param 		  	v0			 	v0.
+ * @param 		  	v1			 	v1.
+ * @param 		  	v2			 	v2.
+ * @param 		  	viewingMatrix	Viewing matrix.
+ * @param 		  	scissor		 	Inclusive pixel rectangle to draw within. Must lie within the window.
+ */
 
-	for (float y = yMin; y <= yMax; y++) {
-		for (float x = xMin; x <= xMax; x++) {	
-			// Calculate the weights for Gouraud inperpolation
-			// If any weight is negative, the fragment is not in the triangle
-			float alpha = f12(v0, v1, v2, x, y) / fAlpha;
-			float beta = f20(v0, v1, v2, x, y) / fBeta;
-			float gamma = f01(v0, v1, v2, x, y) / fGamma;
-
-			// Determine if the pixel position is inside the triangle
-			if (alpha >= 0 && beta >= 0 && gamma >= 0) {
-				if ((alpha > 0 || fAlpha * f12(v0, v1, v2, -1, -1) > 0) &&
-					(beta > 0 || fBeta * f20(v0, v1, v2, -1, -1) > 0) &&
-					(gamma > 0 || fGamma * f01(v0, v1, v2, -1, -1) > 0)) {
-
-					Fragment fragment;
-
-					// Interpolate vertex attributes using alpha, beta, and gamma weights
-					fragment.material = barycentricWeighting(alpha, beta, gamma,
-															v0.material, v1.material, v2.material);
-					fragment.worldNormal = barycentricWeighting(alpha, beta, gamma,
-																v0.normal, v1.normal, v2.normal);
-					fragment.worldPosition = barycentricWeighting(alpha, beta, gamma,
-																v0.worldPosition, v1.worldPosition, v2.worldPosition);
-					float z = barycentricWeighting(alpha, beta, gamma,
-													v0.position.z, v1.position.z, v2.position.z);
-					fragment.windowPosition = glm::vec3(x, y, z);
-					FragmentOps::processFragment(frameBuffer, eyePos, lights, fragment, viewingMatrix);
-				}
-			}
-		}
-	}
+void drawFilledTriangle(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights,
+						const VertexData &v0, const VertexData &v1, const VertexData &v2,
+						const glm::mat4 &viewingMatrix, const BoundingBoxi &scissor) {
+	static thread_local LightBlock lightBlock;
+	lightBlock.prepare(lights, viewingMatrix);
+	const int materialId = FragmentOps::gBuffer != nullptr ?
+							FragmentOps::gBuffer->findOrAddMaterial(v0.material) : NO_MATERIAL;
+	rasterizeTriangle(frameBuffer, eyePos, lightBlock, v0, v1, v2, scissor, materialId);
 }
 
 /**
@@ -650,10 +939,123 @@ void drawFilledTriangle(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const
 void drawManyFilledTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, 
 							const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices,
 							const glm::mat4 &viewingMatrix) {
+	BoundingBoxi window(0, frameBuffer.getWindowWidth() - 1, 0, frameBuffer.getWindowHeight() - 1);
+	drawManyFilledTriangles(frameBuffer, eyePos, lights, vertices, viewingMatrix, window);
+}
+
+/**
+ * @fn	void drawManyFilledTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices, const glm::mat4 &viewingMatrix, const BoundingBoxi &scissor)
+ * @brief	Draw many filled triangles, clipped to a scissor rectangle.
+ * @param [in,out]	frameBuffer  	Framebuffer.
+ * @param 		  	eyePos		 	Eye position.
+ * @param 		  	lights		 	Vector of lights in scene.
+ * @param 		  	vertices	 	The vector of vertice-triplets.
+ * @param 		  	viewingMatrix	Viewing matrix.
+ * @param 		  	scissor		 	Inclusive pixel rectangle to draw within. Must lie within the window.
+ */
+
+void drawManyFilledTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
+							const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices,
+							const glm::mat4 &viewingMatrix, const BoundingBoxi &scissor) {
+	static thread_local LightBlock lightBlock;
+	static thread_local std::vector<int> materialIds;
+	lightBlock.prepare(lights, viewingMatrix);
+	const int *ids = findTriangleMaterials(vertices, materialIds);
 	for (int i = 0; i < (int)vertices.size() - 2; i += 3) {
 		const VertexData &Vi = vertices[i];
 		const VertexData &Vi1 = vertices[i+1];
 		const VertexData &Vi2 = vertices[i+2];
-		drawFilledTriangle(frameBuffer, eyePos, lights, Vi, Vi1, Vi2, viewingMatrix);
+		rasterizeTriangle(frameBuffer, eyePos, lightBlock, Vi, Vi1, Vi2, scissor,
+							ids != nullptr ? ids[i / 3] : NO_MATERIAL);
 	}
+}
+
+/**
+ * @fn	void drawManyFilledTrianglesBinned(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices, const glm::mat4 &viewingMatrix, ThreadPool &pool)
+ * @brief	Draw many filled triangles using a sort-middle approach. Each triangle
+ * 			is first binned into the BIN_SIZE x BIN_SIZE screen tiles its bounding
+ * 			box overlaps. Then the tiles are rasterized in parallel, each one
+ * 			scissored to its own region of the framebuffer. Triangles are binned
+ * 			in submission order, so draw order within a tile is preserved.
+ * @param [in,out]	frameBuffer  	Framebuffer.
+ * @param 		  	eyePos		 	Eye position.
+ * @param 		  	lights		 	Vector of lights in scene.
+ * @param 		  	vertices	 	The vector of vertice-triplets.
+ * @param 		  	viewingMatrix	Viewing matrix.
+ * @param [in,out]	pool		 	Threads to rasterize with.
+ */
+
+void drawManyFilledTrianglesBinned(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
+									const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices,
+									const glm::mat4 &viewingMatrix, ThreadPool &pool) {
+	BoundingBoxi window(0, frameBuffer.getWindowWidth() - 1, 0, frameBuffer.getWindowHeight() - 1);
+	drawManyFilledTrianglesBinned(frameBuffer, eyePos, lights, vertices, viewingMatrix, pool, window);
+}
+
+/**
+ * @fn	void drawManyFilledTrianglesBinned(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices, const glm::mat4 &viewingMatrix, ThreadPool &pool, const BoundingBoxi &scissor)
+ * @brief	Draw many filled triangles in parallel screen tiles, clipped to a
+ * 			scissor rectangle.
+ * @param [in,out]	frameBuffer  	Framebuffer.
+ * @param 		  	eyePos		 	Eye position.
+ * @param 		  	lights		 	Vector of lights in scene.
+ * @param 		  	vertices	 	The vector of vertice-triplets.
+ * @param 		  	viewingMatrix	Viewing matrix.
+ * @param [in,out]	pool		 	Threads to rasterize with.
+ * @param 		  	scissor		 	Inclusive pixel rectangle to draw within. Must lie within the window.
+ */
+
+void drawManyFilledTrianglesBinned(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
+									const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices,
+									const glm::mat4 &viewingMatrix, ThreadPool &pool, const BoundingBoxi &scissor) {
+	const int W = scissor.rx + 1;
+	const int H = scissor.ry + 1;
+	const int binsX = (W + BIN_SIZE - 1) / BIN_SIZE;
+	const int binsY = (H + BIN_SIZE - 1) / BIN_SIZE;
+
+	// Reused from call to call. The workers must see the caller's copy, so
+	// they reach it through the reference rather than the thread_local.
+	static thread_local std::vector<std::vector<int>> callerBins;
+	static thread_local LightBlock callerLights;
+	static thread_local std::vector<int> callerMaterialIds;
+	std::vector<std::vector<int>> &bins = callerBins;
+	LightBlock &lightBlock = callerLights;
+	lightBlock.prepare(lights, viewingMatrix);
+	const int *ids = findTriangleMaterials(vertices, callerMaterialIds);
+	bins.resize(binsX * binsY);
+	for (std::vector<int> &bin : bins) {
+		bin.clear();
+	}
+
+	for (int i = 0; i < (int)vertices.size() - 2; i += 3) {
+		const glm::vec4 &p0 = vertices[i].position;
+		const glm::vec4 &p1 = vertices[i + 1].position;
+		const glm::vec4 &p2 = vertices[i + 2].position;
+		int x0 = std::max(0, (int)glm::floor(min(p0.x, p1.x, p2.x)) / BIN_SIZE);
+		int x1 = std::min(binsX - 1, (int)glm::ceil(max(p0.x, p1.x, p2.x)) / BIN_SIZE);
+		int y0 = std::max(0, (int)glm::floor(min(p0.y, p1.y, p2.y)) / BIN_SIZE);
+		int y1 = std::min(binsY - 1, (int)glm::ceil(max(p0.y, p1.y, p2.y)) / BIN_SIZE);
+		for (int by = y0; by <= y1; by++) {
+			for (int bx = x0; bx <= x1; bx++) {
+				bins[by * binsX + bx].push_back(i);
+			}
+		}
+	}
+
+	pool.parallelFor(binsX * binsY, [&](int b) {
+		const std::vector<int> &bin = bins[b];
+		if (bin.empty()) {
+			return;
+		}
+		const int bx = b % binsX, by = b / binsX;
+		BoundingBoxi tile(std::max(scissor.lx, bx * BIN_SIZE), std::min(W, (bx + 1) * BIN_SIZE) - 1,
+						std::max(scissor.ly, by * BIN_SIZE), std::min(H, (by + 1) * BIN_SIZE) - 1);
+		if (tile.lx > tile.rx || tile.ly > tile.ry) {
+			return;
+		}
+		for (int i : bin) {
+			rasterizeTriangle(frameBuffer, eyePos, lightBlock, vertices[i], vertices[i + 1], vertices[i + 2], tile,
+								ids != nullptr ? ids[i / 3] : NO_MATERIAL);
+		}
+	});
 }
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include "Defs.h"
 #include "FragmentOps.h"
 #include "VertexData.h"
+#include "ThreadPool.h"
+
+const int BIN_SIZE = 64;		//!< Width and height of the screen tiles used by the binned rasterizer.
 
 void drawAxisOnWindow(FrameBuffer &frameBuffer);
 void drawWirePolygon(FrameBuffer &frameBuffer, const std::vector<glm::vec3> &pts, const color &rgb);
@@ -17,13 +20,24 @@ void drawManyLines(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
 					const glm::mat4 &viewingMatrix);
 void drawWireFrameTriangle(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights, const VertexData &v0, const VertexData &v1, const VertexData &v2,
 							const glm::mat4 &viewingMatrix);
-void drawFilledTriangle(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, std::vector<LightSourcePtr> &lights, const VertexData &v0, const VertexData &v1, const VertexData &v2,
+void drawFilledTriangle(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights, const VertexData &v0, const VertexData &v1, const VertexData &v2,
 						const glm::mat4 &viewingMatrix);
+void drawFilledTriangle(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights, const VertexData &v0, const VertexData &v1, const VertexData &v2,
+						const glm::mat4 &viewingMatrix, const BoundingBoxi &scissor);
 void drawManyWireFrameTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, 
 								const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices,
 								const glm::mat4 &viewingMatrix);
 void drawManyFilledTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
 							const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices,
 								const glm::mat4 &viewingMatrix);
+void drawManyFilledTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
+							const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices,
+							const glm::mat4 &viewingMatrix, const BoundingBoxi &scissor);
+void drawManyFilledTrianglesBinned(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
+									const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices,
+									const glm::mat4 &viewingMatrix, ThreadPool &pool);
+void drawManyFilledTrianglesBinned(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
+									const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &vertices,
+									const glm::mat4 &viewingMatrix, ThreadPool &pool, const BoundingBoxi &scissor);
 void drawArc(FrameBuffer &fb, const glm::vec2 &center, float R,
 	float startRads, float lengthInRads, const color &rgb);
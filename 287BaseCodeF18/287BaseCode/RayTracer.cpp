@@ -1,5 +1,9 @@
+#include <vector>
+#include <chrono>
 #include "RayTracer.h"
 #include "IShape.h"
+#include "MappedImage.h"
+#include "ThreadPool.h"
 
 /**
  * @fn	RayTracer::RayTracer(const color &defa)
@@ -9,11 +13,49 @@
 
 RayTracer::RayTracer(const color &defa)
 	: defaultColor(defa) {
+	anti_aliasing = 1;
+	progressive = false;
+	showFrames = true;
+	stats = nullptr;
 }
 
+/**
+ * @fn	static double getSeconds()
+ * @brief	Reads a monotonic clock.
+ * @return	Seconds since some fixed point in the past.
+ */
+
+static double getSeconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @fn	RenderView::RenderView(RaytracingCamera *camera, int left, int bottom, int width, int height)
+ * @brief	Constructs a view.
+ * @param	camera	The view's camera.
+ * @param	left  	Left column of the viewport.
+ * @param	bottom	Bottom row of the viewport.
+ * @param	width 	Width of the viewport.
+ * @param	height	Height of the viewport.
+ */
+
+RenderView::RenderView(RaytracingCamera *camera, int left, int bottom, int width, int height)
+	: camera(camera), left(left), bottom(bottom), width(width), height(height) {
+}
+
+/**
+ * @struct	ViewTile
+ * @brief	One tile of one view; the unit of work handed to the threads.
+ */
+
+struct ViewTile {
+	int view;		//!< Index of the view
+	int x0, y0;		//!< Lower left of the tile, relative to the view's viewport
+};
+
 /**
  * @fn	void RayTracer::raytraceScene(FrameBuffer &frameBuffer, int depth, const IScene &theScene) const
- * @brief	Raytrace scene
+ * @brief	Raytrace scene through its camera, into the whole window.
  * @param [in,out]	frameBuffer	Framebuffer.
  * @param 		  	depth	   	The current depth of recursion.
  * @param 		  	theScene   	The scene.
@@ -21,61 +63,325 @@ RayTracer::RayTracer(const color &defa)
 
 void RayTracer::raytraceScene(FrameBuffer &frameBuffer, int depth,
 								const IScene &theScene) const {
-	// anti-aliasing should be done here
-	const RaytracingCamera &camera = *theScene.camera;
-	const std::vector<VisibleIShapePtr> &objs = theScene.visibleObjects;
-	const std::vector<PositionalLightPtr> &lights = theScene.lights;
-
-	
-	if (!myTwoViewOn) {
-		for (int y = 0; y < frameBuffer.getWindowHeight(); y++) {
-			for (int x = 0; x < frameBuffer.getWindowWidth(); x++) {
-
-				if (anti_aliasing == 1) {
-					Ray ray = camera.getRay((float)x, (float)y);
-					color colorForPixel = traceIndividualRay(ray, theScene, depth);
-					frameBuffer.setColor(x, y, colorForPixel);
-				}
-				else {
-					// assume the anti-aliasing is 2
-					Ray ray1 = camera.getRay((float)(x - 0.25f), (float)(y + 0.25f));
-					color colorForPixel1 = traceIndividualRay(ray1, theScene, depth);
-					//frameBuffer.setColor(x, y, colorForPixel);
-					Ray ray2 = camera.getRay((float)(x + 0.25f), (float)(y + 0.25f));
-					color colorForPixel2 = traceIndividualRay(ray2, theScene, depth);
-					//frameBuffer.setColor(x, y, colorForPixel);
-					Ray ray3 = camera.getRay((float)(x - 0.25f), (float)(y - 0.25f));
-					color colorForPixel3 = traceIndividualRay(ray3, theScene, depth);
-					//frameBuffer.setColor(x, y, colorForPixel);
-					Ray ray4 = camera.getRay((float)(x + 0.25f), (float)(y + 0.25f));
-					color colorForPixel4 = traceIndividualRay(ray4, theScene, depth);
-					color avarageColor = (colorForPixel1 + colorForPixel2 + colorForPixel3 + colorForPixel4) / 4.0f;
-					frameBuffer.setColor(x, y, avarageColor);
+	std::vector<RenderView> views;
+	views.push_back(RenderView(theScene.camera, 0, 0, frameBuffer.getWindowWidth(), frameBuffer.getWindowHeight()));
+	raytraceViews(frameBuffer, depth, theScene, views);
+}
+
+/**
+ * @fn	void RayTracer::raytraceViews(FrameBuffer &frameBuffer, int depth, const IScene &theScene, const std::vector<RenderView> &views) const
+ * @brief	Raytraces the scene through several views in one pass, e.g., a stereo
+ * 			pair, split screen, or the faces of a cube map. The views share the
+ * 			scene's hierarchies and textures. The tiles of all views are
+ * 			handed to the shared thread pool together, so a view that is cheap
+ * 			to trace does not leave threads idle. Each camera's viewing
+ * 			parameters are set for its viewport; the cameras are not otherwise
+ * 			changed, so views need their own cameras, and viewports must not
+ * 			overlap.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	depth	   	The current depth of recursion.
+ * @param 		  	theScene   	The scene.
+ * @param 		  	views	   	The views.
+ */
+
+void RayTracer::raytraceViews(FrameBuffer &frameBuffer, int depth, const IScene &theScene,
+								const std::vector<RenderView> &views) const {
+	const double setupStart = getSeconds();
+	if (stats != nullptr) {
+		stats->clear();
+		stats->numViews = (int)views.size();
+	}
+	if (!progressive) {
+		frameBuffer.clearAccumBuffer();
+	}
+
+	std::vector<ViewTile> tiles;
+	for (unsigned int i = 0; i < views.size(); i++) {
+		const RenderView &view = views[i];
+		view.camera->calculateViewingParameters(view.width, view.height);
+		for (int y0 = 0; y0 < view.height; y0 += RAY_TILE_SIZE) {
+			for (int x0 = 0; x0 < view.width; x0 += RAY_TILE_SIZE) {
+				ViewTile tile = { (int)i, x0, y0 };
+				tiles.push_back(tile);
+			}
+		}
+	}
+
+	const double traceStart = getSeconds();
+	ThreadPool::getShared().parallelFor((int)tiles.size(), [&](int i) {
+		const ViewTile &tile = tiles[i];
+		const RenderView &view = views[tile.view];
+		const int cols = std::min(RAY_TILE_SIZE, view.width - tile.x0);
+		const int rows = std::min(RAY_TILE_SIZE, view.height - tile.y0);
+		color colors[RAY_TILE_SIZE * RAY_TILE_SIZE];
+		traceTile(*view.camera, tile.x0, tile.y0, cols, rows, depth, theScene, colors);
+		for (int r = 0; r < rows; r++) {
+			for (int c = 0; c < cols; c++) {
+				frameBuffer.addSample(view.left + tile.x0 + c, view.bottom + tile.y0 + r, colors[r * cols + c]);
+			}
+		}
+	});
+
+	const double resolveStart = getSeconds();
+	frameBuffer.resolveAccumBuffer(toneMapParams);
+	const double displayStart = getSeconds();
+	if (showFrames) {
+		frameBuffer.showColorBuffer();
+	}
+	if (stats != nullptr) {
+		stats->setupSeconds = traceStart - setupStart;
+		stats->traceSeconds = resolveStart - traceStart;
+		stats->resolveSeconds = displayStart - resolveStart;
+		stats->displaySeconds = getSeconds() - displayStart;
+	}
+}
+
+/**
+ * @fn	void RayTracer::raytraceRects(FrameBuffer &frameBuffer, int depth, const IScene &theScene, const std::vector<BoundingBoxi> &rects) const
+ * @brief	Traces only the pixels in a list of rectangles again, leaving the rest
+ * 			of the frame as it is; e.g., after a small object moved. The
+ * 			rectangles are cut along the tile grid, the pieces falling in each
+ * 			tile are merged, so no pixel is traced twice, and the tiles are
+ * 			traced in parallel. The old samples of those pixels are discarded,
+ * 			even when progressive. The cost is proportional to the area traced.
+ * @param [in,out]	frameBuffer	Framebuffer holding the previous frame.
+ * @param 		  	depth	   	The current depth of recursion.
+ * @param 		  	theScene   	The scene.
+ * @param 		  	rects	   	The rectangles, inclusive; they may overlap or
+ * 								extend past the window.
+ */
+
+void RayTracer::raytraceRects(FrameBuffer &frameBuffer, int depth, const IScene &theScene,
+								const std::vector<BoundingBoxi> &rects) const {
+	const double setupStart = getSeconds();
+	if (stats != nullptr) {
+		stats->clear();
+		stats->numViews = 1;
+	}
+	const int W = frameBuffer.getWindowWidth();
+	const int H = frameBuffer.getWindowHeight();
+	const int T = RAY_TILE_SIZE;
+	const int tilesX = (W + T - 1) / T;
+	const int tilesY = (H + T - 1) / T;
+	RaytracingCamera &camera = *theScene.camera;
+	camera.calculateViewingParameters(W, H);
+
+	std::vector<int> jobOfTile((size_t)tilesX * tilesY, -1);
+	std::vector<BoundingBoxi> jobs;
+	for (const BoundingBoxi &rect : rects) {
+		const int lx = std::max(rect.lx, 0), rx = std::min(rect.rx, W - 1);
+		const int ly = std::max(rect.ly, 0), ry = std::min(rect.ry, H - 1);
+		for (int ty = ly / T; ty <= ry / T && ly <= ry; ty++) {
+			for (int tx = lx / T; tx <= rx / T && lx <= rx; tx++) {
+				BoundingBoxi part(std::max(lx, tx * T), std::min(rx, tx * T + T - 1),
+									std::max(ly, ty * T), std::min(ry, ty * T + T - 1));
+				int &job = jobOfTile[ty * tilesX + tx];
+				if (job < 0) {
+					job = (int)jobs.size();
+					jobs.push_back(part);
+				} else {
+					BoundingBoxi &merged = jobs[job];
+					merged.lx = std::min(merged.lx, part.lx);
+					merged.rx = std::max(merged.rx, part.rx);
+					merged.ly = std::min(merged.ly, part.ly);
+					merged.ry = std::max(merged.ry, part.ry);
 				}
 			}
 		}
 	}
-	else {
-		// left one
-		for (int y = 0; y < frameBuffer.getWindowHeight(); y++) {
-			for (int x = 0; x < frameBuffer.getWindowWidth() / 2; x++) {
-				Ray ray = camera.getRay((float)x, (float)y);
-				color colorForPixel = traceIndividualRay(ray, theScene, depth);
-				frameBuffer.setColor(x, y, colorForPixel);
+
+	const double traceStart = getSeconds();
+	ThreadPool::getShared().parallelFor((int)jobs.size(), [&](int i) {
+		const BoundingBoxi &job = jobs[i];
+		const int cols = job.width() + 1;
+		const int rows = job.height() + 1;
+		color colors[RAY_TILE_SIZE * RAY_TILE_SIZE];
+		traceTile(camera, job.lx, job.ly, cols, rows, depth, theScene, colors);
+		frameBuffer.clearAccumBuffer(job);
+		for (int r = 0; r < rows; r++) {
+			for (int c = 0; c < cols; c++) {
+				frameBuffer.addSample(job.lx + c, job.ly + r, colors[r * cols + c]);
 			}
 		}
-		// right one
-		theScene.camera->changeConfiguration(glm::vec3(0, 15, 15), glm::vec3(-8, 2, 3), Y_AXIS);
-		for (int y = 0; y < frameBuffer.getWindowHeight(); y++) {
-			for (int x = frameBuffer.getWindowWidth() / 2; x < frameBuffer.getWindowWidth(); x++) {
-				Ray ray = camera.getRay((float)x, (float)y);
-				color colorForPixel = traceIndividualRay(ray, theScene, depth);
-				frameBuffer.setColor(x, y, colorForPixel);
+	});
+
+	const double resolveStart = getSeconds();
+	for (const BoundingBoxi &job : jobs) {
+		frameBuffer.resolveAccumBuffer(toneMapParams, job);
+	}
+	const double displayStart = getSeconds();
+	if (showFrames) {
+		frameBuffer.showColorBuffer();
+	}
+	if (stats != nullptr) {
+		stats->setupSeconds = traceStart - setupStart;
+		stats->traceSeconds = resolveStart - traceStart;
+		stats->resolveSeconds = displayStart - resolveStart;
+		stats->displaySeconds = getSeconds() - displayStart;
+	}
+}
+
+/**
+ * @fn	void DirtyRegion::addBounds(const RaytracingCamera &camera, const glm::vec3 &lo, const glm::vec3 &hi)
+ * @brief	Adds the pixels whose rays could hit anything inside a box.
+ * @param	camera	The camera, with its viewing parameters set for the window.
+ * @param	lo	  	The box's minimum corner.
+ * @param	hi	  	The box's maximum corner.
+ */
+
+void DirtyRegion::addBounds(const RaytracingCamera &camera, const glm::vec3 &lo, const glm::vec3 &hi) {
+	BoundingBoxi rect(0, 0, 0, 0);
+	if (camera.getWindowBounds(lo, hi, rect)) {
+		rects.push_back(rect);
+	}
+}
+
+/**
+ * @fn	void DirtyRegion::addObject(const RaytracingCamera &camera, const VisibleIShape &object)
+ * @brief	Adds the pixels an object could cover. An unbounded object (e.g., a
+ * 			plane) covers the whole window.
+ * @param	camera	The camera, with its viewing parameters set for the window.
+ * @param	object	The object.
+ */
+
+void DirtyRegion::addObject(const RaytracingCamera &camera, const VisibleIShape &object) {
+	glm::vec3 lo, hi;
+	if (object.shape->getBounds(lo, hi)) {
+		addBounds(camera, lo, hi);
+	} else {
+		addWindow(camera);
+	}
+}
+
+/**
+ * @fn	void DirtyRegion::addWindow(const RaytracingCamera &camera)
+ * @brief	Adds the whole window.
+ * @param	camera	The camera, with its viewing parameters set for the window.
+ */
+
+void DirtyRegion::addWindow(const RaytracingCamera &camera) {
+	rects.push_back(BoundingBoxi(0, (int)camera.nx - 1, 0, (int)camera.ny - 1));
+}
+
+/**
+ * @fn	void RayTracer::traceTile(const RaytracingCamera &camera, int x0, int y0, int cols, int rows, int depth, const IScene &theScene, color *colors) const
+ * @brief	Traces the pixels of a tile. The camera generates all of the tile's
+ * 			rays at once; with anti-aliasing on, four jittered rays are averaged
+ * 			per pixel. If statistics are on, the tile counts into its own
+ * 			counters, merged into stats at the end.
+ * @param	camera		  	The camera.
+ * @param	x0			  	Left column of the tile.
+ * @param	y0			  	Bottom row of the tile.
+ * @param	cols		  	Width of the tile.
+ * @param	rows		  	Height of the tile.
+ * @param	depth		  	The recursion depth.
+ * @param	theScene	  	The scene.
+ * @param [out]	colors	  	Receives the pixels' colors, in row order.
+ */
+
+void RayTracer::traceTile(const RaytracingCamera &camera, int x0, int y0, int cols, int rows,
+							int depth, const IScene &theScene, color *colors) const {
+	static const glm::vec2 center(0.0f, 0.0f);
+	static const glm::vec2 offsets[4] = { glm::vec2(-0.25f, 0.25f), glm::vec2(0.25f, 0.25f),
+										  glm::vec2(-0.25f, -0.25f), glm::vec2(0.25f, -0.25f) };
+	static thread_local RayBlock block;
+	const int numPixels = rows * cols;
+	RenderCounters counters;
+	RenderCounters::current = stats != nullptr ? &counters : nullptr;
+	if (anti_aliasing == 1) {
+		camera.generateRays(x0, y0, cols, rows, &center, 1, block);
+		for (int i = 0; i < numPixels; i++) {
+			colors[i] = traceIndividualRay(block.getRay(i), theScene, camera.cameraFrame, depth);
+		}
+	} else {
+		camera.generateRays(x0, y0, cols, rows, offsets, 4, block);
+		for (int i = 0; i < numPixels; i++) {
+			color result;
+			for (int s = 0; s < 4; s++) {
+				result += traceIndividualRay(block.getRay(4 * i + s), theScene, camera.cameraFrame, depth);
 			}
+			colors[i] = result / 4.0f;
 		}
 	}
+	RenderCounters::current = nullptr;
+	if (stats != nullptr) {
+		counters.primaryRays += block.numRays;
+		stats->merge(counters, numPixels);
+	}
+}
 
-	frameBuffer.showColorBuffer();
+/**
+ * @fn	bool RayTracer::raytraceToFile(const std::string &filename, int width, int height, int depth, const IScene &theScene, int tileSize) const
+ * @brief	Ray traces an image of any size straight into a PPM file. The image is
+ * 			produced one band of tiles at a time: each band is memory mapped,
+ * 			its tiles are traced and tone mapped into it, and it is unmapped.
+ * 			Resident memory is bounded by one band, not the whole image. Pixels
+ * 			are tone mapped with toneMapParams, as on screen. The camera's
+ * 			viewing parameters are set for width x height.
+ * @param	filename	Filename of the output file.
+ * @param	width   	The width of the image.
+ * @param	height  	The height of the image.
+ * @param	depth   	The recursion depth.
+ * @param	theScene	The scene.
+ * @param	tileSize	Width and height of the tiles; must be positive.
+ * @return	True iff the image was written.
+ */
+
+bool RayTracer::raytraceToFile(const std::string &filename, int width, int height, int depth,
+								const IScene &theScene, int tileSize) const {
+	if (tileSize <= 0) {
+		std::cerr << "Tile size must be positive: " << tileSize << std::endl;
+		return false;
+	}
+	double start = getSeconds();
+	if (stats != nullptr) {
+		stats->clear();
+		stats->numViews = 1;
+	}
+	MappedImage image;
+	if (!image.create(filename, width, height)) {
+		return false;
+	}
+	RaytracingCamera &camera = *theScene.camera;
+	camera.calculateViewingParameters(width, height);
+	double setupSeconds = getSeconds() - start;
+	double traceSeconds = 0.0, resolveSeconds = 0.0, displaySeconds = 0.0;
+	ToneMapper toneMapper;
+	toneMapper.prepare(toneMapParams);
+
+	const uint64_t rowBytes = image.getRowBytes();
+	std::vector<color> tile((size_t)tileSize * tileSize);
+	for (int y0 = 0; y0 < height; y0 += tileSize) {
+		const int rows = std::min(tileSize, height - y0);
+		// The file stores the top row first, so this band's top row is the first mapped.
+		const int fileTop = height - (y0 + rows);
+		GLubyte *band = image.mapRows(fileTop, rows);
+		if (band == nullptr) {
+			return false;
+		}
+		for (int x0 = 0; x0 < width; x0 += tileSize) {
+			const int cols = std::min(tileSize, width - x0);
+			start = getSeconds();
+			traceTile(camera, x0, y0, cols, rows, depth, theScene, tile.data());
+			const double traced = getSeconds();
+			for (int r = 0; r < rows; r++) {
+				GLubyte *dest = band + (rows - 1 - r) * rowBytes + (uint64_t)x0 * BYTES_PER_PIXEL;
+				toneMapper.convertToRGB8(&tile[r * cols], dest, cols, x0, y0 + r);
+			}
+			traceSeconds += traced - start;
+			resolveSeconds += getSeconds() - traced;
+		}
+		start = getSeconds();
+		image.unmapRows();
+		displaySeconds += getSeconds() - start;
+	}
+	if (stats != nullptr) {
+		stats->setupSeconds = setupSeconds;
+		stats->traceSeconds = traceSeconds;
+		stats->resolveSeconds = resolveSeconds;
+		stats->displaySeconds = displaySeconds;
+	}
+	return true;
 }
 
 /**
@@ -86,12 +392,12 @@ void RayTracer::raytraceScene(FrameBuffer &frameBuffer, int depth,
  * @return	if the pixel is in shadow
  */
 bool shadowFeeler(const Ray &ray, const IScene &theScene) {
-	HitRecord theHit = VisibleIShape::findIntersection(ray, theScene.visibleObjects);
+	HitRecord theHit = theScene.findIntersection(ray);
 	// distance between light source and object
 	bool inShadow = false;
 	float distance = glm::distance(theHit.interceptPoint, theScene.lights[0]->lightPosition);
 	const Ray &checkRay = Ray(theScene.lights[0]->lightPosition, (theHit.interceptPoint - theScene.lights[0]->lightPosition));
-	HitRecord checkHit = VisibleIShape::findIntersection(checkRay, theScene.visibleObjects);
+	HitRecord checkHit = theScene.findIntersection(checkRay);
 	if (checkHit.t < (distance - EPSILON)
 		) {
 		inShadow = true;
@@ -100,21 +406,68 @@ bool shadowFeeler(const Ray &ray, const IScene &theScene) {
 }
 
 /**
- * @fn	color RayTracer::traceIndividualRay(const Ray &ray, const IScene &theScene, int recursionLevel) const
+ * @fn	static bool isShadowed(const HitRecord &hit, const PositionalLight &light, const IScene &theScene)
+ * @brief	Determines whether a light is blocked from a hit point. No shadow ray
+ * 			is cast for a light that cannot reach the point anyway (e.g., it is
+ * 			off), since it contributes nothing either way.
+ * @param	hit			The hit point.
+ * @param	light   	The light.
+ * @param	theScene	The scene.
+ * @return	True iff something is between the point and the light.
+ */
+
+static bool isShadowed(const HitRecord &hit, const PositionalLight &light, const IScene &theScene) {
+	RenderCounters *counters = RenderCounters::current;
+	if (!light.canReach(hit.interceptPoint)) {
+		if (counters != nullptr) {
+			counters->lightsCulled++;
+		}
+		return false;
+	}
+	if (counters != nullptr) {
+		counters->shadowRays++;
+	}
+	float distance = glm::distance(light.lightPosition, hit.interceptPoint);
+	glm::vec3 dirOfCheckRay = light.lightPosition - hit.interceptPoint;
+	Ray checkRay = Ray(hit.interceptPoint + hit.surfaceNormal * EPSILON, dirOfCheckRay);
+	HitRecord checkHit = theScene.findIntersection(checkRay);
+	return checkHit.t < distance;
+}
+
+/**
+ * @fn	static color fetchTexel(const Image &texture, float u, float v)
+ * @brief	Looks up a texture, counting the fetch.
+ * @param	texture	The texture.
+ * @param	u	   	The u coordinate.
+ * @param	v	   	The v coordinate.
+ * @return	The texel's color.
+ */
+
+static color fetchTexel(const Image &texture, float u, float v) {
+	RenderCounters *counters = RenderCounters::current;
+	if (counters != nullptr) {
+		counters->textureFetches++;
+	}
+	return texture.getPixel(u, v);
+}
+
+/**
+ * @fn	color RayTracer::traceIndividualRay(const Ray &ray, const IScene &theScene, const Frame &eyeFrame, int recursionLevel) const
  * @brief	Trace an individual ray.
  * @param	ray			  	The ray.
  * @param	theScene	  	The scene.
+ * @param	eyeFrame	  	Frame of the camera the ray came from.
  * @param	recursionLevel	The recursion level.
  * @return	The color to be displayed as a result of this ray.
  */
 
-color RayTracer::traceIndividualRay(const Ray &ray, const IScene &theScene, int recursionLevel) const {
+color RayTracer::traceIndividualRay(const Ray &ray, const IScene &theScene, const Frame &eyeFrame,
+										int recursionLevel) const {
 	//if (recursionLevel == 0) {
 		// opaqueHit
-		HitRecord theHit = VisibleIShape::findIntersection(ray, theScene.visibleObjects);
+		HitRecord theHit = theScene.findIntersection(ray);
 		HitRecord transHit = VisibleIShape::findIntersection(ray, theScene.transparentObjects);
 		color result;
-		Frame eyeFrame = theScene.camera->cameraFrame;
 		if (theHit.t < FLT_MAX && transHit.t >= FLT_MAX) { // hit opaqueHit but no hit for transHit
 			if (theHit.texture != nullptr) {
 				float u = glm::clamp(theHit.u, 0.0f, 1.0f);
@@ -123,16 +476,9 @@ color RayTracer::traceIndividualRay(const Ray &ray, const IScene &theScene, int
 				//50 and 50 weright for obj color and texture color
 				for (PositionalLightPtr light : theScene.lights) {
 
-					bool inShadow = false;
-					float distance = glm::distance(light->lightPosition, theHit.interceptPoint);
-					glm::vec3 dirOfCheckRay = light->lightPosition - theHit.interceptPoint;
-					Ray checkRay = Ray(theHit.interceptPoint + theHit.surfaceNormal * EPSILON, dirOfCheckRay);
-					HitRecord checkHit = VisibleIShape::findIntersection(checkRay, theScene.visibleObjects);
-					if (checkHit.t < distance) {
-						inShadow = true;
-					}
-					result += 0.5f * theHit.texture->getPixel(u, v) +
-						0.5f * light->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, eyeFrame, inShadow);
+					bool inShadow = isShadowed(theHit, *light, theScene);
+					result += 0.5f * fetchTexel(*theHit.texture, u, v) +
+						0.5f * light->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.getMaterial(), eyeFrame, inShadow);
 				}
 				//result = 0.5f * theHit.texture->getPixel(u, v) +
 					//0.5f * theScene.lights[0]->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, eyeFrame, shadowFeeler(ray, theScene));
@@ -141,15 +487,8 @@ color RayTracer::traceIndividualRay(const Ray &ray, const IScene &theScene, int
 				//result = theScene.lights[0]->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, eyeFrame, shadowFeeler(ray, theScene));
 				for (PositionalLightPtr light : theScene.lights) {
 
-					bool inShadow = false;
-					float distance = glm::distance(light->lightPosition, theHit.interceptPoint);
-					glm::vec3 dirOfCheckRay = light->lightPosition - theHit.interceptPoint;
-					Ray checkRay = Ray(theHit.interceptPoint + theHit.surfaceNormal * EPSILON, dirOfCheckRay);
-					HitRecord checkHit = VisibleIShape::findIntersection(checkRay, theScene.visibleObjects);
-					if (checkHit.t < distance) {
-						inShadow = true;
-					}
-					result += light->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, eyeFrame, inShadow);
+					bool inShadow = isShadowed(theHit, *light, theScene);
+					result += light->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.getMaterial(), eyeFrame, inShadow);
 				}
 			}
 		}
@@ -157,16 +496,9 @@ color RayTracer::traceIndividualRay(const Ray &ray, const IScene &theScene, int
 			//result = theScene.lights[0]->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, eyeFrame, shadowFeeler(ray, theScene));
 			//result = (1 - transHit.material.alpha) * transHit.material.ambient + transHit.material.alpha * result;
 			for (PositionalLightPtr light : theScene.lights) {
-				bool inShadow = false;
-				float distance = glm::distance(light->lightPosition, theHit.interceptPoint);
-				glm::vec3 dirOfCheckRay = light->lightPosition - theHit.interceptPoint;
-				Ray checkRay = Ray(theHit.interceptPoint + theHit.surfaceNormal * EPSILON, dirOfCheckRay);
-				HitRecord checkHit = VisibleIShape::findIntersection(checkRay, theScene.visibleObjects);
-				if (checkHit.t < distance) {
-					inShadow = true;
-				}
-				result += light->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, eyeFrame, inShadow);
-				result = (1 - transHit.material.alpha) * transHit.material.ambient + transHit.material.alpha * result;
+				bool inShadow = isShadowed(theHit, *light, theScene);
+				result += light->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.getMaterial(), eyeFrame, inShadow);
+				result = (1 - transHit.getMaterial().alpha) * transHit.getMaterial().ambient + transHit.getMaterial().alpha * result;
 			}
 		}
 		else if (theHit.t < FLT_MAX && transHit.t < FLT_MAX) { // hit both
@@ -178,38 +510,24 @@ color RayTracer::traceIndividualRay(const Ray &ray, const IScene &theScene, int
 				//result = 0.5f * theHit.texture->getPixel(u, v) +
 					//0.5f * theScene.lights[0]->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, eyeFrame, shadowFeeler(ray, theScene));
 				for (PositionalLightPtr light : theScene.lights) {
-					bool inShadow = false;
-					float distance = glm::distance(light->lightPosition, theHit.interceptPoint);
-					glm::vec3 dirOfCheckRay = light->lightPosition - theHit.interceptPoint;
-					Ray checkRay = Ray(theHit.interceptPoint + theHit.surfaceNormal * EPSILON, dirOfCheckRay);
-					HitRecord checkHit = VisibleIShape::findIntersection(checkRay, theScene.visibleObjects);
-					if (checkHit.t < distance) {
-						inShadow = true;
-					}
-					result += 0.5f * theHit.texture->getPixel(u, v) +
-						0.5f * light->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, eyeFrame, inShadow);
+					bool inShadow = isShadowed(theHit, *light, theScene);
+					result += 0.5f * fetchTexel(*theHit.texture, u, v) +
+						0.5f * light->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.getMaterial(), eyeFrame, inShadow);
 				}
 				// first hit transparent obj and then opaque
 				if (theHit.t > transHit.t) {
-					result = (1 - transHit.material.alpha) * result + transHit.material.alpha * transHit.material.ambient;
+					result = (1 - transHit.getMaterial().alpha) * result + transHit.getMaterial().alpha * transHit.getMaterial().ambient;
 				}
 			}
 			else {
 				//result = theScene.lights[0]->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, eyeFrame, shadowFeeler(ray, theScene));
 				for (PositionalLightPtr light : theScene.lights) {
-					bool inShadow = false;
-					float distance = glm::distance(light->lightPosition, theHit.interceptPoint);
-					glm::vec3 dirOfCheckRay = light->lightPosition - theHit.interceptPoint;
-					Ray checkRay = Ray(theHit.interceptPoint + theHit.surfaceNormal * EPSILON, dirOfCheckRay);
-					HitRecord checkHit = VisibleIShape::findIntersection(checkRay, theScene.visibleObjects);
-					if (checkHit.t < distance) {
-						inShadow = true;
-					}
-					result += light->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.material, eyeFrame, inShadow);
+					bool inShadow = isShadowed(theHit, *light, theScene);
+					result += light->illuminate(theHit.interceptPoint, theHit.surfaceNormal, theHit.getMaterial(), eyeFrame, inShadow);
 				}
 				// first hit transparent obj and then opaque
 				if (theHit.t > transHit.t) {
-					result = (1 - transHit.material.alpha) * result + transHit.material.alpha * transHit.material.ambient;
+					result = (1 - transHit.getMaterial().alpha) * result + transHit.getMaterial().alpha * transHit.getMaterial().ambient;
 				}
 			}
 		}
@@ -223,11 +541,11 @@ color RayTracer::traceIndividualRay(const Ray &ray, const IScene &theScene, int
 	else {
 		//color result = defaultColor;
 		color result;
-		HitRecord theHit = VisibleIShape::findIntersection(ray, theScene.visibleObjects);
+		HitRecord theHit = theScene.findIntersection(ray);
 		glm::vec3 origin = theHit.interceptPoint;
 		glm::vec3 dir = ray.direction - 2 * glm::dot(ray.direction, theHit.surfaceNormal) * theHit.surfaceNormal;
 		const Ray reflectionRay = Ray(origin, dir);
-		return result += traceIndividualRay(reflectionRay, theScene, recursionLevel - 1);
+		return result += traceIndividualRay(reflectionRay, theScene, eyeFrame, recursionLevel - 1);
 	}
 	*/
 }
\ No newline at end of file
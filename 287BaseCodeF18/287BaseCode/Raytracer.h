@@ -4,6 +4,41 @@
 #include "FrameBuffer.h"
 #include "Camera.h"
 #include "IScene.h"
+#include "RenderStats.h"
+
+const int RAY_TILE_SIZE = 16;		//!< Width and height of the tiles raytraceScene traces.
+
+/**
+ * @struct	RenderView
+ * @brief	A camera and the part of the window it renders into.
+ */
+
+struct RenderView {
+	RaytracingCamera *camera;		//!< The view's camera
+	int left, bottom;				//!< Lower left corner of the viewport
+	int width, height;				//!< Size of the viewport
+	RenderView(RaytracingCamera *camera, int left, int bottom, int width, int height);
+};
+
+/**
+ * @struct	DirtyRegion
+ * @brief	The parts of the window that must be traced again after an edit, for
+ * 			raytraceRects. Rectangles are conservative for what lies within an
+ * 			object's bounds: record an object before and after it moves.
+ * 			Changes elsewhere, such as the shadow or reflection of a moved
+ * 			object, are not covered; add those rectangles (or the window)
+ * 			explicitly.
+ */
+
+struct DirtyRegion {
+	std::vector<BoundingBoxi> rects;	//!< The rectangles, inclusive; they may overlap
+	void addRect(const BoundingBoxi &rect) { rects.push_back(rect); }
+	void addBounds(const RaytracingCamera &camera, const glm::vec3 &lo, const glm::vec3 &hi);
+	void addObject(const RaytracingCamera &camera, const VisibleIShape &object);
+	void addWindow(const RaytracingCamera &camera);
+	bool isEmpty() const { return rects.empty(); }
+	void clear() { rects.clear(); }
+};
 
 /**
  * @struct	RayTracer
@@ -13,10 +48,22 @@
 struct RayTracer {
 	color defaultColor;
 	int anti_aliasing;
-	bool myTwoViewOn;
+	bool progressive;				//!< True ==> keep accumulating samples across frames.
+	ToneMapParams toneMapParams;	//!< Controls how accumulated samples are displayed.
+	bool showFrames;				//!< False ==> leave frames in the framebuffer, e.g., for batch output.
+	RenderStats *stats;				//!< If not null, filled in by each render.
 	RayTracer(const color &defaultColor);
 	void raytraceScene(FrameBuffer &frameBuffer, int depth,
 						const IScene &theScene) const;
+	void raytraceViews(FrameBuffer &frameBuffer, int depth, const IScene &theScene,
+						const std::vector<RenderView> &views) const;
+	void raytraceRects(FrameBuffer &frameBuffer, int depth, const IScene &theScene,
+						const std::vector<BoundingBoxi> &rects) const;
+	bool raytraceToFile(const std::string &filename, int width, int height, int depth,
+						const IScene &theScene, int tileSize = 64) const;
 protected:
-	color traceIndividualRay(const Ray &ray, const IScene &theScene, int recursionLevel) const;
+	void traceTile(const RaytracingCamera &camera, int x0, int y0, int cols, int rows,
+					int depth, const IScene &theScene, color *colors) const;
+	color traceIndividualRay(const Ray &ray, const IScene &theScene, const Frame &eyeFrame,
+								int recursionLevel) const;
 };
@@ -0,0 +1,209 @@
+#include <cctype>
+#include <vector>
+#include <fstream>
+#include <typeinfo>
+#include <typeindex>
+#include "RenderStats.h"
+#include "IShape.h"
+
+thread_local RenderCounters *RenderCounters::current = nullptr;
+
+static std::mutex shapeTypeMutex;						//!< Guards the shape type registry
+static std::vector<std::type_index> shapeTypes;			//!< Shape types seen so far, by index
+static std::vector<std::string> shapeTypeNames;			//!< Their names
+
+/**
+ * @fn	void RenderCounters::clear()
+ * @brief	Sets every count to 0.
+ */
+
+void RenderCounters::clear() {
+	primaryRays = shadowRays = secondaryRays = 0;
+	bvhNodesVisited = textureFetches = lightsCulled = 0;
+	for (int i = 0; i < MAX_SHAPE_TYPES; i++) {
+		shapeTests[i] = shapeHits[i] = 0;
+	}
+}
+
+/**
+ * @fn	void RenderCounters::add(const RenderCounters &other)
+ * @brief	Adds another set of counts to these.
+ * @param	other	The counts to add.
+ */
+
+void RenderCounters::add(const RenderCounters &other) {
+	primaryRays += other.primaryRays;
+	shadowRays += other.shadowRays;
+	secondaryRays += other.secondaryRays;
+	bvhNodesVisited += other.bvhNodesVisited;
+	textureFetches += other.textureFetches;
+	lightsCulled += other.lightsCulled;
+	for (int i = 0; i < MAX_SHAPE_TYPES; i++) {
+		shapeTests[i] += other.shapeTests[i];
+		shapeHits[i] += other.shapeHits[i];
+	}
+}
+
+/**
+ * @fn	int RenderCounters::getShapeType(const IShape &shape)
+ * @brief	Gets the index under which a shape's type is counted, registering the
+ * 			type the first time it is seen. Call while building a scene, not
+ * 			per ray. Types beyond the first MAX_SHAPE_TYPES - 1 share the last
+ * 			index.
+ * @param	shape	The shape.
+ * @return	The index of its type.
+ */
+
+int RenderCounters::getShapeType(const IShape &shape) {
+	const std::type_index type(typeid(shape));
+	std::lock_guard<std::mutex> lock(shapeTypeMutex);
+	for (unsigned int i = 0; i < shapeTypes.size(); i++) {
+		if (shapeTypes[i] == type) {
+			return (int)i;
+		}
+	}
+	if ((int)shapeTypes.size() == MAX_SHAPE_TYPES - 1) {
+		return MAX_SHAPE_TYPES - 1;
+	}
+	// Compilers decorate the name differently, e.g., "struct ISphere" or "7ISphere".
+	std::string name = type.name();
+	if (name.compare(0, 7, "struct ") == 0) {
+		name.erase(0, 7);
+	} else if (name.compare(0, 6, "class ") == 0) {
+		name.erase(0, 6);
+	}
+	size_t digits = 0;
+	while (digits < name.size() && std::isdigit((unsigned char)name[digits])) {
+		digits++;
+	}
+	name.erase(0, digits);
+	shapeTypes.push_back(type);
+	shapeTypeNames.push_back(name);
+	return (int)shapeTypes.size() - 1;
+}
+
+/**
+ * @fn	std::string RenderCounters::getShapeTypeName(int type)
+ * @brief	Gets the name of a shape type.
+ * @param	type	Index of the type.
+ * @return	The name; "Other" for the index that collects the rest.
+ */
+
+std::string RenderCounters::getShapeTypeName(int type) {
+	std::lock_guard<std::mutex> lock(shapeTypeMutex);
+	if (type >= 0 && type < (int)shapeTypeNames.size()) {
+		return shapeTypeNames[type];
+	}
+	return "Other";
+}
+
+/**
+ * @fn	int RenderCounters::getNumShapeTypes()
+ * @brief	Gets the number of indices in use.
+ * @return	The number of shape types seen, plus one if some share the last index.
+ */
+
+int RenderCounters::getNumShapeTypes() {
+	std::lock_guard<std::mutex> lock(shapeTypeMutex);
+	return (int)shapeTypes.size() == MAX_SHAPE_TYPES - 1 ? MAX_SHAPE_TYPES : (int)shapeTypes.size();
+}
+
+/**
+ * @fn	void RenderStats::clear()
+ * @brief	Resets the statistics before a render.
+ */
+
+void RenderStats::clear() {
+	counters.clear();
+	numViews = numTiles = 0;
+	numPixels = 0;
+	setupSeconds = traceSeconds = resolveSeconds = displaySeconds = 0.0;
+}
+
+/**
+ * @fn	void RenderStats::merge(const RenderCounters &tile, int pixels)
+ * @brief	Adds the counts of a finished tile. Safe to call from any thread.
+ * @param	tile  	The tile's counts.
+ * @param	pixels	Pixels in the tile.
+ */
+
+void RenderStats::merge(const RenderCounters &tile, int pixels) {
+	std::lock_guard<std::mutex> lock(mutex);
+	counters.add(tile);
+	numTiles++;
+	numPixels += pixels;
+}
+
+/**
+ * @fn	void RenderStats::writeJSON(std::ostream &os) const
+ * @brief	Writes the statistics as a JSON object. Times are in milliseconds.
+ * @param	os	Output stream.
+ */
+
+void RenderStats::writeJSON(std::ostream &os) const {
+	os << "{" << std::endl;
+	os << "  \"views\": " << numViews << "," << std::endl;
+	os << "  \"tiles\": " << numTiles << "," << std::endl;
+	os << "  \"pixels\": " << numPixels << "," << std::endl;
+	os << "  \"milliseconds\": { \"setup\": " << setupSeconds * 1000.0
+		<< ", \"trace\": " << traceSeconds * 1000.0
+		<< ", \"resolve\": " << resolveSeconds * 1000.0
+		<< ", \"display\": " << displaySeconds * 1000.0
+		<< ", \"total\": " << getTotalSeconds() * 1000.0 << " }," << std::endl;
+	os << "  \"rays\": { \"primary\": " << counters.primaryRays
+		<< ", \"shadow\": " << counters.shadowRays
+		<< ", \"secondary\": " << counters.secondaryRays << " }," << std::endl;
+	os << "  \"bvhNodesVisited\": " << counters.bvhNodesVisited << "," << std::endl;
+	os << "  \"textureFetches\": " << counters.textureFetches << "," << std::endl;
+	os << "  \"lightsCulled\": " << counters.lightsCulled << "," << std::endl;
+	os << "  \"shapes\": {";
+	const int N = RenderCounters::getNumShapeTypes();
+	for (int i = 0; i < N; i++) {
+		os << (i > 0 ? "," : "") << std::endl;
+		os << "    \"" << RenderCounters::getShapeTypeName(i) << "\": { \"tests\": " << counters.shapeTests[i]
+			<< ", \"hits\": " << counters.shapeHits[i] << " }";
+	}
+	os << std::endl << "  }" << std::endl;
+	os << "}" << std::endl;
+}
+
+/**
+ * @fn	bool RenderStats::saveJSON(const std::string &filename) const
+ * @brief	Writes the statistics to a JSON file.
+ * @param	filename	Filename of the output file.
+ * @return	True iff the file was written.
+ */
+
+bool RenderStats::saveJSON(const std::string &filename) const {
+	std::ofstream out(filename.c_str());
+	if (!out) {
+		std::cerr << "Cannot write " << filename << std::endl;
+		return false;
+	}
+	writeJSON(out);
+	return (bool)out;
+}
+
+/**
+ * @fn	std::ostream &operator << (std::ostream &os, const RenderStats &stats)
+ * @brief	Output stream for render statistics: a short summary.
+ * @param	os   	Output stream.
+ * @param	stats	The statistics.
+ * @return	The output stream.
+ */
+
+std::ostream &operator << (std::ostream &os, const RenderStats &stats) {
+	const RenderCounters &c = stats.counters;
+	os << "Render: " << stats.getTotalSeconds() * 1000.0 << " ms (setup " << stats.setupSeconds * 1000.0
+		<< ", trace " << stats.traceSeconds * 1000.0 << ", resolve " << stats.resolveSeconds * 1000.0
+		<< ", display " << stats.displaySeconds * 1000.0 << ")" << std::endl;
+	os << "Rays: " << c.primaryRays << " primary, " << c.shadowRays << " shadow, "
+		<< c.secondaryRays << " secondary; " << c.lightsCulled << " lights culled" << std::endl;
+	os << "BVH nodes visited: " << c.bvhNodesVisited << ", texture fetches: " << c.textureFetches << std::endl;
+	const int N = RenderCounters::getNumShapeTypes();
+	for (int i = 0; i < N; i++) {
+		os << "  " << RenderCounters::getShapeTypeName(i) << ": " << c.shapeTests[i] << " tests, "
+			<< c.shapeHits[i] << " hits" << std::endl;
+	}
+	return os;
+}
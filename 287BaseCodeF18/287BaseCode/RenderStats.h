@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <iostream>
+
+struct IShape;
+
+const int MAX_SHAPE_TYPES = 32;			//!< Distinct shape types that are counted separately.
+
+/**
+ * @struct	RenderCounters
+ * @brief	Event counts of one piece of a render, e.g., one tile. Tracing code
+ * 			counts into the counters of the current thread, if any, so counting
+ * 			costs nothing when statistics are off and needs no locking when on.
+ */
+
+struct RenderCounters {
+	uint64_t primaryRays;						//!< Rays from the camera
+	uint64_t shadowRays;						//!< Rays toward lights
+	uint64_t secondaryRays;						//!< Reflected and refracted rays
+	uint64_t bvhNodesVisited;					//!< Hierarchy nodes popped during traversal
+	uint64_t textureFetches;					//!< Texels looked up
+	uint64_t lightsCulled;						//!< Shadow rays skipped for lights that cannot reach the point
+	uint64_t shapeTests[MAX_SHAPE_TYPES];		//!< Intersection tests, by shape type
+	uint64_t shapeHits[MAX_SHAPE_TYPES];		//!< Tests that hit, by shape type
+	RenderCounters() { clear(); }
+	void clear();
+	void add(const RenderCounters &other);
+	static int getShapeType(const IShape &shape);
+	static std::string getShapeTypeName(int type);
+	static int getNumShapeTypes();
+	static thread_local RenderCounters *current;	//!< Where this thread counts; null when not counting
+};
+
+/**
+ * @struct	RenderStats
+ * @brief	What one call to the ray tracer did and how long each phase took.
+ * 			Each tile counts into its own RenderCounters, which are merged
+ * 			into these when the tile is done.
+ */
+
+struct RenderStats {
+	RenderCounters counters;	//!< Totals over the render
+	int numViews;				//!< Views rendered
+	int numTiles;				//!< Tiles traced
+	uint64_t numPixels;			//!< Pixels traced
+	double setupSeconds;		//!< Clearing, setting up cameras and tiles
+	double traceSeconds;		//!< Tracing rays
+	double resolveSeconds;		//!< Tone mapping and converting pixels
+	double displaySeconds;		//!< Showing or writing the frame
+	RenderStats() { clear(); }
+	void clear();
+	void merge(const RenderCounters &tile, int pixels);
+	double getTotalSeconds() const { return setupSeconds + traceSeconds + resolveSeconds + displaySeconds; }
+	void writeJSON(std::ostream &os) const;
+	bool saveJSON(const std::string &filename) const;
+	friend std::ostream &operator << (std::ostream &os, const RenderStats &stats);
+protected:
+	RenderStats(const RenderStats &);
+	RenderStats &operator = (const RenderStats &);
+	std::mutex mutex;			//!< Guards merging
+};
@@ -0,0 +1,73 @@
+#include <cstdint>
+#include <cstdlib>
+#include "SceneArena.h"
+
+/**
+ * @fn	SceneArena::SceneArena(size_t blockSize)
+ * @brief	Constructs an empty arena. No memory is taken until the first object.
+ * @param	blockSize	Size of each block.
+ */
+
+SceneArena::SceneArena(size_t blockSize)
+	: next(nullptr), end(nullptr), blockSize(blockSize), bytesUsed(0) {
+}
+
+/**
+ * @fn	SceneArena::~SceneArena()
+ * @brief	Destructor. Releases every object.
+ */
+
+SceneArena::~SceneArena() {
+	release();
+}
+
+/**
+ * @fn	void *SceneArena::allocate(size_t size, size_t alignment)
+ * @brief	Hands out memory from the current block, starting a new block if it
+ * 			is full. An object bigger than a block gets a block of its own.
+ * @param	size	 	Bytes needed.
+ * @param	alignment	Alignment needed; a power of 2, at most that of malloc.
+ * @return	The memory.
+ */
+
+void *SceneArena::allocate(size_t size, size_t alignment) {
+	char *p = (char *)(((uintptr_t)next + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	if (next == nullptr || p + size > end) {
+		const size_t bytes = size > blockSize ? size : blockSize;
+		char *block = (char *)std::malloc(bytes);
+		if (block == nullptr) {
+			throw std::bad_alloc();
+		}
+		if (size > blockSize && !blocks.empty()) {
+			// Keep filling the current block; the big one goes in before it.
+			blocks.insert(blocks.end() - 1, block);
+			bytesUsed += size;
+			return block;
+		}
+		blocks.push_back(block);
+		p = block;
+		end = block + bytes;
+	}
+	next = p + size;
+	bytesUsed += size;
+	return p;
+}
+
+/**
+ * @fn	void SceneArena::release()
+ * @brief	Destroys every object, newest first, and frees every block. The arena
+ * 			can be used again afterwards.
+ */
+
+void SceneArena::release() {
+	for (int i = (int)destructors.size() - 1; i >= 0; i--) {
+		destructors[i].destroy(destructors[i].object);
+	}
+	destructors.clear();
+	for (unsigned int i = 0; i < blocks.size(); i++) {
+		std::free(blocks[i]);
+	}
+	blocks.clear();
+	next = end = nullptr;
+	bytesUsed = 0;
+}
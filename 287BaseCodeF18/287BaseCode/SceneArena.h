@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+const size_t ARENA_BLOCK_SIZE = 64 * 1024;		//!< Bytes in each block, unless an object needs more.
+
+/**
+ * @struct	SceneArena
+ * @brief	Owns the objects of a scene (shapes, visible shapes, lights, cameras,
+ * 			textures). Objects are bump allocated one after another in large
+ * 			blocks, so those created together sit together in memory, and all
+ * 			are released at once. Objects needing destructors have them run, in
+ * 			reverse order of creation, when the arena is released.
+ */
+
+struct SceneArena {
+	SceneArena(size_t blockSize = ARENA_BLOCK_SIZE);
+	~SceneArena();
+	void *allocate(size_t size, size_t alignment);
+	void release();
+	size_t getBytesUsed() const { return bytesUsed; }
+	int getNumBlocks() const { return (int)blocks.size(); }
+	template <class T, class... Args> T *create(Args&&... args);
+protected:
+	SceneArena(const SceneArena &);
+	SceneArena &operator = (const SceneArena &);
+	template <class T> static void destroy(void *object) { ((T *)object)->~T(); }
+	/**
+	 * @struct	Destructor
+	 * @brief	An object whose destructor must run when the arena is released.
+	 */
+	struct Destructor {
+		void (*destroy)(void *);		//!< Calls the object's destructor
+		void *object;					//!< The object
+	};
+	std::vector<char *> blocks;			//!< All blocks; the last is the one being filled
+	std::vector<Destructor> destructors;	//!< In order of creation
+	char *next;							//!< Next free byte in the current block
+	char *end;							//!< End of the current block
+	size_t blockSize;					//!< Size of a normal block
+	size_t bytesUsed;					//!< Bytes handed out, not counting alignment
+};
+
+/**
+ * @fn	template <class T, class... Args> T *SceneArena::create(Args&&... args)
+ * @brief	Constructs an object in the arena. The arena owns it; do not delete it.
+ * @param	args	The constructor's arguments.
+ * @return	The new object.
+ */
+
+template <class T, class... Args>
+T *SceneArena::create(Args&&... args) {
+	T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	if (!std::is_trivially_destructible<T>::value) {
+		Destructor d = { &SceneArena::destroy<T>, object };
+		destructors.push_back(d);
+	}
+	return object;
+}
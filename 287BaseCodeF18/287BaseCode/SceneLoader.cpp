@@ -0,0 +1,802 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <cstring>
+#include <sys/stat.h>
+#include "SceneLoader.h"
+#include "MappedImage.h"
+
+/**
+ * @enum	SceneSection
+ * @brief	The arrays stored in a compiled scene file, in file order.
+ */
+
+enum SceneSection {
+	SECTION_MATERIALS, SECTION_TEXTURE_NAMES, SECTION_SHAPES, SECTION_LIGHTS, SECTION_CAMERAS,
+	SECTION_BVH_NODES, SECTION_BVH_INDICES, SECTION_BVH_UNBOUNDED, NUM_SCENE_SECTIONS
+};
+
+// Bytes per element of each section. Texture names are NUL-terminated strings, counted in bytes.
+static const uint64_t SECTION_ELEMENT_BYTES[NUM_SCENE_SECTIONS] = {
+	sizeof(SceneMaterialRecord), 1, sizeof(SceneShapeRecord), sizeof(SceneLightRecord),
+	sizeof(SceneCameraRecord), sizeof(BVHNode), sizeof(int32_t), sizeof(int32_t)
+};
+
+/**
+ * @struct	SceneFileHeader
+ * @brief	The start of a compiled scene file. Each section is 8-byte aligned.
+ */
+
+struct SceneFileHeader {
+	char magic[4];							//!< "RTSC"
+	uint32_t version;						//!< SCENE_FILE_VERSION
+	SceneSourceStamp source;				//!< The text file it was compiled from
+	uint32_t bvhObjects;					//!< Number of opaque shapes the BVH was built for
+	uint32_t counts[NUM_SCENE_SECTIONS];	//!< Elements in each section
+	uint64_t offsets[NUM_SCENE_SECTIONS];	//!< File offset of each section
+};
+
+/**
+ * @struct	SceneRecords
+ * @brief	The records of a scene, wherever they are stored: in a SceneDescription,
+ * 			or in a mapped file.
+ */
+
+struct SceneRecords {
+	const SceneMaterialRecord *materials;
+	int numMaterials;
+	const SceneShapeRecord *shapes;
+	int numShapes;
+	const SceneLightRecord *lights;
+	int numLights;
+	const SceneCameraRecord *cameras;
+	int numCameras;
+};
+
+/**
+ * @struct	ShapeSyntax
+ * @brief	How a kind of shape is written in a text scene file.
+ */
+
+struct ShapeSyntax {
+	const char *keyword;		//!< The first word of the line
+	int numParams;				//!< How many numbers follow it
+};
+
+// Indexed by SceneShapeKind.
+static const ShapeSyntax SHAPE_SYNTAX[NUM_SCENE_SHAPE_KINDS] = {
+	{ "plane", 6 },				// point, normal
+	{ "sphere", 4 },			// center, radius
+	{ "ellipsoid", 6 },			// center, size
+	{ "disk", 7 },				// center, normal, radius
+	{ "rect", 8 },				// center, normal, width, height
+	{ "box", 6 },				// center, size
+	{ "triangle", 9 },			// 3 vertices, counterclockwise
+	{ "cylinderx", 5 },			// center, radius, length
+	{ "cylindery", 5 },
+	{ "cylinderz", 5 },
+	{ "closedcylindery", 5 },
+	{ "coney", 5 }				// center, radius, length
+};
+
+/**
+ * @struct	NamedMaterial
+ * @brief	A material that scene files can use by name without defining it.
+ */
+
+struct NamedMaterial {
+	const char *name;
+	const MaterialPreset *material;
+};
+
+static const NamedMaterial BUILT_IN_MATERIALS[] = {
+	{ "brass", &brass }, { "bronze", &bronze }, { "polishedBronze", &polishedBronze },
+	{ "chrome", &chrome }, { "copper", &copper }, { "polishedCopper", &polishedCopper },
+	{ "gold", &gold }, { "polishedGold", &polishedGold }, { "tin", &tin },
+	{ "silver", &silver }, { "polishedSilver", &polishedSilver },
+	{ "blackPlastic", &blackPlastic }, { "cyanPlastic", &cyanPlastic }, { "greenPlastic", &greenPlastic },
+	{ "redPlastic", &redPlastic }, { "whitePlastic", &whitePlastic }, { "yellowPlastic", &yellowPlastic },
+	{ "blackRubber", &blackRubber }, { "cyanRubber", &cyanRubber }, { "greenRubber", &greenRubber },
+	{ "redRubber", &redRubber }, { "whiteRubber", &whiteRubber }, { "yellowRubber", &yellowRubber },
+	{ "pewter", &pewter }, { "emerald", &emerald }, { "jade", &jade }, { "obsidian", &obsidian },
+	{ "perl", &perl }, { "ruby", &ruby }, { "turquoise", &turquoise }
+};
+
+/**
+ * @struct	NamedColor
+ * @brief	A color that scene files can use by name as an ambient-only material.
+ */
+
+struct NamedColor {
+	const char *name;
+	const color *value;
+};
+
+static const NamedColor BUILT_IN_COLORS[] = {
+	{ "black", &black }, { "red", &red }, { "green", &green }, { "blue", &blue },
+	{ "magenta", &magenta }, { "yellow", &yellow }, { "cyan", &cyan }, { "white", &white },
+	{ "gray", &gray }, { "lightGray", &lightGray }, { "darkGray", &darkGray }
+};
+
+/**
+ * @fn	static bool findBuiltInMaterial(const std::string &name, SceneMaterialRecord &record)
+ * @brief	Looks up a built-in material or color by name.
+ * @param 		  	name  	The name.
+ * @param [in,out]	record	The material, if found.
+ * @return	True iff the name is built in.
+ */
+
+static bool findBuiltInMaterial(const std::string &name, SceneMaterialRecord &record) {
+	for (const NamedMaterial &named : BUILT_IN_MATERIALS) {
+		if (name == named.name) {
+			std::memcpy(record.values, named.material->values, sizeof(record.values));
+			return true;
+		}
+	}
+	for (const NamedColor &named : BUILT_IN_COLORS) {
+		if (name == named.name) {
+			const Material mat(*named.value);
+			const float values[10] = { mat.ambient.r, mat.ambient.g, mat.ambient.b,
+										mat.diffuse.r, mat.diffuse.g, mat.diffuse.b,
+										mat.specular.r, mat.specular.g, mat.specular.b, mat.shininess };
+			std::memcpy(record.values, values, sizeof(values));
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @fn	static bool stampOf(const std::string &filename, SceneSourceStamp &stamp)
+ * @brief	Gets the modification time, size and content hash of a file.
+ * @param 		  	filename	Filename of the file.
+ * @param [in,out]	stamp   	Receives the stamp.
+ * @return	True iff the file exists and could be read.
+ */
+
+static bool stampOf(const std::string &filename, SceneSourceStamp &stamp) {
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(filename.c_str(), &info) != 0) {
+		return false;
+	}
+#else
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0) {
+		return false;
+	}
+#endif
+	stamp.time = (int64_t)info.st_mtime;
+	stamp.size = (uint64_t)info.st_size;
+	stamp.hash = 14695981039346656037ull;
+	if (stamp.size > 0) {
+		MappedFile file;
+		if (!file.open(filename)) {
+			return false;
+		}
+		const unsigned char *bytes = file.getData();
+		stamp.size = file.getSize();
+		for (uint64_t i = 0; i < stamp.size; i++) {
+			stamp.hash = (stamp.hash ^ bytes[i]) * 1099511628211ull;
+		}
+	}
+	return true;
+}
+
+/**
+ * @fn	static std::string resolvePath(const std::string &sceneFilename, const std::string &name)
+ * @brief	Makes a filename in a scene file relative to the scene file's directory.
+ * @param	sceneFilename	Filename of the scene file.
+ * @param	name		 	The filename, as written in the scene file.
+ * @return	The filename to open.
+ */
+
+static std::string resolvePath(const std::string &sceneFilename, const std::string &name) {
+	if (name[0] == '/' || name[0] == '\\' || name.find(':') != std::string::npos) {
+		return name;
+	}
+	const size_t slash = sceneFilename.find_last_of("/\\");
+	return slash == std::string::npos ? name : sceneFilename.substr(0, slash + 1) + name;
+}
+
+/**
+ * @fn	static bool readFloats(std::istream &in, float *values, int n)
+ * @brief	Reads some numbers.
+ * @param [in,out]	in	  	The stream.
+ * @param [in,out]	values	The numbers read.
+ * @param 		  	n	  	How many to read.
+ * @return	True iff all n were read.
+ */
+
+static bool readFloats(std::istream &in, float *values, int n) {
+	for (int i = 0; i < n; i++) {
+		if (!(in >> values[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @fn	static IShapePtr createShape(const SceneShapeRecord &s, IScene &scene)
+ * @brief	Creates the implicit shape a record describes, owned by a scene.
+ * @param 		  	s	 	The record.
+ * @param [in,out]	scene	The scene.
+ * @return	The new shape.
+ */
+
+static IShapePtr createShape(const SceneShapeRecord &s, IScene &scene) {
+	const float *p = s.params;
+	const glm::vec3 a(p[0], p[1], p[2]);
+	const glm::vec3 b(p[3], p[4], p[5]);
+	switch (s.kind) {
+	case SCENE_PLANE:				return scene.create<IPlane>(a, b);
+	case SCENE_SPHERE:				return scene.create<ISphere>(a, p[3]);
+	case SCENE_ELLIPSOID:			return scene.create<IEllipsoid>(a, b);
+	case SCENE_DISK:				return scene.create<IDisk>(a, b, p[6]);
+	case SCENE_RECT:				return scene.create<IRect>(a, b, p[6], p[7]);
+	case SCENE_BOX:					return scene.create<IBox>(a, b);
+	case SCENE_TRIANGLE:			return scene.create<ITriangle>(a, b, glm::vec3(p[6], p[7], p[8]));
+	case SCENE_CYLINDER_X:			return scene.create<ICylinderX>(a, p[3], p[4]);
+	case SCENE_CYLINDER_Y:			return scene.create<ICylinderY>(a, p[3], p[4]);
+	case SCENE_CYLINDER_Z:			return scene.create<ICylinderZ>(a, p[3], p[4]);
+	case SCENE_CLOSED_CYLINDER_Y:	return scene.create<IClosedCylinderY>(a, p[3], p[4]);
+	default:						return scene.create<IConeY>(a, p[3], p[4]);
+	}
+}
+
+/**
+ * @fn	static SceneRecords recordsOf(const SceneDescription &description)
+ * @brief	Gets the records of a description.
+ * @param	description	The description.
+ * @return	The records.
+ */
+
+static SceneRecords recordsOf(const SceneDescription &description) {
+	SceneRecords records;
+	records.materials = description.materials.data();
+	records.numMaterials = (int)description.materials.size();
+	records.shapes = description.shapes.data();
+	records.numShapes = (int)description.shapes.size();
+	records.lights = description.lights.data();
+	records.numLights = (int)description.lights.size();
+	records.cameras = description.cameras.data();
+	records.numCameras = (int)description.cameras.size();
+	return records;
+}
+
+/**
+ * @fn	static bool loadTextures(const std::vector<std::string> &filenames, std::vector<Image *> &textures, IScene &scene)
+ * @brief	Reads the textures of a scene, which owns them.
+ * @param 		  	filenames	Filenames of the textures.
+ * @param [in,out]	textures 	The images, in the same order.
+ * @param [in,out]	scene	 	The scene.
+ * @return	True iff every file could be opened.
+ */
+
+static bool loadTextures(const std::vector<std::string> &filenames, std::vector<Image *> &textures, IScene &scene) {
+	for (unsigned int i = 0; i < filenames.size(); i++) {
+		if (!std::ifstream(filenames[i].c_str()).good()) {
+			std::cerr << "Unable to open texture: " << filenames[i] << std::endl;
+			return false;
+		}
+	}
+	for (unsigned int i = 0; i < filenames.size(); i++) {
+		std::string filename = filenames[i];
+		textures.push_back(scene.create<Image>(&filename[0]));
+	}
+	return true;
+}
+
+/**
+ * @fn	static void instantiate(const SceneRecords &records, const std::vector<Image *> &textures, IScene &scene)
+ * @brief	Creates the objects, lights and cameras that records describe, and adds
+ * 			them to a scene, which owns them. The first camera becomes the scene's
+ * 			camera.
+ * @param 		  	records 	The records, already checked.
+ * @param 		  	textures	The textures the shapes refer to.
+ * @param [in,out]	scene   	The scene.
+ */
+
+static void instantiate(const SceneRecords &records, const std::vector<Image *> &textures, IScene &scene) {
+	MaterialLibrary &library = MaterialLibrary::getShared();
+	std::vector<MaterialId> materials;
+	materials.reserve(records.numMaterials);
+	for (int i = 0; i < records.numMaterials; i++) {
+		materials.push_back(library.findOrAdd(Material(std::vector<float>(records.materials[i].values,
+																			records.materials[i].values + 10))));
+	}
+
+	scene.visibleObjects.reserve(scene.visibleObjects.size() + records.numShapes);
+	for (int i = 0; i < records.numShapes; i++) {
+		const SceneShapeRecord &s = records.shapes[i];
+		VisibleIShapePtr obj = scene.create<VisibleIShape>(createShape(s, scene), materials[s.material]);
+		if (s.texture >= 0) {
+			obj->setTexture(textures[s.texture]);
+		}
+		if (s.alpha < 1.0f) {
+			scene.addTransparentObject(obj, s.alpha);
+		} else {
+			scene.addObject(obj);
+		}
+	}
+
+	for (int i = 0; i < records.numLights; i++) {
+		const SceneLightRecord &l = records.lights[i];
+		const glm::vec3 position(l.position[0], l.position[1], l.position[2]);
+		const LightColor lightColor(color(l.color[0], l.color[1], l.color[2]));
+		PositionalLightPtr light;
+		if (l.isSpot) {
+			light = scene.create<SpotLight>(position, glm::vec3(l.direction[0], l.direction[1], l.direction[2]),
+									l.fov, lightColor);
+		} else {
+			light = scene.create<PositionalLight>(position, lightColor);
+		}
+		if (l.attenuationIsTurnedOn) {
+			light->attenuationIsTurnedOn = true;
+			light->attenuationParams = LightAttenuationParameters(l.attenuation[0], l.attenuation[1], l.attenuation[2]);
+		}
+		scene.addObject(light);
+	}
+
+	for (int i = 0; i < records.numCameras; i++) {
+		const SceneCameraRecord &c = records.cameras[i];
+		const glm::vec3 position(c.position[0], c.position[1], c.position[2]);
+		const glm::vec3 lookAt(c.lookAt[0], c.lookAt[1], c.lookAt[2]);
+		const glm::vec3 up(c.up[0], c.up[1], c.up[2]);
+		RaytracingCamera *camera;
+		if (c.isPerspective) {
+			camera = scene.create<PerspectiveCamera>(position, lookAt, up, c.parameter);
+		} else {
+			camera = scene.create<OrthographicCamera>(position, lookAt, up, c.parameter);
+		}
+		scene.cameras.push_back(camera);
+		if (i == 0) {
+			scene.changeCamera(camera);
+		}
+	}
+}
+
+/**
+ * @fn	bool SceneLoader::parse(const std::string &filename, SceneDescription &description)
+ * @brief	Reads a text scene file. Each line is one statement; # starts a comment.
+ * 			Angles are in degrees.
+ * 			  material <name> <ambient rgb> <diffuse rgb> <specular rgb> <shininess>
+ * 			  texture <name> <ppm file>
+ * 			  camera perspective <position> <look at> <up> <field of view>
+ * 			  camera orthographic <position> <look at> <up> <pixels per world unit>
+ * 			  light positional <position> <rgb> [attenuation <c> <l> <q>]
+ * 			  light spot <position> <direction> <field of view> <rgb> [attenuation ...]
+ * 			  <shape> <numbers> <material> [texture <name>] [alpha <a>]
+ * 			The shapes and their numbers are listed in SHAPE_SYNTAX. Materials are
+ * 			those defined earlier in the file, or the built-in materials and colors
+ * 			of ColorAndMaterials.h. Texture files are relative to the scene file.
+ * @param 		  	filename   	Filename of the scene file.
+ * @param [in,out]	description	The scene's records.
+ * @return	True iff the whole file was read without error.
+ */
+
+bool SceneLoader::parse(const std::string &filename, SceneDescription &description) {
+	std::ifstream input(filename.c_str());
+	if (!input) {
+		std::cerr << "Unable to open scene: " << filename << std::endl;
+		return false;
+	}
+	std::map<std::string, int> materialIndices, textureIndices;
+	std::map<std::string, SceneMaterialRecord> definedMaterials;
+	std::string line;
+	int lineNumber = 0;
+	auto fail = [&](const std::string &message) {
+		std::cerr << filename << "(" << lineNumber << "): " << message << std::endl;
+		return false;
+	};
+
+	while (std::getline(input, line)) {
+		lineNumber++;
+		const size_t hash = line.find('#');
+		if (hash != std::string::npos) {
+			line.erase(hash);
+		}
+		std::istringstream in(line);
+		std::string keyword, name;
+		if (!(in >> keyword)) {
+			continue;
+		}
+
+		if (keyword == "material") {
+			SceneMaterialRecord record;
+			if (!(in >> name) || !readFloats(in, record.values, 10)) {
+				return fail("material needs a name and 10 numbers");
+			}
+			definedMaterials[name] = record;
+		} else if (keyword == "texture") {
+			std::string file;
+			if (!(in >> name >> file)) {
+				return fail("texture needs a name and a file");
+			}
+			textureIndices[name] = (int)description.textures.size();
+			description.textures.push_back(resolvePath(filename, file));
+		} else if (keyword == "camera") {
+			SceneCameraRecord record;
+			std::string type;
+			in >> type;
+			if ((type != "perspective" && type != "orthographic") ||
+				!readFloats(in, record.position, 3) || !readFloats(in, record.lookAt, 3) ||
+				!readFloats(in, record.up, 3) || !readFloats(in, &record.parameter, 1)) {
+				return fail("camera needs perspective or orthographic, position, look at, up, and one number");
+			}
+			record.isPerspective = type == "perspective";
+			if (record.isPerspective) {
+				record.parameter = glm::radians(record.parameter);
+			}
+			description.cameras.push_back(record);
+		} else if (keyword == "light") {
+			SceneLightRecord record;
+			std::memset(&record, 0, sizeof(record));
+			std::string type;
+			in >> type;
+			record.isSpot = type == "spot";
+			if (type != "positional" && type != "spot") {
+				return fail("light must be positional or spot");
+			}
+			if (!readFloats(in, record.position, 3) ||
+				(record.isSpot && (!readFloats(in, record.direction, 3) || !readFloats(in, &record.fov, 1))) ||
+				!readFloats(in, record.color, 3)) {
+				return fail("light has too few numbers");
+			}
+			record.fov = glm::radians(record.fov);
+			std::string option;
+			while (in >> option) {
+				if (option != "attenuation" || !readFloats(in, record.attenuation, 3)) {
+					return fail("unknown light option: " + option);
+				}
+				record.attenuationIsTurnedOn = 1;
+			}
+			description.lights.push_back(record);
+		} else {
+			int kind = 0;
+			while (kind < NUM_SCENE_SHAPE_KINDS && keyword != SHAPE_SYNTAX[kind].keyword) {
+				kind++;
+			}
+			if (kind == NUM_SCENE_SHAPE_KINDS) {
+				return fail("unknown statement: " + keyword);
+			}
+			SceneShapeRecord record;
+			std::memset(&record, 0, sizeof(record));
+			record.kind = kind;
+			record.texture = -1;
+			record.alpha = 1.0f;
+			if (!readFloats(in, record.params, SHAPE_SYNTAX[kind].numParams) || !(in >> name)) {
+				return fail(keyword + " needs " + std::to_string(SHAPE_SYNTAX[kind].numParams) +
+							" numbers and a material");
+			}
+
+			// Only the materials shapes actually use are stored.
+			auto m = materialIndices.find(name);
+			if (m == materialIndices.end()) {
+				SceneMaterialRecord mat;
+				auto defined = definedMaterials.find(name);
+				if (defined != definedMaterials.end()) {
+					mat = defined->second;
+				} else if (!findBuiltInMaterial(name, mat)) {
+					return fail("unknown material: " + name);
+				}
+				m = materialIndices.insert(std::make_pair(name, (int)description.materials.size())).first;
+				description.materials.push_back(mat);
+			}
+			record.material = m->second;
+
+			std::string option;
+			while (in >> option) {
+				if (option == "texture" && (in >> name)) {
+					auto t = textureIndices.find(name);
+					if (t == textureIndices.end()) {
+						return fail("unknown texture: " + name);
+					}
+					record.texture = t->second;
+				} else if (option == "alpha" && readFloats(in, &record.alpha, 1)) {
+					continue;
+				} else {
+					return fail("unknown shape option: " + option);
+				}
+			}
+			description.shapes.push_back(record);
+		}
+	}
+	return true;
+}
+
+/**
+ * @fn	bool SceneLoader::loadText(const std::string &filename, IScene &scene)
+ * @brief	Reads a text scene file into a scene and builds the scene's BVH.
+ * @param 		  	filename	Filename of the scene file.
+ * @param [in,out]	scene   	The scene.
+ * @return	True iff the scene was loaded. On failure, the scene is unchanged.
+ */
+
+bool SceneLoader::loadText(const std::string &filename, IScene &scene) {
+	SceneDescription description;
+	std::vector<Image *> textures;
+	if (!parse(filename, description) || !loadTextures(description.textures, textures, scene)) {
+		return false;
+	}
+	instantiate(recordsOf(description), textures, scene);
+	scene.buildAccelerationStructure();
+	return true;
+}
+
+/**
+ * @fn	static bool isTreeWithinDepth(const BVHNode *nodes, int numNodes)
+ * @brief	Walks a stored BVH from the root, whose child links are already known to
+ * 			be in range, and checks that it is a tree the traversal stack can hold:
+ * 			no node is deeper than BVH_MAX_DEPTH or reached twice, and every node is
+ * 			reached.
+ * @param	nodes   	The nodes; nodes[0] is the root.
+ * @param	numNodes	Number of nodes.
+ * @return	True iff the nodes form such a tree.
+ */
+
+static bool isTreeWithinDepth(const BVHNode *nodes, int numNodes) {
+	if (numNodes == 0) {
+		return true;
+	}
+	std::vector<bool> reached(numNodes, false);
+	std::vector<std::pair<int, int>> pending(1, std::make_pair(0, 1));	// (node, depth); the root is 1
+	int numReached = 0;
+	while (!pending.empty()) {
+		const int n = pending.back().first;
+		const int depth = pending.back().second;
+		pending.pop_back();
+		if (depth > BVH_MAX_DEPTH || reached[n]) {
+			return false;
+		}
+		reached[n] = true;
+		numReached++;
+		if (nodes[n].count == 0) {
+			pending.push_back(std::make_pair(nodes[n].first, depth + 1));
+			pending.push_back(std::make_pair(nodes[n].first + 1, depth + 1));
+		}
+	}
+	return numReached == numNodes;
+}
+
+/**
+ * @fn	static bool loadCompiledFile(const std::string &filename, IScene &scene, const SceneSourceStamp *source)
+ * @brief	Maps a compiled scene file, checks it, and adds its contents to a scene.
+ * 			If the scene had no visible objects before, the stored BVH is used as
+ * 			is; otherwise a new one is built.
+ * @param 		  	filename  	Filename of the compiled file.
+ * @param [in,out]	scene	  	The scene.
+ * @param 		  	source	  	If not null, the stamp of the text file, which the
+ * 								compiled file must have been made from.
+ * @return	True iff the scene was loaded. On failure, the scene is unchanged.
+ */
+
+static bool loadCompiledFile(const std::string &filename, IScene &scene, const SceneSourceStamp *source) {
+	MappedFile file;
+	if (!file.open(filename) || file.getSize() < sizeof(SceneFileHeader)) {
+		return false;
+	}
+	const unsigned char *base = file.getData();
+	const SceneFileHeader &header = *(const SceneFileHeader *)base;
+	if (std::memcmp(header.magic, "RTSC", 4) != 0 || header.version != SCENE_FILE_VERSION ||
+		(source != nullptr && (header.source.time != source->time || header.source.size != source->size ||
+								header.source.hash != source->hash))) {
+		return false;
+	}
+	for (int i = 0; i < NUM_SCENE_SECTIONS; i++) {
+		if (header.offsets[i] % 8 != 0 || header.offsets[i] > file.getSize() ||
+			header.counts[i] > (file.getSize() - header.offsets[i]) / SECTION_ELEMENT_BYTES[i]) {
+			std::cerr << "Corrupt compiled scene: " << filename << std::endl;
+			return false;
+		}
+	}
+
+	SceneRecords records;
+	records.materials = (const SceneMaterialRecord *)(base + header.offsets[SECTION_MATERIALS]);
+	records.numMaterials = header.counts[SECTION_MATERIALS];
+	records.shapes = (const SceneShapeRecord *)(base + header.offsets[SECTION_SHAPES]);
+	records.numShapes = header.counts[SECTION_SHAPES];
+	records.lights = (const SceneLightRecord *)(base + header.offsets[SECTION_LIGHTS]);
+	records.numLights = header.counts[SECTION_LIGHTS];
+	records.cameras = (const SceneCameraRecord *)(base + header.offsets[SECTION_CAMERAS]);
+	records.numCameras = header.counts[SECTION_CAMERAS];
+	const BVHNode *nodes = (const BVHNode *)(base + header.offsets[SECTION_BVH_NODES]);
+	const int numNodes = header.counts[SECTION_BVH_NODES];
+	const int32_t *indices = (const int32_t *)(base + header.offsets[SECTION_BVH_INDICES]);
+	const int numIndices = header.counts[SECTION_BVH_INDICES];
+	const int32_t *unbounded = (const int32_t *)(base + header.offsets[SECTION_BVH_UNBOUNDED]);
+	const int numUnbounded = header.counts[SECTION_BVH_UNBOUNDED];
+
+	// Texture names are consecutive NUL-terminated strings.
+	std::vector<std::string> textureNames;
+	const char *names = (const char *)(base + header.offsets[SECTION_TEXTURE_NAMES]);
+	const uint32_t nameBytes = header.counts[SECTION_TEXTURE_NAMES];
+	if (nameBytes > 0 && names[nameBytes - 1] != '\0') {
+		std::cerr << "Corrupt compiled scene: " << filename << std::endl;
+		return false;
+	}
+	for (uint32_t i = 0; i < nameBytes; i += (uint32_t)textureNames.back().size() + 1) {
+		textureNames.push_back(std::string(names + i));
+	}
+
+	// Check every index, so a damaged file cannot crash the loader or the ray tracer.
+	bool valid = true;
+	int numOpaque = 0;
+	for (int i = 0; i < records.numShapes; i++) {
+		const SceneShapeRecord &s = records.shapes[i];
+		valid = valid && s.kind >= 0 && s.kind < NUM_SCENE_SHAPE_KINDS &&
+				s.material >= 0 && s.material < records.numMaterials &&
+				s.texture >= -1 && s.texture < (int)textureNames.size();
+		numOpaque += s.alpha < 1.0f ? 0 : 1;
+	}
+	valid = valid && (int)header.bvhObjects == numOpaque;
+	for (int i = 0; i < numNodes; i++) {
+		const BVHNode &node = nodes[i];
+		valid = valid && node.count >= 0 && node.first >= 0 &&
+				(node.count > 0 ? node.first <= numIndices && node.count <= numIndices - node.first
+								: node.first > i && node.first < numNodes - 1);
+	}
+	valid = valid && isTreeWithinDepth(nodes, numNodes);
+	for (int i = 0; i < numIndices; i++) {
+		valid = valid && indices[i] >= 0 && indices[i] < numOpaque;
+	}
+	for (int i = 0; i < numUnbounded; i++) {
+		valid = valid && unbounded[i] >= 0 && unbounded[i] < numOpaque;
+	}
+	if (!valid) {
+		std::cerr << "Corrupt compiled scene: " << filename << std::endl;
+		return false;
+	}
+
+	std::vector<Image *> textures;
+	if (!loadTextures(textureNames, textures, scene)) {
+		return false;
+	}
+	const bool adoptBVH = scene.visibleObjects.empty() && numOpaque > 0;
+	instantiate(records, textures, scene);
+	if (adoptBVH) {
+		scene.bvh.nodes.assign(nodes, nodes + numNodes);
+		scene.bvh.objectIndices.assign(indices, indices + numIndices);
+		scene.bvh.unboundedObjects.assign(unbounded, unbounded + numUnbounded);
+		scene.bvh.numObjects = numOpaque;
+	} else {
+		scene.buildAccelerationStructure();
+	}
+	return true;
+}
+
+/**
+ * @fn	bool SceneLoader::loadCompiled(const std::string &filename, IScene &scene)
+ * @brief	Loads a compiled scene file into a scene.
+ * @param 		  	filename	Filename of the compiled file.
+ * @param [in,out]	scene   	The scene.
+ * @return	True iff the scene was loaded. On failure, the scene is unchanged.
+ */
+
+bool SceneLoader::loadCompiled(const std::string &filename, IScene &scene) {
+	if (!loadCompiledFile(filename, scene, nullptr)) {
+		std::cerr << "Unable to load compiled scene: " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn	bool SceneLoader::writeCompiled(const std::string &filename, const SceneDescription &description, const BVH &bvh, const SceneSourceStamp &source)
+ * @brief	Writes a compiled scene file.
+ * @param	filename   	Filename of the compiled file.
+ * @param	description	The scene's records.
+ * @param	bvh		   	The BVH over the description's opaque shapes, in order.
+ * @param	source	   	Stamp of the text file.
+ * @return	True iff the file was written.
+ */
+
+bool SceneLoader::writeCompiled(const std::string &filename, const SceneDescription &description,
+								const BVH &bvh, const SceneSourceStamp &source) {
+	std::string textureNames;
+	for (unsigned int i = 0; i < description.textures.size(); i++) {
+		textureNames += description.textures[i];
+		textureNames += '\0';
+	}
+	const void *sections[NUM_SCENE_SECTIONS] = {
+		description.materials.data(), textureNames.data(), description.shapes.data(),
+		description.lights.data(), description.cameras.data(),
+		bvh.nodes.data(), bvh.objectIndices.data(), bvh.unboundedObjects.data()
+	};
+
+	SceneFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "RTSC", 4);
+	header.version = SCENE_FILE_VERSION;
+	header.source = source;
+	header.bvhObjects = bvh.numObjects;
+	header.counts[SECTION_MATERIALS] = (uint32_t)description.materials.size();
+	header.counts[SECTION_TEXTURE_NAMES] = (uint32_t)textureNames.size();
+	header.counts[SECTION_SHAPES] = (uint32_t)description.shapes.size();
+	header.counts[SECTION_LIGHTS] = (uint32_t)description.lights.size();
+	header.counts[SECTION_CAMERAS] = (uint32_t)description.cameras.size();
+	header.counts[SECTION_BVH_NODES] = (uint32_t)bvh.nodes.size();
+	header.counts[SECTION_BVH_INDICES] = (uint32_t)bvh.objectIndices.size();
+	header.counts[SECTION_BVH_UNBOUNDED] = (uint32_t)bvh.unboundedObjects.size();
+	uint64_t offset = (sizeof(header) + 7) & ~(uint64_t)7;
+	for (int i = 0; i < NUM_SCENE_SECTIONS; i++) {
+		header.offsets[i] = offset;
+		offset = (offset + header.counts[i] * SECTION_ELEMENT_BYTES[i] + 7) & ~(uint64_t)7;
+	}
+
+	std::vector<char> bytes((size_t)offset, 0);
+	std::memcpy(&bytes[0], &header, sizeof(header));
+	for (int i = 0; i < NUM_SCENE_SECTIONS; i++) {
+		if (header.counts[i] > 0) {
+			std::memcpy(&bytes[(size_t)header.offsets[i]], sections[i], (size_t)(header.counts[i] * SECTION_ELEMENT_BYTES[i]));
+		}
+	}
+	std::ofstream output(filename.c_str(), std::ios::binary);
+	output.write(bytes.data(), bytes.size());
+	if (!output) {
+		std::cerr << "Unable to write compiled scene: " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn	bool SceneLoader::compile(const std::string &textFilename, const std::string &compiledFilename)
+ * @brief	Compiles a text scene file, including its BVH. Textures are not read.
+ * @param	textFilename		Filename of the text scene file.
+ * @param	compiledFilename	Filename of the compiled file.
+ * @return	True iff the file was compiled.
+ */
+
+bool SceneLoader::compile(const std::string &textFilename, const std::string &compiledFilename) {
+	SceneDescription description;
+	SceneSourceStamp source;
+	if (!stampOf(textFilename, source) || !parse(textFilename, description)) {
+		std::cerr << "Unable to compile scene: " << textFilename << std::endl;
+		return false;
+	}
+
+	// The shapes are only needed for their bounds.
+	IScene scratch(nullptr);
+	instantiate(recordsOf(description), std::vector<Image *>(description.textures.size(), nullptr), scratch);
+	scratch.buildAccelerationStructure();
+	return writeCompiled(compiledFilename, description, scratch.bvh, source);
+}
+
+/**
+ * @fn	bool SceneLoader::load(const std::string &filename, IScene &scene)
+ * @brief	Loads a text scene file, through its compiled cache, filename + ".bin".
+ * 			If the cache was compiled from the file as it is now, it is mapped
+ * 			and used; otherwise the text is parsed and the cache rewritten.
+ * @param 		  	filename	Filename of the text scene file.
+ * @param [in,out]	scene   	The scene.
+ * @return	True iff the scene was loaded. On failure, the scene is unchanged.
+ */
+
+bool SceneLoader::load(const std::string &filename, IScene &scene) {
+	const std::string compiledFilename = filename + ".bin";
+	SceneSourceStamp source;
+	if (!stampOf(filename, source)) {
+		std::cerr << "Unable to open scene: " << filename << std::endl;
+		return false;
+	}
+	if (loadCompiledFile(compiledFilename, scene, &source)) {
+		return true;
+	}
+
+	SceneDescription description;
+	std::vector<Image *> textures;
+	if (!parse(filename, description) || !loadTextures(description.textures, textures, scene)) {
+		return false;
+	}
+	const bool wasEmpty = scene.visibleObjects.empty();
+	instantiate(recordsOf(description), textures, scene);
+	scene.buildAccelerationStructure();
+	// The cache's BVH indexes the file's own objects, so it is only written when they are all there is.
+	if (wasEmpty) {
+		writeCompiled(compiledFilename, description, scene.bvh, source);
+	}
+	return true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "IScene.h"
+
+const uint32_t SCENE_FILE_VERSION = 2;		//!< Bump whenever a record or the file layout changes.
+const int SCENE_SHAPE_PARAMS = 9;			//!< Most numbers any shape takes (a triangle's 3 vertices).
+
+/**
+ * @enum	SceneShapeKind
+ * @brief	The kinds of shapes a scene file can hold.
+ */
+
+enum SceneShapeKind {
+	SCENE_PLANE, SCENE_SPHERE, SCENE_ELLIPSOID, SCENE_DISK, SCENE_RECT, SCENE_BOX, SCENE_TRIANGLE,
+	SCENE_CYLINDER_X, SCENE_CYLINDER_Y, SCENE_CYLINDER_Z, SCENE_CLOSED_CYLINDER_Y, SCENE_CONE_Y,
+	NUM_SCENE_SHAPE_KINDS
+};
+
+/**
+ * @struct	SceneMaterialRecord
+ * @brief	A material, as stored in a scene description: ambient, diffuse and
+ * 			specular colors, then shininess, like Material(std::vector<float>).
+ */
+
+struct SceneMaterialRecord {
+	float values[10];
+};
+
+/**
+ * @struct	SceneShapeRecord
+ * @brief	A visible shape, as stored in a scene description.
+ */
+
+struct SceneShapeRecord {
+	int32_t kind;								//!< A SceneShapeKind
+	int32_t material;							//!< Index of the material
+	int32_t texture;							//!< Index of the texture; -1 for none
+	float alpha;								//!< Less than 1 ==> a transparent object
+	float params[SCENE_SHAPE_PARAMS];			//!< The numbers given in the file, in order
+};
+
+/**
+ * @struct	SceneLightRecord
+ * @brief	A positional or spot light, as stored in a scene description.
+ */
+
+struct SceneLightRecord {
+	int32_t isSpot;								//!< Nonzero ==> a SpotLight
+	int32_t attenuationIsTurnedOn;				//!< Nonzero ==> attenuation given
+	float position[3];							//!< Position of the light
+	float direction[3];							//!< Spot direction
+	float fov;									//!< Spot field of view, in radians
+	float color[3];								//!< Color of all three components
+	float attenuation[3];						//!< Constant, linear and quadratic attenuation
+};
+
+/**
+ * @struct	SceneCameraRecord
+ * @brief	A camera, as stored in a scene description.
+ */
+
+struct SceneCameraRecord {
+	int32_t isPerspective;						//!< Nonzero ==> a PerspectiveCamera
+	float position[3];							//!< Position of the camera
+	float lookAt[3];							//!< Focus point
+	float up[3];								//!< Up vector
+	float parameter;							//!< Field of view in radians, or pixels per world unit
+};
+
+/**
+ * @struct	SceneSourceStamp
+ * @brief	Identifies the contents of a text scene file, so a compiled cache can
+ * 			tell whether it was made from the file as it is now. Modification
+ * 			times alone are too coarse: edits within a second share one.
+ */
+
+struct SceneSourceStamp {
+	int64_t time;								//!< Modification time
+	uint64_t size;								//!< Size in bytes
+	uint64_t hash;								//!< Hash of the contents (FNV-1a)
+};
+
+/**
+ * @struct	SceneDescription
+ * @brief	Everything in a scene file, as plain records. Shapes refer to materials
+ * 			and textures by index.
+ */
+
+struct SceneDescription {
+	std::vector<SceneMaterialRecord> materials;	//!< The materials shapes use
+	std::vector<std::string> textures;			//!< Filenames of the textures shapes use
+	std::vector<SceneShapeRecord> shapes;		//!< The shapes, in file order
+	std::vector<SceneLightRecord> lights;		//!< The lights, in file order
+	std::vector<SceneCameraRecord> cameras;		//!< The cameras, in file order
+};
+
+/**
+ * @struct	SceneLoader
+ * @brief	Builds an IScene from a scene file. A text file is parsed; a compiled
+ * 			file is memory mapped and its records, including the prebuilt BVH,
+ * 			are used as they are.
+ */
+
+struct SceneLoader {
+	static bool load(const std::string &filename, IScene &scene);
+	static bool loadText(const std::string &filename, IScene &scene);
+	static bool loadCompiled(const std::string &filename, IScene &scene);
+	static bool compile(const std::string &textFilename, const std::string &compiledFilename);
+	static bool parse(const std::string &filename, SceneDescription &description);
+protected:
+	static bool writeCompiled(const std::string &filename, const SceneDescription &description,
+								const BVH &bvh, const SceneSourceStamp &source);
+};
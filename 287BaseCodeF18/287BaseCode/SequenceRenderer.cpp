@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include "SequenceRenderer.h"
+
+/**
+ * @fn	static double getSeconds()
+ * @brief	Reads a monotonic clock.
+ * @return	Seconds since some fixed point in the past.
+ */
+
+static double getSeconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @fn	template <typename K> static void insertKey(std::vector<K> &keys, const K &key)
+ * @brief	Inserts a keyframe, keeping the keyframes in time order. A keyframe at
+ * 			the same time as an earlier one goes after it.
+ * @param [in,out]	keys	The keyframes.
+ * @param 		  	key 	The new keyframe.
+ */
+
+template <typename K>
+static void insertKey(std::vector<K> &keys, const K &key) {
+	typename std::vector<K>::iterator it = std::upper_bound(keys.begin(), keys.end(), key,
+		[](const K &a, const K &b) { return a.time < b.time; });
+	keys.insert(it, key);
+}
+
+/**
+ * @fn	template <typename K> static float findSegment(const std::vector<K> &keys, float time, int &i)
+ * @brief	Finds the pair of keyframes that a time falls between. Before the first
+ * 			or after the last keyframe, the nearest one holds.
+ * @param 		  	keys	The keyframes, in time order; at least one.
+ * @param 		  	time	The time.
+ * @param [in,out]	i   	The first keyframe of the pair; the second is i + 1, if any.
+ * @return	How far time is from keys[i] to keys[i + 1], from 0 to 1.
+ */
+
+template <typename K>
+static float findSegment(const std::vector<K> &keys, float time, int &i) {
+	const int N = (int)keys.size();
+	i = 0;
+	while (i < N - 1 && keys[i + 1].time <= time) {
+		i++;
+	}
+	if (i == N - 1 || time <= keys[i].time) {
+		return 0.0f;
+	}
+	return (time - keys[i].time) / (keys[i + 1].time - keys[i].time);
+}
+
+/**
+ * @fn	static glm::vec3 samplePosition(const std::vector<PositionKeyframe> &keys, float time)
+ * @brief	Interpolates a track of positions.
+ * @param	keys	The keyframes, in time order; at least one.
+ * @param	time	The time.
+ * @return	The position at that time.
+ */
+
+static glm::vec3 samplePosition(const std::vector<PositionKeyframe> &keys, float time) {
+	int i;
+	const float f = findSegment(keys, time, i);
+	if (f == 0.0f) {
+		return keys[i].position;
+	}
+	return glm::mix(keys[i].position, keys[i + 1].position, f);
+}
+
+/**
+ * @fn	double SequenceStats::getTotalSeconds() const
+ * @brief	Wall time of the whole sequence: setup, every frame and the final flush.
+ * @return	The time, in seconds.
+ */
+
+double SequenceStats::getTotalSeconds() const {
+	double total = setupSeconds + flushSeconds;
+	for (unsigned int i = 0; i < frameSeconds.size(); i++) {
+		total += frameSeconds[i];
+	}
+	return total;
+}
+
+/**
+ * @fn	double SequenceStats::getAmortizedSeconds() const
+ * @brief	Cost per frame, with the one-time setup spread over all frames.
+ * @return	The time, in seconds; 0 if no frames were rendered.
+ */
+
+double SequenceStats::getAmortizedSeconds() const {
+	return frameSeconds.empty() ? 0.0 : getTotalSeconds() / frameSeconds.size();
+}
+
+/**
+ * @fn	std::ostream &operator << (std::ostream &os, const SequenceStats &stats)
+ * @brief	Output stream for sequence statistics: each frame's cost, then the
+ * 			setup and amortized costs.
+ * @param	os   	Output stream.
+ * @param	stats	The statistics.
+ * @return	The output stream.
+ */
+
+std::ostream &operator << (std::ostream &os, const SequenceStats &stats) {
+	double frames = 0.0;
+	for (unsigned int i = 0; i < stats.frameSeconds.size(); i++) {
+		os << "Frame " << i << ": " << stats.frameSeconds[i] * 1000.0 << " ms (update "
+			<< stats.updateSeconds[i] * 1000.0 << " ms)" << std::endl;
+		frames += stats.frameSeconds[i];
+	}
+	const double N = (double)std::max((size_t)1, stats.frameSeconds.size());
+	os << "Setup: " << stats.setupSeconds * 1000.0 << " ms, once" << std::endl;
+	os << "Total: " << stats.getTotalSeconds() << " sec for " << stats.frameSeconds.size() << " frames" << std::endl;
+	os << "Amortized: " << stats.getAmortizedSeconds() * 1000.0 << " ms/frame (repeating this setup every frame: "
+		<< (frames / N + stats.setupSeconds) * 1000.0 << " ms/frame)" << std::endl;
+	return os;
+}
+
+/**
+ * @fn	void SequenceRenderer::addCameraKeyframe(float time, const glm::vec3 &position, const glm::vec3 &lookAt, const glm::vec3 &up)
+ * @brief	Adds a keyframe for the scene's camera.
+ * @param	time	The time, in seconds.
+ * @param	position	Position of the camera.
+ * @param	lookAt  	Focus point.
+ * @param	up			Up vector.
+ */
+
+void SequenceRenderer::addCameraKeyframe(float time, const glm::vec3 &position, const glm::vec3 &lookAt, const glm::vec3 &up) {
+	CameraKeyframe key = { time, position, lookAt, up };
+	insertKey(cameraKeys, key);
+}
+
+/**
+ * @fn	void SequenceRenderer::addLightKeyframe(PositionalLightPtr light, float time, const glm::vec3 &position)
+ * @brief	Adds a keyframe for a light's position.
+ * @param	light   	The light.
+ * @param	time		The time, in seconds.
+ * @param	position	Position of the light.
+ */
+
+void SequenceRenderer::addLightKeyframe(PositionalLightPtr light, float time, const glm::vec3 &position) {
+	PositionKeyframe key = { time, position };
+	for (unsigned int i = 0; i < lightTracks.size(); i++) {
+		if (lightTracks[i].light == light) {
+			insertKey(lightTracks[i].keys, key);
+			return;
+		}
+	}
+	LightTrack track;
+	track.light = light;
+	track.keys.push_back(key);
+	lightTracks.push_back(track);
+}
+
+/**
+ * @fn	void SequenceRenderer::addObjectKeyframe(VisibleIShapePtr object, float time, const glm::vec3 &offset)
+ * @brief	Adds a keyframe for an object's position.
+ * @param	object	The object.
+ * @param	time  	The time, in seconds.
+ * @param	offset	How far the object is from where it was when the sequence started.
+ */
+
+void SequenceRenderer::addObjectKeyframe(VisibleIShapePtr object, float time, const glm::vec3 &offset) {
+	PositionKeyframe key = { time, offset };
+	for (unsigned int i = 0; i < objectTracks.size(); i++) {
+		if (objectTracks[i].object == object) {
+			insertKey(objectTracks[i].keys, key);
+			return;
+		}
+	}
+	ObjectTrack track;
+	track.object = object;
+	track.keys.push_back(key);
+	track.applied = glm::vec3(0.0f);
+	objectTracks.push_back(track);
+}
+
+/**
+ * @fn	float SequenceRenderer::getStartTime() const
+ * @brief	Gets the time of the earliest keyframe.
+ * @return	The start time of the sequence; 0 if there are no keyframes.
+ */
+
+float SequenceRenderer::getStartTime() const {
+	float start = FLT_MAX;
+	if (!cameraKeys.empty()) {
+		start = cameraKeys.front().time;
+	}
+	for (unsigned int i = 0; i < lightTracks.size(); i++) {
+		start = std::min(start, lightTracks[i].keys.front().time);
+	}
+	for (unsigned int i = 0; i < objectTracks.size(); i++) {
+		start = std::min(start, objectTracks[i].keys.front().time);
+	}
+	return start == FLT_MAX ? 0.0f : start;
+}
+
+/**
+ * @fn	float SequenceRenderer::getEndTime() const
+ * @brief	Gets the time of the latest keyframe.
+ * @return	The end time of the sequence; 0 if there are no keyframes.
+ */
+
+float SequenceRenderer::getEndTime() const {
+	float end = -FLT_MAX;
+	if (!cameraKeys.empty()) {
+		end = cameraKeys.back().time;
+	}
+	for (unsigned int i = 0; i < lightTracks.size(); i++) {
+		end = std::max(end, lightTracks[i].keys.back().time);
+	}
+	for (unsigned int i = 0; i < objectTracks.size(); i++) {
+		end = std::max(end, objectTracks[i].keys.back().time);
+	}
+	return end == -FLT_MAX ? 0.0f : end;
+}
+
+/**
+ * @fn	void SequenceRenderer::prepare(IScene &scene)
+ * @brief	Does the work that every frame shares: animated objects are made
+ * 			dynamic, and the hierarchies are built if they are not already.
+ * 			Offsets of object keyframes are measured from where the objects are
+ * 			now.
+ * @param [in,out]	scene	The scene.
+ */
+
+void SequenceRenderer::prepare(IScene &scene) {
+	for (unsigned int i = 0; i < objectTracks.size(); i++) {
+		ObjectTrack &track = objectTracks[i];
+		if (std::find(scene.dynamicObjects.begin(), scene.dynamicObjects.end(), track.object) == scene.dynamicObjects.end() &&
+			!scene.makeDynamic(track.object)) {
+			std::cerr << "Animated object is not in the scene" << std::endl;
+		}
+		track.applied = glm::vec3(0.0f);
+	}
+	if (!scene.bvh.isBuiltFor(scene.visibleObjects) || !scene.dynamicBvh.isBuiltFor(scene.dynamicObjects)) {
+		scene.buildAccelerationStructure();
+	}
+}
+
+/**
+ * @fn	void SequenceRenderer::setTime(IScene &scene, float time, int width, int height)
+ * @brief	Puts the camera, lights and objects where they are at a given time, and
+ * 			refits the dynamic hierarchy. Call prepare first.
+ * @param [in,out]	scene 	The scene.
+ * @param 		  	time  	The time, in seconds.
+ * @param 		  	width 	Width of the frame.
+ * @param 		  	height	Height of the frame.
+ */
+
+void SequenceRenderer::setTime(IScene &scene, float time, int width, int height) {
+	if (!cameraKeys.empty()) {
+		int i;
+		const float f = findSegment(cameraKeys, time, i);
+		const CameraKeyframe &a = cameraKeys[i];
+		const CameraKeyframe &b = f == 0.0f ? a : cameraKeys[i + 1];
+		scene.camera->changeConfiguration(glm::mix(a.position, b.position, f),
+											glm::mix(a.lookAt, b.lookAt, f),
+											glm::mix(a.up, b.up, f));
+	}
+	scene.camera->calculateViewingParameters(width, height);
+
+	for (unsigned int i = 0; i < lightTracks.size(); i++) {
+		lightTracks[i].light->lightPosition = samplePosition(lightTracks[i].keys, time);
+	}
+
+	for (unsigned int i = 0; i < objectTracks.size(); i++) {
+		ObjectTrack &track = objectTracks[i];
+		const glm::vec3 offset = samplePosition(track.keys, time);
+		if (offset != track.applied) {
+			track.object->shape->translate(offset - track.applied);
+			track.applied = offset;
+			scene.markMoved(track.object);
+		}
+	}
+	scene.updateDynamicObjects();
+}
+
+/**
+ * @fn	bool SequenceRenderer::render(IScene &scene, const RayTracer &rayTracer, FrameBuffer &frameBuffer, int depth, int numFrames, const std::string &filenamePrefix, AsyncFrameWriter &writer, SequenceStats &stats)
+ * @brief	Renders the sequence: numFrames frames, evenly spaced from the first
+ * 			keyframe to the last, written as filenamePrefix0000.ppm and so on.
+ * @param [in,out]	scene		  	The scene.
+ * @param 		  	rayTracer	  	The ray tracer.
+ * @param [in,out]	frameBuffer   	Framebuffer each frame is traced into.
+ * @param 		  	depth		  	The recursion depth.
+ * @param 		  	numFrames	  	Number of frames.
+ * @param 		  	filenamePrefix	Start of each frame's filename.
+ * @param [in,out]	writer		  	Writes the frames.
+ * @param [in,out]	stats		  	What the sequence cost.
+ * @return	True iff any frames were rendered.
+ */
+
+bool SequenceRenderer::render(IScene &scene, const RayTracer &rayTracer, FrameBuffer &frameBuffer, int depth,
+								int numFrames, const std::string &filenamePrefix, AsyncFrameWriter &writer,
+								SequenceStats &stats) {
+	if (numFrames < 1) {
+		std::cerr << "A sequence needs at least one frame" << std::endl;
+		return false;
+	}
+	stats = SequenceStats();
+	double start = getSeconds();
+	prepare(scene);
+	stats.setupSeconds = getSeconds() - start;
+
+	const float startTime = getStartTime();
+	const float endTime = getEndTime();
+	for (int i = 0; i < numFrames; i++) {
+		const float time = numFrames == 1 ? startTime : startTime + (endTime - startTime) * i / (numFrames - 1);
+		start = getSeconds();
+		setTime(scene, time, frameBuffer.getWindowWidth(), frameBuffer.getWindowHeight());
+		const double updated = getSeconds();
+		rayTracer.raytraceScene(frameBuffer, depth, scene);
+		char number[16];
+		std::sprintf(number, "%04d.ppm", i);
+		writer.submit(frameBuffer, filenamePrefix + number);
+		const double finished = getSeconds();
+		stats.updateSeconds.push_back(updated - start);
+		stats.frameSeconds.push_back(finished - start);
+	}
+	start = getSeconds();
+	writer.flush();
+	stats.flushSeconds = getSeconds() - start;
+	return true;
+}
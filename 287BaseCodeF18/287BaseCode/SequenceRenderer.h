@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include "IScene.h"
+#include "Raytracer.h"
+#include "FrameWriter.h"
+
+/**
+ * @struct	CameraKeyframe
+ * @brief	Where the camera is at a given time.
+ */
+
+struct CameraKeyframe {
+	float time;			//!< Time of the keyframe, in seconds
+	glm::vec3 position;	//!< Position of the camera
+	glm::vec3 lookAt;	//!< Focus point
+	glm::vec3 up;		//!< Up vector
+};
+
+/**
+ * @struct	PositionKeyframe
+ * @brief	Where a light, or how far an object has moved, at a given time.
+ */
+
+struct PositionKeyframe {
+	float time;			//!< Time of the keyframe, in seconds
+	glm::vec3 position;	//!< A light's position, or an object's offset from where it was built
+};
+
+/**
+ * @struct	LightTrack
+ * @brief	The keyframes of one light.
+ */
+
+struct LightTrack {
+	PositionalLightPtr light;				//!< The light that moves
+	std::vector<PositionKeyframe> keys;		//!< Its keyframes, in time order
+};
+
+/**
+ * @struct	ObjectTrack
+ * @brief	The keyframes of one object.
+ */
+
+struct ObjectTrack {
+	VisibleIShapePtr object;				//!< The object that moves
+	std::vector<PositionKeyframe> keys;		//!< Its keyframes, in time order
+	glm::vec3 applied;						//!< Offset the object has been moved by so far
+};
+
+/**
+ * @struct	SequenceStats
+ * @brief	What a sequence cost to render. Setup is paid once; the amortized cost
+ * 			spreads it over the frames.
+ */
+
+struct SequenceStats {
+	double setupSeconds;					//!< Making objects dynamic and building any out-of-date hierarchy, once
+	std::vector<double> frameSeconds;		//!< Updating, tracing and handing off each frame
+	std::vector<double> updateSeconds;		//!< The part of each frame spent moving things and refitting
+	double flushSeconds;					//!< Waiting for the last frames to be written
+	SequenceStats() : setupSeconds(0.0), flushSeconds(0.0) {}
+	double getTotalSeconds() const;
+	double getAmortizedSeconds() const;
+	friend std::ostream &operator << (std::ostream &os, const SequenceStats &stats);
+};
+
+/**
+ * @struct	SequenceRenderer
+ * @brief	Renders a sequence of frames (e.g., a turntable or a fly-through) from
+ * 			keyframed camera, light and object positions, linearly interpolated.
+ * 			Everything that does not change from frame to frame is set up once:
+ * 			the static hierarchy is built before the first frame, animated
+ * 			objects are moved to the scene's dynamic hierarchy and refit each
+ * 			frame, and textures are the scene's own. Frames are written by an
+ * 			AsyncFrameWriter while the next one is traced.
+ */
+
+struct SequenceRenderer {
+	std::vector<CameraKeyframe> cameraKeys;		//!< Keyframes of the scene's camera, in time order
+	std::vector<LightTrack> lightTracks;		//!< One track per animated light
+	std::vector<ObjectTrack> objectTracks;		//!< One track per animated object
+	void addCameraKeyframe(float time, const glm::vec3 &position, const glm::vec3 &lookAt, const glm::vec3 &up);
+	void addLightKeyframe(PositionalLightPtr light, float time, const glm::vec3 &position);
+	void addObjectKeyframe(VisibleIShapePtr object, float time, const glm::vec3 &offset);
+	float getStartTime() const;
+	float getEndTime() const;
+	void prepare(IScene &scene);
+	void setTime(IScene &scene, float time, int width, int height);
+	bool render(IScene &scene, const RayTracer &rayTracer, FrameBuffer &frameBuffer, int depth,
+				int numFrames, const std::string &filenamePrefix, AsyncFrameWriter &writer,
+				SequenceStats &stats);
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/**
+ * @struct	vfloat4
+ * @brief	Four floats processed together using SSE2. Comparisons return
+ * 			all-ones/all-zeros lane masks, which select() consumes.
+ */
+
+struct vfloat4 {
+	static const int WIDTH = 4;		//!< Number of lanes
+	__m128 v;
+	vfloat4() {}
+	vfloat4(__m128 x) : v(x) {}
+	vfloat4(float x) : v(_mm_set1_ps(x)) {}
+	static vfloat4 load(const float *p) { return _mm_loadu_ps(p); }
+	void store(float *p) const { _mm_storeu_ps(p, v); }
+	int mask() const { return _mm_movemask_ps(v); }
+};
+
+inline vfloat4 operator +(const vfloat4 &a, const vfloat4 &b) { return _mm_add_ps(a.v, b.v); }
+inline vfloat4 operator -(const vfloat4 &a, const vfloat4 &b) { return _mm_sub_ps(a.v, b.v); }
+inline vfloat4 operator *(const vfloat4 &a, const vfloat4 &b) { return _mm_mul_ps(a.v, b.v); }
+inline vfloat4 operator /(const vfloat4 &a, const vfloat4 &b) { return _mm_div_ps(a.v, b.v); }
+inline vfloat4 operator <(const vfloat4 &a, const vfloat4 &b) { return _mm_cmplt_ps(a.v, b.v); }
+inline vfloat4 operator >(const vfloat4 &a, const vfloat4 &b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline vfloat4 operator >=(const vfloat4 &a, const vfloat4 &b) { return _mm_cmpge_ps(a.v, b.v); }
+inline vfloat4 operator &(const vfloat4 &a, const vfloat4 &b) { return _mm_and_ps(a.v, b.v); }
+inline vfloat4 operator |(const vfloat4 &a, const vfloat4 &b) { return _mm_or_ps(a.v, b.v); }
+inline vfloat4 vmin(const vfloat4 &a, const vfloat4 &b) { return _mm_min_ps(a.v, b.v); }
+inline vfloat4 vmax(const vfloat4 &a, const vfloat4 &b) { return _mm_max_ps(a.v, b.v); }
+inline vfloat4 vsqrt(const vfloat4 &a) { return _mm_sqrt_ps(a.v); }
+inline vfloat4 select(const vfloat4 &mask, const vfloat4 &a, const vfloat4 &b) {
+	return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+
+/**
+ * @fn	inline vfloat4 vlog2(const vfloat4 &x)
+ * @brief	Base 2 logarithm of positive, normal x. Absolute error is below 1e-5.
+ * @param	x	The argument.
+ * @return	log2(x).
+ */
+
+inline vfloat4 vlog2(const vfloat4 &x) {
+	const __m128i bits = _mm_castps_si128(x.v);
+	const __m128i exponent = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+	const vfloat4 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)),
+													_mm_set1_epi32(0x3F800000)));
+	// ln(m) = 2 atanh(t), with t = (m - 1) / (m + 1) in [0, 1/3)
+	const vfloat4 t = (m - 1.0f) / (m + 1.0f);
+	const vfloat4 t2 = t * t;
+	const vfloat4 series = t * (2.0f + t2 * (0.666666667f + t2 * (0.4f + t2 * (0.285714286f + t2 * 0.222222222f))));
+	return vfloat4(_mm_cvtepi32_ps(exponent)) + series * 1.442695041f;
+}
+
+/**
+ * @fn	inline vfloat4 vexp2(const vfloat4 &x)
+ * @brief	2 raised to x. Relative error is below 1e-5. x is clamped to [-126, 126].
+ * @param	x	The exponent.
+ * @return	2^x.
+ */
+
+inline vfloat4 vexp2(const vfloat4 &x) {
+	const vfloat4 c = vmin(vmax(x, -126.0f), 126.0f);
+	__m128i i = _mm_cvttps_epi32(c.v);
+	// Truncation rounds negatives up; step back to the floor.
+	const vfloat4 truncated = _mm_cvtepi32_ps(i);
+	i = _mm_add_epi32(i, _mm_castps_si128((truncated > c).v));
+	const vfloat4 f = (c - vfloat4(_mm_cvtepi32_ps(i))) * 0.693147181f;
+	const vfloat4 poly = 1.0f + f * (1.0f + f * (0.5f + f * (0.166666667f + f * (0.041666667f +
+						f * (0.008333333f + f * 0.001388889f)))));
+	const vfloat4 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23));
+	return poly * scale;
+}
+
+/**
+ * @fn	inline vfloat4 vpow(const vfloat4 &x, const vfloat4 &y)
+ * @brief	x raised to y, for x >= 0. Zero (and negative) x gives 0.
+ * @param	x	The base.
+ * @param	y	The exponent.
+ * @return	x^y.
+ */
+
+inline vfloat4 vpow(const vfloat4 &x, const vfloat4 &y) {
+	const vfloat4 positive = x > 0.0f;
+	const vfloat4 safeX = select(positive, x, 1.0f);
+	return select(positive, vexp2(y * vlog2(safeX)), 0.0f);
+}
+
+#ifdef __AVX2__
+
+/**
+ * @struct	vfloat8
+ * @brief	Eight floats processed together using AVX2. Same interface as vfloat4.
+ */
+
+struct vfloat8 {
+	static const int WIDTH = 8;		//!< Number of lanes
+	__m256 v;
+	vfloat8() {}
+	vfloat8(__m256 x) : v(x) {}
+	vfloat8(float x) : v(_mm256_set1_ps(x)) {}
+	static vfloat8 load(const float *p) { return _mm256_loadu_ps(p); }
+	void store(float *p) const { _mm256_storeu_ps(p, v); }
+	int mask() const { return _mm256_movemask_ps(v); }
+};
+
+inline vfloat8 operator +(const vfloat8 &a, const vfloat8 &b) { return _mm256_add_ps(a.v, b.v); }
+inline vfloat8 operator -(const vfloat8 &a, const vfloat8 &b) { return _mm256_sub_ps(a.v, b.v); }
+inline vfloat8 operator *(const vfloat8 &a, const vfloat8 &b) { return _mm256_mul_ps(a.v, b.v); }
+inline vfloat8 operator /(const vfloat8 &a, const vfloat8 &b) { return _mm256_div_ps(a.v, b.v); }
+inline vfloat8 operator <(const vfloat8 &a, const vfloat8 &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline vfloat8 operator >(const vfloat8 &a, const vfloat8 &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline vfloat8 operator >=(const vfloat8 &a, const vfloat8 &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline vfloat8 operator &(const vfloat8 &a, const vfloat8 &b) { return _mm256_and_ps(a.v, b.v); }
+inline vfloat8 operator |(const vfloat8 &a, const vfloat8 &b) { return _mm256_or_ps(a.v, b.v); }
+inline vfloat8 vmin(const vfloat8 &a, const vfloat8 &b) { return _mm256_min_ps(a.v, b.v); }
+inline vfloat8 vmax(const vfloat8 &a, const vfloat8 &b) { return _mm256_max_ps(a.v, b.v); }
+inline vfloat8 vsqrt(const vfloat8 &a) { return _mm256_sqrt_ps(a.v); }
+inline vfloat8 select(const vfloat8 &mask, const vfloat8 &a, const vfloat8 &b) {
+	return _mm256_blendv_ps(b.v, a.v, mask.v);
+}
+
+inline vfloat8 vlog2(const vfloat8 &x) {
+	const __m256i bits = _mm256_castps_si256(x.v);
+	const __m256i exponent = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127));
+	const vfloat8 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)),
+														_mm256_set1_epi32(0x3F800000)));
+	const vfloat8 t = (m - 1.0f) / (m + 1.0f);
+	const vfloat8 t2 = t * t;
+	const vfloat8 series = t * (2.0f + t2 * (0.666666667f + t2 * (0.4f + t2 * (0.285714286f + t2 * 0.222222222f))));
+	return vfloat8(_mm256_cvtepi32_ps(exponent)) + series * 1.442695041f;
+}
+
+inline vfloat8 vexp2(const vfloat8 &x) {
+	const vfloat8 c = vmin(vmax(x, -126.0f), 126.0f);
+	const vfloat8 floorC = _mm256_floor_ps(c.v);
+	const __m256i i = _mm256_cvtps_epi32(floorC.v);
+	const vfloat8 f = (c - floorC) * 0.693147181f;
+	const vfloat8 poly = 1.0f + f * (1.0f + f * (0.5f + f * (0.166666667f + f * (0.041666667f +
+						f * (0.008333333f + f * 0.001388889f)))));
+	const vfloat8 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(i, _mm256_set1_epi32(127)), 23));
+	return poly * scale;
+}
+
+inline vfloat8 vpow(const vfloat8 &x, const vfloat8 &y) {
+	const vfloat8 positive = x > 0.0f;
+	const vfloat8 safeX = select(positive, x, 1.0f);
+	return select(positive, vexp2(y * vlog2(safeX)), 0.0f);
+}
+
+typedef vfloat8 vfloatN;	//!< Widest vector type available
+#else
+typedef vfloat4 vfloatN;	//!< Widest vector type available
+#endif
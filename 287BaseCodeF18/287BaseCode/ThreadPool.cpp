@@ -0,0 +1,126 @@
+#include "ThreadPool.h"
+
+static thread_local bool insideParallelFor = false;	//!< True on a thread running loop iterations
+
+/**
+ * @fn	ThreadPool::ThreadPool(int numThreads)
+ * @brief	Constructor. Starts the worker threads.
+ * @param	numThreads	Total number of threads, including the caller. 0 means
+ * 						one per hardware thread.
+ */
+
+ThreadPool::ThreadPool(int numThreads)
+	: body(nullptr), count(0), nextIteration(0), busyWorkers(0), generation(0), stopping(false) {
+	if (numThreads <= 0) {
+		numThreads = (int)std::thread::hardware_concurrency();
+	}
+	for (int i = 1; i < numThreads; i++) {
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+/**
+ * @fn	ThreadPool::~ThreadPool()
+ * @brief	Destructor. Stops the worker threads.
+ */
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobReady.notify_all();
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+}
+
+/**
+ * @fn	ThreadPool &ThreadPool::getShared()
+ * @brief	Gets a pool shared by the renderers, with one thread per hardware thread.
+ * @return	The shared pool.
+ */
+
+ThreadPool &ThreadPool::getShared() {
+	static ThreadPool pool;
+	return pool;
+}
+
+/**
+ * @fn	void ThreadPool::parallelFor(int N, const std::function<void(int)> &func)
+ * @brief	Runs func(0) ... func(N - 1) across the pool, and returns when all
+ * 			have finished. Iterations may run in any order. If called from
+ * 			inside an iteration, the loop runs serially on the calling thread.
+ * @param	N	 	Number of iterations.
+ * @param	func	The loop body.
+ */
+
+void ThreadPool::parallelFor(int N, const std::function<void(int)> &func) {
+	if (N <= 0) {
+		return;
+	}
+	if (workers.empty() || N == 1 || insideParallelFor) {
+		for (int i = 0; i < N; i++) {
+			func(i);
+		}
+		return;
+	}
+
+	std::lock_guard<std::mutex> submitLock(submitMutex);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		body = &func;
+		count = N;
+		nextIteration = 0;
+		busyWorkers = (int)workers.size();
+		generation++;
+	}
+	jobReady.notify_all();
+
+	runIterations();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	jobDone.wait(lock, [this] { return busyWorkers == 0; });
+	body = nullptr;
+}
+
+/**
+ * @fn	void ThreadPool::runIterations()
+ * @brief	Claims and runs iterations of the current loop until none are left.
+ */
+
+void ThreadPool::runIterations() {
+	insideParallelFor = true;
+	int i;
+	while ((i = nextIteration.fetch_add(1)) < count) {
+		(*body)(i);
+	}
+	insideParallelFor = false;
+}
+
+/**
+ * @fn	void ThreadPool::workerLoop()
+ * @brief	Body of each worker thread.
+ */
+
+void ThreadPool::workerLoop() {
+	unsigned int lastGeneration = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobReady.wait(lock, [&] { return stopping || generation != lastGeneration; });
+			if (stopping) {
+				return;
+			}
+			lastGeneration = generation;
+		}
+
+		runIterations();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busyWorkers--;
+		}
+		jobDone.notify_one();
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * @struct	ThreadPool
+ * @brief	A fixed set of worker threads that run the iterations of a parallel
+ * 			loop. Iterations are handed out dynamically, so uneven work (e.g.,
+ * 			tiles of differing complexity) is balanced. The calling thread
+ * 			takes part in the loop.
+ */
+
+struct ThreadPool {
+	ThreadPool(int numThreads = 0);
+	~ThreadPool();
+	int getNumThreads() const { return (int)workers.size() + 1; }
+	void parallelFor(int N, const std::function<void(int)> &func);
+	static ThreadPool &getShared();
+protected:
+	void workerLoop();
+	void runIterations();
+	std::vector<std::thread> workers;		//!< The worker threads, not counting the caller
+	std::mutex submitMutex;					//!< Serializes calls to parallelFor
+	std::mutex mutex;						//!< Guards the job state below
+	std::condition_variable jobReady;		//!< Signalled when a new loop starts
+	std::condition_variable jobDone;		//!< Signalled when a worker finishes its part
+	const std::function<void(int)> *body;	//!< Body of the current loop
+	int count;								//!< Number of iterations in the current loop
+	std::atomic<int> nextIteration;			//!< Next iteration to hand out
+	int busyWorkers;						//!< Workers still running the current loop
+	unsigned int generation;				//!< Incremented for each loop
+	bool stopping;							//!< True ==> workers should exit
+};
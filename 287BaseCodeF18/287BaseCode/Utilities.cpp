@@ -1044,7 +1044,7 @@ std::string extractBaseFilename(const std::string &str) {
 	return str.substr(pos + 1);
 }
 
-bool DEBUG_PIXEL = false;
+thread_local bool DEBUG_PIXEL = false;
 int xDebug = -1, yDebug = -1;
 
 void mouseUtility(int b, int s, int x, int y) {
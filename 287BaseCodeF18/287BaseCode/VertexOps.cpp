@@ -1,4 +1,7 @@
+#include <algorithm>
+#include <functional>
 #include "VertexOps.h"
+#include "PhongKernel.h"
 
 // Pipeline transformation matrices
 glm::mat4 VertexOps::modelingTransformation;
@@ -6,6 +9,10 @@ glm::mat4 VertexOps::viewingTransformation;
 glm::mat4 VertexOps::projectionTransformation;
 glm::mat4 VertexOps::viewportTransformation;
 bool VertexOps::renderBackFaces = true;
+bool VertexOps::binnedRasterization = false;
+bool VertexOps::perVertexLighting = false;
+int VertexOps::parallelVertexThreshold = 16384;
+float VertexOps::guardBand = 2.0f;
 
 const BoundingBox3D VertexOps::ndc(-1, 1, -1, 1, -1, 1);	//l,r,b,t,n,f
 BoundingBoxi VertexOps::viewport(0, WINDOW_WIDTH - 1, 0, WINDOW_HEIGHT - 1);
@@ -19,87 +26,86 @@ std::vector<IPlane> VertexOps::ndcPlanes{ IPlane(glm::vec3(0, 1, 0), glm::vec3(0
 											IPlane(glm::vec3(0, 0, -1), glm::vec3(0, 0, 1)) };
 
 /**
- * @fn	std::vector<VertexData> triangulate(const std::vector<VertexData> &poly)
- * @brief	Triangulates the given polygon
- * @param	poly	The polygon to be decomposed into individual triangles.
- * @return	A vector of triangles, which comprise the original polygon.
+ * @fn	void VertexOps::clipAgainstPlane(const ClipPolygon &input, const IPlane &plane, ClipPolygon &output)
+ * @brief	Clips a polygon against a single plane
+ * @param 		  	input 	The polygon to clip.
+ * @param 		  	plane 	The plane that will do the clipping.
+ * @param [in,out]	output	Receives the portion of the polygon inside the given plane.
  */
 
-std::vector<VertexData> triangulate(const std::vector<VertexData> &poly) {
-	std::vector<VertexData> triangles;
-
-	for (unsigned int i = 1; i < poly.size() - 1; i++) {
-		triangles.push_back(poly[0]);
-		triangles.push_back(poly[i]);
-		triangles.push_back(poly[i + 1]);
+void VertexOps::clipAgainstPlane(const ClipPolygon &input, const IPlane &plane, ClipPolygon &output) {
+	output.count = 0;
+	if (input.count < 3) {
+		return;
 	}
 
-	return triangles;
+	// Edges are visited starting with (0, 1) and ending with (count - 1, 0).
+	int prev = 0;
+	bool prevIn = plane.insidePlane(input.verts[0].position.xyz);
+	for (int j = 1; j <= input.count; j++) {
+		const int i = j % input.count;
+		const VertexData &v0 = input.verts[prev];
+		const VertexData &v1 = input.verts[i];
+		bool v1In = plane.insidePlane(v1.position.xyz);
+
+		if (prevIn && v1In) {
+			output.verts[output.count++] = v1;
+		} else if (prevIn || v1In) {
+			float t;
+			plane.findIntersection(v0.position.xyz, v1.position.xyz, t);
+			output.verts[output.count++] = VertexData(1.0f - t, v0, t, v1);
+			if (!prevIn && v1In) {
+				output.verts[output.count++] = v1;
+			}
+		}
+		prev = i;
+		prevIn = v1In;
+	}
 }
 
 /**
- * @fn	std::vector<VertexData> VertexOps::clipAgainstPlane(std::vector<VertexData> &verts, const IPlane &plane)
- * @brief	Clips a polygon against a single plane
- * @param [in,out]	verts	The array of vertices.
- * @param 		  	plane	The plane that will do the clipping.
- * @return	The polygon that exludes the portions outside the given plane.
+ * @fn	static unsigned int outcode(const glm::vec4 &p, float xyLimit)
+ * @brief	Computes which planes of the view volume a point is outside of. Bit i
+ * 			stands for VertexOps::ndcPlanes[i]. The x and y planes are placed at
+ * 			+/- xyLimit, so the same test serves the view volume and the guard band.
+ * @param	p	   	Point in normalized device coordinates.
+ * @param	xyLimit	Position of the x and y planes.
+ * @return	The outcode.
  */
 
-std::vector<VertexData> VertexOps::clipAgainstPlane(std::vector<VertexData> &verts, const IPlane &plane) {
-	std::vector<VertexData> output;
-
-	if (verts.size() > 2) {
-		verts.push_back(verts[0]);
-
-		for (unsigned int i = 1; i < verts.size(); i++) {
-			bool v0In = plane.insidePlane(verts[i - 1].position.xyz);
-			bool v1In = plane.insidePlane(verts[i].position.xyz);
-
-			if (v0In && v1In) {
-				output.push_back(verts[i]);
-			} else if (v0In || v1In) {
-				float t;
-				plane.findIntersection(verts[i - 1].position.xyz, verts[i].position.xyz, t);
-				VertexData I(1.0f - t, verts[i - 1], t, verts[i]);
-				output.push_back(I);
-				if (!v0In && v1In) {
-					output.push_back(verts[i]);
-				}
-			}
-		}
-	}
-	return output;
+static unsigned int outcode(const glm::vec4 &p, float xyLimit) {
+	return (p.y > xyLimit ? 0x01 : 0) | (p.x > xyLimit ? 0x02 : 0) | (p.z > 1.0f ? 0x04 : 0) |
+			(p.x < -xyLimit ? 0x08 : 0) | (p.y < -xyLimit ? 0x10 : 0) | (p.z < -1.0f ? 0x20 : 0);
 }
 
 /**
- * @fn	std::vector<VertexData> VertexOps::clipPolygon(const std::vector<VertexData> &clipCoords)
+ * @fn	void VertexOps::clipPolygon(ClipPolygon &polygon, ClipPolygon &scratch, unsigned int planeMask)
  * @brief	Clip polygon against the normalized view volumn - 2x2x2 cube.
- * @param	clipCoords	The array of triangles.
- * @return	The array of triangles, after performing clipping.
+ * @param [in,out]	polygon  	The polygon, which is replaced by its clipped version.
+ * @param [in,out]	scratch  	Working storage.
+ * @param 		  	planeMask	Outcode bits of the planes to clip against.
  */
 
-std::vector<VertexData> VertexOps::clipPolygon(const std::vector<VertexData> &clipCoords) {
-	std::vector<VertexData> ndcCoords;
-
-	if (clipCoords.size() > 2) {
-		for (unsigned int i = 0; i < clipCoords.size() - 2; i += 3) {
-			std::vector<VertexData> polygon;
-			polygon.push_back(clipCoords[i]);
-			polygon.push_back(clipCoords[i + 1]);
-			polygon.push_back(clipCoords[i + 2]);
-
-			for (IPlane plane : ndcPlanes) {
-				polygon = clipAgainstPlane(polygon, plane);
-			}
-			if (polygon.size() > 3) {
-				polygon = triangulate(polygon);
-			}
-			for (VertexData v : polygon) {
-				ndcCoords.push_back(v);
-			}
+void VertexOps::clipPolygon(ClipPolygon &polygon, ClipPolygon &scratch, unsigned int planeMask) {
+	// Alternate between the two polygons, copying back at the end if needed.
+	ClipPolygon *src = &polygon, *dest = &scratch;
+	for (unsigned int i = 0; i < ndcPlanes.size(); i++) {
+		if ((planeMask & (1u << i)) == 0) {
+			continue;
+		}
+		clipAgainstPlane(*src, ndcPlanes[i], *dest);
+		std::swap(src, dest);
+		if (src->count < 3) {
+			polygon.count = 0;
+			return;
+		}
+	}
+	if (src != &polygon) {
+		polygon.count = src->count;
+		for (int i = 0; i < src->count; i++) {
+			polygon.verts[i] = src->verts[i];
 		}
 	}
-	return ndcCoords;
 }
 
 /**
@@ -146,27 +152,115 @@ std::vector<VertexData> VertexOps::clipLineSegments(const std::vector<VertexData
 	return ndcCoords;
 }
 
- /**
- * @fn	std::vector<VertexData> VertexOps::removeBackwardFacingTriangles(const std::vector<VertexData> &triangleVerts)
- * @brief	Removes the backward facing triangles
- * @param	triangleVerts	The vector of triangle vertices.
- * @return	Vector of triangle vertices, without those facing backward.
+/**
+ * @fn	bool VertexOps::isBackwardFacing(const VertexData &v0, const VertexData &v1, const VertexData &v2)
+ * @brief	Determines if a triangle in normalized device coordinates faces away from the viewer.
+ * @param	v0	The first vertex.
+ * @param	v1	The second vertex.
+ * @param	v2	The third vertex.
+ * @return	True if the triangle faces backward.
  */
 
-std::vector<VertexData> VertexOps::removeBackwardFacingTriangles(const std::vector<VertexData> &triangleVerts) {
-	std::vector<VertexData> fowardFacingTriangles;
+bool VertexOps::isBackwardFacing(const VertexData &v0, const VertexData &v1, const VertexData &v2) {
 	const glm::vec3 viewDirection(0.0f, 0.0f, -1.0f);
+	glm::vec3 n = normalFrom3Points(v0.position.xyz, v1.position.xyz, v2.position.xyz);
+	return glm::dot(viewDirection, n) > 0.0;
+}
+
+/**
+ * @fn	void VertexOps::transformToNDC(const glm::vec4 &position, const glm::vec3 &normal, const Material &material, const glm::mat4 &modelMatrix, const glm::mat3 &normalMatrix, const glm::mat4 &projViewMatrix, VertexData &ndcVertex)
+ * @brief	Takes one vertex from object coordinates to world coordinates, and then
+ * 			through the viewing and projection transformations and the perspective
+ * 			division, in a single step.
+ * @param 		  	position	  	The vertex in object coordinates.
+ * @param 		  	normal		  	The vertex's normal.
+ * @param 		  	material	  	The vertex's material.
+ * @param 		  	modelMatrix   	Modeling matrix.
+ * @param 		  	normalMatrix  	Matrix for transforming normals to world coordinates.
+ * @param 		  	projViewMatrix	Projection times viewing matrix.
+ * @param [in,out]	ndcVertex	  	Receives the transformed vertex.
+ */
 
-	for (int i = 0; i < (int)triangleVerts.size() - 2; i += 3) {
-		glm::vec3 n = normalFrom3Points(triangleVerts[i].position.xyz, triangleVerts[i + 1].position.xyz, triangleVerts[i + 2].position.xyz);
+void VertexOps::transformToNDC(const glm::vec4 &position, const glm::vec3 &normal, const Material &material,
+								const glm::mat4 &modelMatrix, const glm::mat3 &normalMatrix,
+								const glm::mat4 &projViewMatrix, VertexData &ndcVertex) {
+	glm::vec4 worldPos = modelMatrix * position;
+	glm::vec4 v = projViewMatrix * worldPos;
+	if (v.w >= 0)		// Perspective division
+		v /= v.w;
+	else {
+		v.x /= -v.w;
+		v.y /= -v.w;
+		v.z = -std::abs(v.z);
+		v.w = 1.0f;
+	}
+	ndcVertex.position = v;
+	ndcVertex.normal = glm::normalize(normalMatrix * normal);
+	ndcVertex.worldPosition = worldPos.xyz;
+	ndcVertex.material = material;
+}
 
-		if (glm::dot(viewDirection, n) <= 0.0) {
-			fowardFacingTriangles.push_back(triangleVerts[i]);
-			fowardFacingTriangles.push_back(triangleVerts[i + 1]);
-			fowardFacingTriangles.push_back(triangleVerts[i + 2]);
-		}
+/**
+ * @fn	void VertexOps::addClippedTriangle(ClipPolygon &polygon, ClipPolygon &scratch, std::vector<VertexData> &windowCoords)
+ * @brief	Takes a triangle in normalized device coordinates through backface
+ * 			culling, clipping and the viewport transformation, and appends the
+ * 			resulting triangles to windowCoords. Triangles entirely outside one
+ * 			plane of the view volume are rejected from their outcodes. The rest
+ * 			are only clipped against the near and far planes they cross, and
+ * 			against the x and y planes if they extend beyond the guard band;
+ * 			otherwise the rasterizer's scissor rectangle trims them to the viewport.
+ * @param [in,out]	polygon			The triangle, in its first three vertices. Used as working storage.
+ * @param [in,out]	scratch			Working storage.
+ * @param [in,out]	windowCoords	Receives the triangles in window coordinates.
+ */
+
+void VertexOps::addClippedTriangle(ClipPolygon &polygon, ClipPolygon &scratch, std::vector<VertexData> &windowCoords) {
+	const glm::vec4 &p0 = polygon.verts[0].position;
+	const glm::vec4 &p1 = polygon.verts[1].position;
+	const glm::vec4 &p2 = polygon.verts[2].position;
+	if ((outcode(p0, 1.0f) & outcode(p1, 1.0f) & outcode(p2, 1.0f)) != 0)	// trivial reject
+		return;
+	if (!renderBackFaces && isBackwardFacing(polygon.verts[0], polygon.verts[1], polygon.verts[2]))
+		return;
+
+	polygon.count = 3;
+	const unsigned int crossed = outcode(p0, guardBand) | outcode(p1, guardBand) | outcode(p2, guardBand);
+	if (crossed != 0) {
+		clipPolygon(polygon, scratch, crossed);
+	}
+
+	for (int k = 0; k < polygon.count; k++) {
+		glm::vec4 &p = polygon.verts[k].position;
+		p = viewportTransformation * p;
+	}
+	for (int k = 1; k < polygon.count - 1; k++) {	// Triangulate as a fan
+		windowCoords.push_back(polygon.verts[0]);
+		windowCoords.push_back(polygon.verts[k]);
+		windowCoords.push_back(polygon.verts[k + 1]);
+	}
+}
+
+/**
+ * @fn	void VertexOps::rasterizeTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &windowCoords)
+ * @brief	Hands triangles in window coordinates to the rasterizer, scissored
+ * 			to the viewport.
+ * @param [in,out]	frameBuffer 	Buffer for frame data.
+ * @param 		  	eyePos			The eye position.
+ * @param 		  	lights			The lights.
+ * @param 		  	windowCoords	The triangles in window coordinates.
+ */
+
+void VertexOps::rasterizeTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
+									const std::vector<LightSourcePtr> &lights,
+									const std::vector<VertexData> &windowCoords) {
+	BoundingBoxi scissor(std::max(viewport.lx, 0), std::min(viewport.rx, frameBuffer.getWindowWidth() - 1),
+						std::max(viewport.ly, 0), std::min(viewport.ry, frameBuffer.getWindowHeight() - 1));
+	if (binnedRasterization) {
+		drawManyFilledTrianglesBinned(frameBuffer, eyePos, lights, windowCoords, viewingTransformation,
+										ThreadPool::getShared(), scissor);
+	} else {
+		drawManyFilledTriangles(frameBuffer, eyePos, lights, windowCoords, viewingTransformation, scissor);
 	}
-	return fowardFacingTriangles;
 }
 
 /**
@@ -193,6 +287,76 @@ std::vector<VertexData> VertexOps::transformVerticesToWorldCoordinates(const glm
 	return transformedVertices;
 }
 
+/**
+ * @fn	void VertexOps::lightVertices(VertexData *vertices, int count, const LightBlock &lighting)
+ * @brief	Lights vertices in world coordinates, vfloatN::WIDTH at a time, taking
+ * 			one light at a time across the whole batch. The color replaces the
+ * 			material's ambient property, which is what the rasterizer interpolates.
+ * @param [in,out]	vertices	The vertices.
+ * @param 		  	count   	Number of vertices.
+ * @param 		  	lighting	The lights and camera, prepared for this draw.
+ */
+
+void VertexOps::lightVertices(VertexData *vertices, int count, const LightBlock &lighting) {
+	typedef vfloatN VF;
+	const int W = VF::WIDTH;
+	const int NUM_ATTRIBUTES = 16;
+
+	for (int first = 0; first < count; first += W) {
+		const int lanes = std::min(W, count - first);
+
+		// Transpose to structure-of-arrays. A partial batch repeats its last vertex.
+		float attribute[NUM_ATTRIBUTES][W];
+		for (int lane = 0; lane < W; lane++) {
+			const VertexData &v = vertices[first + std::min(lane, lanes - 1)];
+			const Material &m = v.material;
+			const float values[NUM_ATTRIBUTES] = { v.worldPosition.x, v.worldPosition.y, v.worldPosition.z,
+													v.normal.x, v.normal.y, v.normal.z,
+													m.ambient.r, m.ambient.g, m.ambient.b,
+													m.diffuse.r, m.diffuse.g, m.diffuse.b,
+													m.specular.r, m.specular.g, m.specular.b, m.shininess };
+			for (int a = 0; a < NUM_ATTRIBUTES; a++) {
+				attribute[a][lane] = values[a];
+			}
+		}
+		SurfaceBatch<VF> s;
+		s.px = VF::load(attribute[0]);
+		s.py = VF::load(attribute[1]);
+		s.pz = VF::load(attribute[2]);
+		s.nx = VF::load(attribute[3]);
+		s.ny = VF::load(attribute[4]);
+		s.nz = VF::load(attribute[5]);
+		completeSurfaceBatch(s, lighting.eyeFrame.origin);
+		s.ambR = VF::load(attribute[6]);
+		s.ambG = VF::load(attribute[7]);
+		s.ambB = VF::load(attribute[8]);
+		s.diffR = VF::load(attribute[9]);
+		s.diffG = VF::load(attribute[10]);
+		s.diffB = VF::load(attribute[11]);
+		s.specR = VF::load(attribute[12]);
+		s.specG = VF::load(attribute[13]);
+		s.specB = VF::load(attribute[14]);
+		s.shininess = VF::load(attribute[15]);
+
+		VF R(0.0f), G(0.0f), B(0.0f);
+		for (const LightParams &light : lighting.flatLights) {
+			accumulatePhong(light, s, R, G, B);
+		}
+		float r[W], g[W], b[W];
+		R.store(r);
+		G.store(g);
+		B.store(b);
+		for (int lane = 0; lane < lanes; lane++) {
+			VertexData &v = vertices[first + lane];
+			color totalLight(r[lane], g[lane], b[lane]);
+			for (LightSourcePtr light : lighting.otherLights) {
+				totalLight += light->illuminate(v.worldPosition, v.normal, v.material, lighting.eyeFrame, false);
+			}
+			v.material.ambient = totalLight;
+		}
+	}
+}
+
 /**
  * @fn	void VertexOps::applyLighting(const std::vector<LightSourcePtr> &lights, std::vector<VertexData> &worldCoords)
  * @brief	Applies the lighting to all the vertices. Modifies the VertexData's material field.
@@ -201,18 +365,9 @@ std::vector<VertexData> VertexOps::transformVerticesToWorldCoordinates(const glm
  */
 
 void VertexOps::applyLighting(const std::vector<LightSourcePtr> &lights, std::vector<VertexData> &worldCoords) {
-	Frame eyeFrame = Frame::createOrthoNormalBasis(VertexOps::viewingTransformation);
-	for (unsigned int i = 0; i < worldCoords.size(); i++) {
-		VertexData &vert = worldCoords[i];
-		float alpha = worldCoords[i].material.alpha;
-		color totalLight = black;
-
-		for (unsigned int j = 0; j < lights.size(); j++) {
-			totalLight += lights[j]->illuminate(vert.worldPosition, vert.normal, vert.material,
-												eyeFrame, false);
-		}
-		worldCoords[i].material.ambient = totalLight;
-	}
+	LightBlock lighting;
+	lighting.prepare(lights, VertexOps::viewingTransformation);
+	lightVertices(worldCoords.data(), (int)worldCoords.size(), lighting);
 }
 
 /**
@@ -236,9 +391,95 @@ std::vector<VertexData> VertexOps::transformVertices(const glm::mat4 &TM, const
 	return transformedVertices;
 }
 
+/**
+ * @fn	static void runInChunks(int numTriangles, const std::function<void(int, int, std::vector<VertexData> &)> &stage, std::vector<VertexData> &windowCoords)
+ * @brief	Runs a vertex stage over chunks of VERTEX_CHUNK triangles on the shared
+ * 			thread pool. Each chunk writes its own output; a prefix sum over the
+ * 			output sizes then places every chunk in windowCoords, in triangle order.
+ * @param 		  	numTriangles	Number of triangles.
+ * @param 		  	stage			Processes triangles [first, last), appending to its output.
+ * @param [in,out]	windowCoords	Receives the output of all of the chunks.
+ */
+
+static void runInChunks(int numTriangles, const std::function<void(int, int, std::vector<VertexData> &)> &stage,
+						std::vector<VertexData> &windowCoords) {
+	// Reused from draw to draw. The workers reach the caller's copies through the references.
+	static thread_local std::vector<std::vector<VertexData>> callerChunks;
+	static thread_local std::vector<size_t> callerOffsets;
+	std::vector<std::vector<VertexData>> &chunks = callerChunks;
+	std::vector<size_t> &offsets = callerOffsets;
+	const int numChunks = (numTriangles + VERTEX_CHUNK - 1) / VERTEX_CHUNK;
+	if ((int)chunks.size() < numChunks) {
+		chunks.resize(numChunks);
+	}
+
+	ThreadPool &pool = ThreadPool::getShared();
+	pool.parallelFor(numChunks, [&](int c) {
+		chunks[c].clear();
+		stage(c * VERTEX_CHUNK, std::min(numTriangles, (c + 1) * VERTEX_CHUNK), chunks[c]);
+	});
+
+	// Exclusive prefix sum of the chunk sizes gives where each chunk starts.
+	offsets.resize(numChunks + 1);
+	offsets[0] = windowCoords.size();
+	for (int c = 0; c < numChunks; c++) {
+		offsets[c + 1] = offsets[c] + chunks[c].size();
+	}
+	windowCoords.resize(offsets[numChunks]);
+	pool.parallelFor(numChunks, [&](int c) {
+		std::copy(chunks[c].begin(), chunks[c].end(), windowCoords.begin() + offsets[c]);
+	});
+}
+
+/**
+ * @fn	void VertexOps::processTriangleRange(const std::vector<VertexData> &objectCoords, int first, int last, const glm::mat3 &normalMatrix, const glm::mat4 &projViewMatrix, const LightBlock *lighting, std::vector<VertexData> &windowCoords)
+ * @brief	Takes triangles [first, last) of a triangle list through the vertex
+ * 			stages. A small batch of triangles at a time passes through every
+ * 			stage, so lighting sees full batches of vertices. Safe to call from
+ * 			several threads at once.
+ * @param 		  	objectCoords  	The triangles, in object coordinates.
+ * @param 		  	first		  	First triangle.
+ * @param 		  	last		  	One past the last triangle.
+ * @param 		  	normalMatrix  	Matrix for transforming normals to world coordinates.
+ * @param 		  	projViewMatrix	Projection times viewing matrix.
+ * @param 		  	lighting	  	The lights, or nullptr if vertices are not lit.
+ * @param [in,out]	windowCoords  	Receives the triangles in window coordinates.
+ */
+
+void VertexOps::processTriangleRange(const std::vector<VertexData> &objectCoords, int first, int last,
+									const glm::mat3 &normalMatrix, const glm::mat4 &projViewMatrix,
+									const LightBlock *lighting, std::vector<VertexData> &windowCoords) {
+	static thread_local ClipPolygon polygon, scratch;
+	static thread_local VertexData batch[3 * TRIANGLE_BATCH];
+
+	const int end = 3 * last;
+	for (int start = 3 * first; start < end; start += 3 * TRIANGLE_BATCH) {
+		const int count = std::min(3 * TRIANGLE_BATCH, end - start);
+		for (int j = 0; j < count; j++) {
+			const VertexData &v = objectCoords[start + j];
+			transformToNDC(v.position, v.normal, v.material, modelingTransformation, normalMatrix,
+							projViewMatrix, batch[j]);
+		}
+		if (lighting != nullptr) {
+			lightVertices(batch, count, *lighting);
+		}
+		for (int j = 0; j < count; j += 3) {
+			polygon.verts[0] = batch[j];
+			polygon.verts[1] = batch[j + 1];
+			polygon.verts[2] = batch[j + 2];
+			addClippedTriangle(polygon, scratch, windowCoords);
+		}
+	}
+}
+
 /**
  * @fn	void VertexOps::processTriangleVertices(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights, const std::vector<VertexData> &objectCoords)
  * @brief	Transforms the triangle vertices through pipeline: object -> world -> eye -> clip/ndc -> window.
+ * 			Triangles stream through every stage using per-thread buffers, so a
+ * 			warmed-up pipeline does not allocate. Vertices are lit along the way
+ * 			when perVertexLighting is set, unless shading is deferred. Lists of
+ * 			parallelVertexThreshold or more triangles are split into chunks
+ * 			processed in parallel; the output keeps the triangles' order either way.
  * @param [in,out]	frameBuffer 	Buffer for frame data.
  * @param 		  	eyePos			The eye position.
  * @param 		  	lights			The lights.
@@ -248,35 +489,144 @@ std::vector<VertexData> VertexOps::transformVertices(const glm::mat4 &TM, const
 void VertexOps::processTriangleVertices(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
 										const std::vector<LightSourcePtr> &lights,
 										const std::vector<VertexData> &objectCoords) {
-	std::vector<VertexData> worldCoords = transformVerticesToWorldCoordinates(modelingTransformation, objectCoords);
-	std::vector<VertexData> eyeCoords = transformVertices(viewingTransformation, worldCoords);
-	glm::mat4 VM = VertexOps::viewingTransformation;
-	std::vector<VertexData> projCoords = transformVertices(projectionTransformation, eyeCoords);
-	std::vector<VertexData> clipCoords;
-	for (VertexData v : projCoords) {		// Perspective division
-		if (v.position.w >= 0)
-			v.position /= v.position.w;
-		else {
-			v.position.x /= -v.position.w;
-			v.position.y /= -v.position.w;
-			v.position.z = -std::abs(v.position.z);
-			v.position.w = 1.0f;
+	// Reused from draw to draw, so once their capacity has grown nothing is allocated.
+	static thread_local std::vector<VertexData> callerWindowCoords;
+	static thread_local LightBlock callerLighting;
+	std::vector<VertexData> &windowCoords = callerWindowCoords;
+	windowCoords.clear();
+
+	const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelingTransformation)));
+	const glm::mat4 projViewMatrix = projectionTransformation * viewingTransformation;
+	const LightBlock *lighting = nullptr;
+	if (perVertexLighting && FragmentOps::gBuffer == nullptr) {
+		callerLighting.prepare(lights, viewingTransformation);
+		lighting = &callerLighting;
+	}
+
+	const int numTriangles = (int)objectCoords.size() / 3;
+	if (numTriangles < parallelVertexThreshold) {
+		processTriangleRange(objectCoords, 0, numTriangles, normalMatrix, projViewMatrix, lighting, windowCoords);
+	} else {
+		runInChunks(numTriangles, [&](int first, int last, std::vector<VertexData> &output) {
+			processTriangleRange(objectCoords, first, last, normalMatrix, projViewMatrix, lighting, output);
+		}, windowCoords);
+	}
+
+	rasterizeTriangles(frameBuffer, eyePos, lights, windowCoords);
+}
+
+/**
+ * @fn	void VertexOps::processIndexedRange(const EShapeMesh &mesh, int first, int last, const glm::mat3 &normalMatrix, const glm::mat4 &projViewMatrix, PostTransformCache &cache, std::vector<VertexData> &windowCoords)
+ * @brief	Takes triangles [first, last) of an indexed mesh through the vertex
+ * 			stages, transforming vertices the cache does not yet hold. Several
+ * 			threads may share a cache only if it already holds every vertex.
+ * @param 		  	mesh		  	The mesh, in object coordinates.
+ * @param 		  	first		  	First triangle.
+ * @param 		  	last		  	One past the last triangle.
+ * @param 		  	normalMatrix  	Matrix for transforming normals to world coordinates.
+ * @param 		  	projViewMatrix	Projection times viewing matrix.
+ * @param [in,out]	cache		  	The post-transform cache.
+ * @param [in,out]	windowCoords  	Receives the triangles in window coordinates.
+ */
+
+void VertexOps::processIndexedRange(const EShapeMesh &mesh, int first, int last,
+									const glm::mat3 &normalMatrix, const glm::mat4 &projViewMatrix,
+									PostTransformCache &cache, std::vector<VertexData> &windowCoords) {
+	static thread_local ClipPolygon polygon, scratch;
+	const MaterialLibrary &library = MaterialLibrary::getShared();
+	for (int i = first; i < last; i++) {
+		for (int k = 0; k < 3; k++) {
+			const unsigned int index = mesh.indices[3 * i + k];
+			if (cache.cachedIn[index] != cache.drawNumber) {
+				const MeshVertex &v = mesh.vertices[index];
+				transformToNDC(v.position, v.normal, library[v.materialId], modelingTransformation,
+								normalMatrix, projViewMatrix, cache.transformed[index]);
+				cache.cachedIn[index] = cache.drawNumber;
+			}
+			polygon.verts[k] = cache.transformed[index];
 		}
-		clipCoords.push_back(v);
+		addClippedTriangle(polygon, scratch, windowCoords);
 	}
+}
 
-	if (!renderBackFaces)	// backface culling?
-		clipCoords = removeBackwardFacingTriangles(clipCoords);	
+/**
+ * @fn	void VertexOps::processIndexedTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos, const std::vector<LightSourcePtr> &lights, const EShapeMesh &mesh)
+ * @brief	Transforms the triangles of an indexed mesh through the pipeline. A
+ * 			post-transform cache holds each vertex once it has been transformed,
+ * 			so a vertex shared by several triangles is only transformed once.
+ * 			Meshes of parallelVertexThreshold or more triangles have all of their
+ * 			vertices transformed in parallel chunks first, and then their
+ * 			triangles assembled and clipped in parallel chunks, in order.
+ * @param [in,out]	frameBuffer	Buffer for frame data.
+ * @param 		  	eyePos	   	The eye position.
+ * @param 		  	lights	   	The lights.
+ * @param 		  	mesh	   	The mesh, in object coordinates.
+ */
 
-	std::vector<VertexData> ndcCoords = clipPolygon(clipCoords);
-	std::vector<VertexData> windowCoords = transformVertices(viewportTransformation, ndcCoords);
+void VertexOps::processIndexedTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
+										const std::vector<LightSourcePtr> &lights,
+										const EShapeMesh &mesh) {
+	static thread_local std::vector<VertexData> callerWindowCoords;
+	static thread_local PostTransformCache callerCache;
+	static thread_local LightBlock callerLighting;
+	std::vector<VertexData> &windowCoords = callerWindowCoords;
+	PostTransformCache &cache = callerCache;
+	windowCoords.clear();
+	if (cache.transformed.size() < mesh.vertices.size()) {
+		cache.transformed.resize(mesh.vertices.size());
+		cache.cachedIn.resize(mesh.vertices.size(), 0);
+	}
+	if (++cache.drawNumber == 0) {	// Wrapped around; forget every entry
+		std::fill(cache.cachedIn.begin(), cache.cachedIn.end(), 0);
+		cache.drawNumber = 1;
+	}
+
+	const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelingTransformation)));
+	const glm::mat4 projViewMatrix = projectionTransformation * viewingTransformation;
+	const bool parallel = mesh.numTriangles() >= parallelVertexThreshold;
+	const LightBlock *lighting = nullptr;
+	if (perVertexLighting && FragmentOps::gBuffer == nullptr) {
+		callerLighting.prepare(lights, viewingTransformation);
+		lighting = &callerLighting;
+	}
 
-	for (VertexData &vd : windowCoords) {
-		vd.position.x = glm::clamp(vd.position.x, (float)viewport.lx, (float)viewport.rx);
-		vd.position.y = glm::clamp(vd.position.y, (float)viewport.ly, (float)viewport.ry);
+	// Lighting wants whole batches, and parallel triangles must not race to
+	// fill the cache, so in either case every vertex is transformed up front.
+	if (parallel || lighting != nullptr) {
+		const MaterialLibrary &library = MaterialLibrary::getShared();
+		const int numVertices = (int)mesh.vertices.size();
+		auto transformChunk = [&](int c) {
+			const int first = c * VERTEX_CHUNK;
+			const int last = std::min(numVertices, first + VERTEX_CHUNK);
+			for (int index = first; index < last; index++) {
+				const MeshVertex &v = mesh.vertices[index];
+				transformToNDC(v.position, v.normal, library[v.materialId], modelingTransformation,
+								normalMatrix, projViewMatrix, cache.transformed[index]);
+				cache.cachedIn[index] = cache.drawNumber;
+			}
+			if (lighting != nullptr) {
+				lightVertices(&cache.transformed[first], last - first, *lighting);
+			}
+		};
+		const int numChunks = (numVertices + VERTEX_CHUNK - 1) / VERTEX_CHUNK;
+		if (parallel) {
+			ThreadPool::getShared().parallelFor(numChunks, transformChunk);
+		} else {
+			for (int c = 0; c < numChunks; c++) {
+				transformChunk(c);
+			}
+		}
 	}
 
-	drawManyFilledTriangles(frameBuffer, eyePos, lights, windowCoords, viewingTransformation);
+	if (parallel) {
+		runInChunks(mesh.numTriangles(), [&](int first, int last, std::vector<VertexData> &output) {
+			processIndexedRange(mesh, first, last, normalMatrix, projViewMatrix, cache, output);
+		}, windowCoords);
+	} else {
+		processIndexedRange(mesh, 0, mesh.numTriangles(), normalMatrix, projViewMatrix, cache, windowCoords);
+	}
+
+	rasterizeTriangles(frameBuffer, eyePos, lights, windowCoords);
 }
 
 /**
@@ -346,6 +696,42 @@ void VertexOps::render(FrameBuffer &frameBuffer, const std::vector<VertexData> v
 	VertexOps::processTriangleVertices(frameBuffer, eyePos, lights, verts);
 }
 
+/**
+ * @fn	void VertexOps::render(FrameBuffer &frameBuffer, const EShapeMesh &mesh, const std::vector<LightSourcePtr> &lights, const glm::mat4 &TM)
+ * @brief	Renders an indexed mesh
+ * @param [in,out]	frameBuffer	Buffer for frame data.
+ * @param 		  	mesh	   	The mesh.
+ * @param 		  	lights	   	The lights.
+ * @param 		  	TM		   	The modeling transformation.
+ */
+
+void VertexOps::render(FrameBuffer &frameBuffer, const EShapeMesh &mesh,
+						const std::vector<LightSourcePtr> &lights,
+						const glm::mat4 &TM) {
+	glm::vec3 eyePos = glm::inverse(VertexOps::viewingTransformation)[3].xyz;
+	VertexOps::modelingTransformation = TM;
+	VertexOps::processIndexedTriangles(frameBuffer, eyePos, lights, mesh);
+}
+
+/**
+ * @fn	void VertexOps::render(FrameBuffer &frameBuffer, const EShapeLOD &lod, const std::vector<LightSourcePtr> &lights, const glm::mat4 &TM)
+ * @brief	Renders the level of a LOD chain that suits the shape's size on screen.
+ * @param [in,out]	frameBuffer	Buffer for frame data.
+ * @param 		  	lod		   	The LOD chain.
+ * @param 		  	lights	   	The lights.
+ * @param 		  	TM		   	The modeling transformation.
+ */
+
+void VertexOps::render(FrameBuffer &frameBuffer, const EShapeLOD &lod,
+						const std::vector<LightSourcePtr> &lights,
+						const glm::mat4 &TM) {
+	if (lod.levels.empty()) {
+		return;
+	}
+	const int level = lod.selectLevel(TM, viewingTransformation, projectionTransformation, (float)viewport.height());
+	render(frameBuffer, lod.levels[level], lights, TM);
+}
+
 /**
  * @fn	void VertexOps::setViewport(float left, float right, float bottom, float top)
  * @brief	Sets a viewport to a particular setting.
@@ -376,9 +762,10 @@ void VertexOps::setViewport(const BoundingBoxi &vp) {
  */
 
 void VertexOps::setViewportTransformation() {
-	VertexOps::viewportTransformation = T((float)VertexOps::viewport.lx,
-											(float)VertexOps::viewport.ly, 0.0f) *
-		S((float)VertexOps::viewport.width() / VertexOps::ndc.width(),
-			(float)VertexOps::viewport.height() / VertexOps::ndc.height(), 1.0f) *
-		T(-VertexOps::ndc.lx, -VertexOps::ndc.ly, 0.0f);
+	// Built with glm rather than T() and S(), which are left as exercises.
+	VertexOps::viewportTransformation = glm::translate(glm::mat4(1.0f), glm::vec3((float)VertexOps::viewport.lx,
+																				(float)VertexOps::viewport.ly, 0.0f)) *
+		glm::scale(glm::mat4(1.0f), glm::vec3((float)VertexOps::viewport.width() / VertexOps::ndc.width(),
+												(float)VertexOps::viewport.height() / VertexOps::ndc.height(), 1.0f)) *
+		glm::translate(glm::mat4(1.0f), glm::vec3(-VertexOps::ndc.lx, -VertexOps::ndc.ly, 0.0f));
 }
\ No newline at end of file
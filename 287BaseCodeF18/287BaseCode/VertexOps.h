@@ -4,9 +4,39 @@
 #include "FrameBuffer.h"
 #include "Light.h"
 #include "VertexData.h"
+#include "EShape.h"
 #include "IScene.h"
 #include "Rasterization.h"
 
+const int MAX_CLIP_VERTICES = 9;			//!< A triangle clipped by 6 planes has at most 3 + 6 vertices.
+const unsigned int ALL_NDC_PLANES = 0x3F;	//!< Outcode bit i stands for VertexOps::ndcPlanes[i].
+
+/**
+ * @struct	ClipPolygon
+ * @brief	A convex polygon being clipped, held in fixed-capacity inline storage.
+ */
+
+struct ClipPolygon {
+	VertexData verts[MAX_CLIP_VERTICES];	//!< The vertices, in order
+	int count;								//!< Number of vertices in use
+	ClipPolygon() : count(0) {}
+};
+
+const int TRIANGLE_BATCH = 8;				//!< Triangles transformed together; 24 vertices fill whole SIMD batches.
+const int VERTEX_CHUNK = 4096;				//!< Triangles, or vertices, per task of the parallel vertex stage.
+
+/**
+ * @struct	PostTransformCache
+ * @brief	Mesh vertices already transformed during the current draw, by index.
+ */
+
+struct PostTransformCache {
+	std::vector<VertexData> transformed;	//!< The transformed vertices
+	std::vector<unsigned int> cachedIn;		//!< Draw that filled each entry
+	unsigned int drawNumber;				//!< The current draw
+	PostTransformCache() : drawNumber(0) {}
+};
+
 /**
  * @class	VertexOps
  * @brief	Class to encapsulate the methods related to vertex processing.
@@ -15,6 +45,10 @@
 class VertexOps {
 public:
 	static bool renderBackFaces;				//!< Typically false for closed body objects (e.g., sphere).
+	static bool binnedRasterization;			//!< True ==> rasterize screen tiles in parallel.
+	static bool perVertexLighting;				//!< True ==> vertices are lit, and the colors interpolated across triangles. Ignored when shading is deferred.
+	static int parallelVertexThreshold;			//!< Triangle count at which the vertex stage runs on the thread pool.
+	static float guardBand;						//!< NDC x/y extent within which triangles are scissored rather than clipped.
 	static glm::mat4 modelingTransformation;	//!< Used to orient/scale/position objects. Changed often.
 	static glm::mat4 viewingTransformation;		//!< Orient/position camera.
 	static glm::mat4 projectionTransformation;	//!< Define projection. Typically set just once.
@@ -31,22 +65,45 @@ public:
 										const std::vector<LightSourcePtr> &lights,
 										const glm::mat4 &TM,
 										const std::vector<VertexData> &objectCoords);
+	static void processIndexedTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
+										const std::vector<LightSourcePtr> &lights,
+										const EShapeMesh &mesh);
 	static void processLineSegments(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
 									const std::vector<LightSourcePtr> &lights,
 									const std::vector<VertexData> &objectCoords);
 	static void VertexOps::render(FrameBuffer &frameBuffer, const std::vector<VertexData> verts,
 								const std::vector<LightSourcePtr> &lights,
 								const glm::mat4 &TM);
+	static void render(FrameBuffer &frameBuffer, const EShapeMesh &mesh,
+						const std::vector<LightSourcePtr> &lights,
+						const glm::mat4 &TM);
+	static void render(FrameBuffer &frameBuffer, const EShapeLOD &lod,
+						const std::vector<LightSourcePtr> &lights,
+						const glm::mat4 &TM);
 	static void setViewport(int left, int right, int bottom, int top);
 	static void setViewport(const BoundingBoxi &vp);
 protected:
 	static BoundingBoxi viewport;			//!< the currently active viewport
 	static void setViewportTransformation();
-	static std::vector<VertexData> clipAgainstPlane(std::vector<VertexData> &verts, const IPlane &plane);
-	static std::vector<VertexData> clipPolygon(const std::vector<VertexData> &clipCoords);
+	static void clipAgainstPlane(const ClipPolygon &input, const IPlane &plane, ClipPolygon &output);
+	static void clipPolygon(ClipPolygon &polygon, ClipPolygon &scratch, unsigned int planeMask = ALL_NDC_PLANES);
 	static std::vector<VertexData> clipLineSegments(const std::vector<VertexData> &clipCoords);
-	static std::vector<VertexData> removeBackwardFacingTriangles(const std::vector<VertexData> &triangleVerts);
+	static bool isBackwardFacing(const VertexData &v0, const VertexData &v1, const VertexData &v2);
+	static void transformToNDC(const glm::vec4 &position, const glm::vec3 &normal, const Material &material,
+								const glm::mat4 &modelMatrix, const glm::mat3 &normalMatrix,
+								const glm::mat4 &projViewMatrix, VertexData &ndcVertex);
+	static void addClippedTriangle(ClipPolygon &polygon, ClipPolygon &scratch, std::vector<VertexData> &windowCoords);
+	static void processTriangleRange(const std::vector<VertexData> &objectCoords, int first, int last,
+									const glm::mat3 &normalMatrix, const glm::mat4 &projViewMatrix,
+									const LightBlock *lighting, std::vector<VertexData> &windowCoords);
+	static void processIndexedRange(const EShapeMesh &mesh, int first, int last,
+									const glm::mat3 &normalMatrix, const glm::mat4 &projViewMatrix,
+									PostTransformCache &cache, std::vector<VertexData> &windowCoords);
+	static void rasterizeTriangles(FrameBuffer &frameBuffer, const glm::vec3 &eyePos,
+									const std::vector<LightSourcePtr> &lights,
+									const std::vector<VertexData> &windowCoords);
 	static std::vector<VertexData> transformVerticesToWorldCoordinates(const glm::mat4 &modelMatrix, const std::vector<VertexData> &vertices);
 	static void applyLighting(const std::vector<LightSourcePtr> &lights, std::vector<VertexData> &worldCoords);
+	static void lightVertices(VertexData *vertices, int count, const LightBlock &lighting);
 	static std::vector<VertexData> transformVertices(const glm::mat4 &TM, const std::vector<VertexData> &vertices);
 };